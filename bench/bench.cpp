@@ -0,0 +1,936 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "deckview.h"
+#include "bench.h"
+
+// Headless benchmark of the upload paths and the frame conversion shaders,
+// and of the CPU conversion, audio meter, mix and resample kernels (see kernels.cpp).
+// Renders into an offscreen framebuffer of a surfaceless EGL context, so it
+// also runs on software GL (Mesa llvmpipe) without a GPU or display. Every
+// case prints one JSON object per line.
+
+typedef struct {
+	const char*	name;
+	unsigned int	width;
+	unsigned int	height;
+} Size;
+
+static const Size inputs[] = {
+	{ "720p",  1280, 720 },
+	{ "1080p", 1920, 1080 },
+	{ "2160p", 3840, 2160 }
+};
+
+static const Size outputs[] = {
+	{ "720p",  1280, 720 },
+	{ "1080p", 1920, 1080 },
+	{ "2160p", 3840, 2160 }
+};
+
+static const BMDPixelFormat formats[] = {
+	bmdFormat8BitYUV,
+	bmdFormat10BitYUV,
+	bmdFormat10BitRGB
+};
+
+static const GXUploadMode upload_modes[] = {
+	GX_UPLOAD_DIRECT,
+	GX_UPLOAD_PBO
+};
+
+static const GXComposeMode compose_modes[] = {
+	GX_COMPOSE_TILES,
+	GX_COMPOSE_ARRAY
+};
+
+static const unsigned int multiview_counts[] = { 4, 16 };
+
+// 16 UHD inputs would need several GB of RGBA16F textures
+#define	MULTIVIEW_MAX_PIXELS	(16 * 1920 * 1080)
+
+#define	COUNT(x)	(sizeof(x) / sizeof(*(x)))
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+
+int64_t bench_time_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool init_egl(void)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(get_platform_display) {
+		display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+
+	if(display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+		fprintf(stderr, "Failed to initialize EGL\n");
+		return false;
+	}
+
+	if(!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "Desktop OpenGL is not available through EGL\n");
+		return false;
+	}
+
+	const EGLint config_attribs[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+
+	// rendering goes to an FBO, so a context without config is enough when
+	// the display (e.g. surfaceless) exposes none
+	EGLConfig config = EGL_NO_CONFIG_KHR;
+	EGLint config_count = 0;
+	if(!eglChooseConfig(display, config_attribs, &config, 1, &config_count) || config_count < 1) {
+		const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+		if(!extensions || !strstr(extensions, "EGL_KHR_no_config_context")) {
+			fprintf(stderr, "No suitable EGL config\n");
+			return false;
+		}
+		config = EGL_NO_CONFIG_KHR;
+	}
+
+	// prefer 4.5 core for the PBO path, fall back to the 3.3 the shaders need
+	const EGLint versions[2][2] = { { 4, 5 }, { 3, 3 } };
+	for(unsigned int i = 0; i < 2 && context == EGL_NO_CONTEXT; i++) {
+		const EGLint context_attribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, versions[i][0],
+			EGL_CONTEXT_MINOR_VERSION, versions[i][1],
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+	}
+
+	if(context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "Failed to create an OpenGL 3.3 context\n");
+		return false;
+	}
+
+	if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		fprintf(stderr, "Surfaceless contexts are not supported\n");
+		return false;
+	}
+
+	return true;
+}
+
+static void destroy_egl(void)
+{
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglTerminate(display);
+}
+
+static size_t row_bytes_for(BMDPixelFormat fmt, unsigned int width)
+{
+	switch(fmt) {
+		case bmdFormat8BitYUV:
+			return width * 2;
+		case bmdFormat10BitYUV:
+			return ((width + 47) / 48) * 128;
+		case bmdFormat10BitRGB:
+			return ((width + 63) / 64) * 256;
+		default:
+			return 0;
+	}
+}
+
+static const char* format_name(BMDPixelFormat fmt)
+{
+	switch(fmt) {
+		case bmdFormat8BitYUV:
+			return "uyvy";
+		case bmdFormat10BitYUV:
+			return "v210";
+		case bmdFormat10BitRGB:
+			return "r210";
+		default:
+			return "unknown";
+	}
+}
+
+// Noise, so nothing can take shortcuts on uniform data
+void bench_fill(uint8_t* data, size_t size)
+{
+	uint32_t x = 0x12345678;
+	for(size_t i = 0; i < size; i++) {
+		x = x * 1664525 + 1013904223;
+		data[i] = x >> 24;
+	}
+}
+
+typedef struct {
+	GLuint	fbo;
+	GLuint	color;
+} Target;
+
+static void create_target(Target* t, unsigned int width, unsigned int height)
+{
+	glGenTextures(1, &t->color);
+	glBindTexture(GL_TEXTURE_2D, t->color);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+
+	glGenFramebuffers(1, &t->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, t->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t->color, 0);
+	glViewport(0, 0, width, height);
+}
+
+static void destroy_target(Target* t)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &t->fbo);
+	glDeleteTextures(1, &t->color);
+}
+
+static GLuint64 query_result(GLuint query)
+{
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+	return elapsed;
+}
+
+static void run_case(GXRenderer* renderer, BMDPixelFormat fmt, const Size* in, const Size* out, bool interpolate, GXUploadMode mode, unsigned int frames, const uint8_t* data)
+{
+	size_t row_bytes = row_bytes_for(fmt, in->width);
+	size_t size = row_bytes * in->height;
+
+	GXSetUploadMode(renderer, mode);
+	if(renderer->upload_mode != mode) {
+		return;
+	}
+
+	Target target;
+	create_target(&target, out->width, out->height);
+
+	GLuint queries[2];
+	glGenQueries(2, queries);
+
+	// warm up: texture allocation, shader compilation in the driver
+	for(unsigned int i = 0; i < 3; i++) {
+		GXUploadFrame(renderer, fmt, in->width, in->height, row_bytes, data);
+		GXDraw(renderer, interpolate, 1.0);
+	}
+	glFinish();
+
+	int64_t upload_cpu = 0;
+	GLuint64 upload_gpu = 0;
+	GLuint64 draw_gpu = 0;
+
+	int64_t start = bench_time_us();
+	for(unsigned int i = 0; i < frames; i++) {
+		int64_t t = bench_time_us();
+		glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+		GXUploadFrame(renderer, fmt, in->width, in->height, row_bytes, data);
+		glEndQuery(GL_TIME_ELAPSED);
+		upload_cpu += bench_time_us() - t;
+
+		// the unpack if GXDraw needs one, or the decode into the output
+		glBeginQuery(GL_TIME_ELAPSED, queries[1]);
+		GXDraw(renderer, interpolate, 1.0);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		// reading the results serializes frames like a swap would
+		upload_gpu += query_result(queries[0]);
+		draw_gpu += query_result(queries[1]);
+	}
+	glFinish();
+	int64_t total = bench_time_us() - start;
+
+	GL_ERROR();
+
+	double seconds = total / 1000000.0;
+	printf("{\"format\":\"%s\",\"input\":\"%s\",\"output\":\"%s\",\"interpolate\":%s,\"upload\":\"%s\","
+		"\"frames\":%u,\"fps\":%.2f,\"upload_cpu_ms\":%.3f,\"upload_gpu_ms\":%.3f,\"upload_gbps\":%.3f,\"draw_gpu_ms\":%.3f}\n",
+		format_name(fmt), in->name, out->name, interpolate ? "true" : "false", GXUploadModeName(mode),
+		frames, frames / seconds,
+		upload_cpu / 1000.0 / frames,
+		upload_gpu / 1000000.0 / frames,
+		(double) size * frames / (upload_cpu / 1000000.0) / 1e9,
+		draw_gpu / 1000000.0 / frames);
+	fflush(stdout);
+
+	glDeleteQueries(2, queries);
+	destroy_target(&target);
+}
+
+// Same grid as the renderer, row by row from the top left
+static void tile_rect(unsigned int index, unsigned int count, const Size* out, GXTile* t)
+{
+	unsigned int cols = 1;
+	while(cols * cols < count) {
+		cols++;
+	}
+	unsigned int rows = (count + cols - 1) / cols;
+
+	unsigned int col = index % cols;
+	unsigned int row = index / cols;
+
+	t->x = out->width * col / cols;
+	t->width = out->width * (col + 1) / cols - t->x;
+	t->y = out->height - out->height * (row + 1) / rows;
+	t->height = out->height * (row + 1) / rows - out->height * row / rows;
+}
+
+// Composites count inputs of the same size into one output. Every input gets
+// a new frame each iteration; the upload is the same for both modes and not
+// part of the measured compositing time.
+static void run_multiview(GXRenderer* renderers, GXComposite* composite, GXComposeMode compose, BMDPixelFormat fmt, const Size* in, const Size* out, unsigned int count, unsigned int frames, const uint8_t* data)
+{
+	size_t row_bytes = row_bytes_for(fmt, in->width);
+
+	Target target;
+	create_target(&target, out->width, out->height);
+
+	GXTile tiles[GX_MAX_INPUTS];
+	for(unsigned int i = 0; i < count; i++) {
+		tile_rect(i, count, out, &tiles[i]);
+	}
+
+	GXCompositeInvalidate(composite);
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	GLuint64 compose_gpu = 0;
+	int64_t start = 0;
+
+	// the first 3 iterations warm up
+	for(unsigned int f = 0; f < frames + 3; f++) {
+		if(f == 3) {
+			glFinish();
+			start = bench_time_us();
+			compose_gpu = 0;
+		}
+
+		for(unsigned int i = 0; i < count; i++) {
+			GXUploadFrame(&renderers[i], fmt, in->width, in->height, row_bytes, data);
+		}
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		if(compose == GX_COMPOSE_ARRAY) {
+			for(unsigned int i = 0; i < count; i++) {
+				GXCompositeUnpack(composite, i, &renderers[i], &tiles[i]);
+			}
+			GXCompositeDraw(composite, tiles, count, 1.0);
+		} else {
+			for(unsigned int i = 0; i < count; i++) {
+				const GXTile* t = &tiles[i];
+				glViewport(t->x, t->y, t->width, t->height);
+				GXDraw(&renderers[i], t->width != (int) in->width || t->height != (int) in->height, 1.0);
+			}
+			glViewport(0, 0, out->width, out->height);
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+
+		compose_gpu += query_result(query);
+	}
+	glFinish();
+	int64_t total = bench_time_us() - start;
+
+	GL_ERROR();
+
+	double seconds = total / 1000000.0;
+	printf("{\"compose\":\"%s\",\"inputs\":%u,\"format\":\"%s\",\"input\":\"%s\",\"output\":\"%s\","
+		"\"frames\":%u,\"fps\":%.2f,\"compose_gpu_ms\":%.3f}\n",
+		GXComposeModeName(compose), count, format_name(fmt), in->name, out->name,
+		frames, frames / seconds,
+		compose_gpu / 1000000.0 / frames);
+	fflush(stdout);
+
+	glDeleteQueries(1, &query);
+	destroy_target(&target);
+}
+
+static void bench_multiview(GXRenderer* share, unsigned int frames, const char* only_input, const char* only_output, const uint8_t* data)
+{
+	static GXRenderer renderers[GX_MAX_INPUTS];
+
+	for(unsigned int i = 0; i < GX_MAX_INPUTS; i++) {
+		GXRendererInit(&renderers[i], share);
+		GXSetUploadMode(&renderers[i], GX_UPLOAD_DIRECT);
+	}
+
+	GXComposite composite;
+	GXCompositeInit(&composite, share, GX_MAX_INPUTS);
+
+	for(unsigned int i = 0; i < COUNT(inputs); i++) {
+		if(only_input && strcmp(only_input, inputs[i].name)) {
+			continue;
+		}
+
+		for(unsigned int o = 0; o < COUNT(outputs); o++) {
+			if(only_output && strcmp(only_output, outputs[o].name)) {
+				continue;
+			}
+
+			for(unsigned int n = 0; n < COUNT(multiview_counts); n++) {
+				if(multiview_counts[n] * inputs[i].width * inputs[i].height > MULTIVIEW_MAX_PIXELS) {
+					continue;
+				}
+
+				for(unsigned int c = 0; c < COUNT(compose_modes); c++) {
+					run_multiview(renderers, &composite, compose_modes[c], bmdFormat10BitYUV, &inputs[i], &outputs[o], multiview_counts[n], frames, data);
+				}
+			}
+		}
+	}
+
+	GXCompositeDestroy(&composite);
+	for(unsigned int i = 0; i < GX_MAX_INPUTS; i++) {
+		GXUploadDestroy(&renderers[i]);
+	}
+}
+
+// Computes and draws one scope of a new frame each iteration, the upload and
+// unpack are not part of the measured times
+static void run_scope(GXRenderer* renderer, GXScopes* scopes, GXScope scope, BMDPixelFormat fmt, const Size* in, unsigned int frames, const uint8_t* data)
+{
+	size_t row_bytes = row_bytes_for(fmt, in->width);
+
+	// a scope panel of a 1080p window
+	Target target;
+	create_target(&target, 480, 360);
+
+	GLuint queries[2];
+	glGenQueries(2, queries);
+
+	GLuint64 scatter_gpu = 0;
+	GLuint64 draw_gpu = 0;
+
+	// the first 3 iterations warm up
+	for(unsigned int f = 0; f < frames + 3; f++) {
+		if(f == 3) {
+			scatter_gpu = 0;
+			draw_gpu = 0;
+		}
+
+		GXUploadFrame(renderer, fmt, in->width, in->height, row_bytes, data);
+		GXUnpackFrame(renderer);
+
+		glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+		GXScopesCompute(scopes, scope, renderer);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		glBeginQuery(GL_TIME_ELAPSED, queries[1]);
+		GXScopesDraw(scopes, scope);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		scatter_gpu += query_result(queries[0]);
+		draw_gpu += query_result(queries[1]);
+	}
+
+	GL_ERROR();
+
+	GXScopeStats st;
+	GXScopesGetStats(scopes, scope, &st);
+
+	printf("{\"scope\":\"%s\",\"format\":\"%s\",\"input\":\"%s\",\"samples\":%u,"
+		"\"frames\":%u,\"scatter_gpu_ms\":%.3f,\"draw_gpu_ms\":%.3f}\n",
+		GXScopeName(scope), format_name(fmt), in->name, st.samples,
+		frames,
+		scatter_gpu / 1000000.0 / frames,
+		draw_gpu / 1000000.0 / frames);
+	fflush(stdout);
+
+	glDeleteQueries(2, queries);
+	destroy_target(&target);
+}
+
+static void bench_scopes(GXRenderer* share, unsigned int frames, const char* only_input, const uint8_t* data)
+{
+	GXRenderer renderer;
+	memset(&renderer, 0, sizeof(renderer));
+	GXRendererInit(&renderer, share);
+	GXSetUploadMode(&renderer, GX_UPLOAD_DIRECT);
+
+	GXScopes scopes;
+	GXScopesInit(&scopes, share);
+
+	for(unsigned int f = 0; f < COUNT(formats); f++) {
+		for(unsigned int i = 0; i < COUNT(inputs); i++) {
+			if(only_input && strcmp(only_input, inputs[i].name)) {
+				continue;
+			}
+
+			for(unsigned int s = 0; s < GX_SCOPE_CNT; s++) {
+				run_scope(&renderer, &scopes, (GXScope) s, formats[f], &inputs[i], frames, data);
+			}
+		}
+	}
+
+	GXScopesDestroy(&scopes);
+	GXUploadDestroy(&renderer);
+}
+
+// Scales a new frame each iteration in every mode, the upload and unpack
+// are not part of the measured times. The frame is a smooth ramp, so the
+// output differs from the bilinear one by less than an 8 bit step on
+// average unless a pass is misplaced.
+static const Size scale_cases[][2] = {
+	{ { "1080p", 1920, 1080 }, { "2160p", 3840, 2160 } },
+	{ { "720p",  1280, 720 },  { "2160p", 3840, 2160 } },
+	{ { "2160p", 3840, 2160 }, { "1080p", 1920, 1080 } },
+	{ { "1080p", 1920, 1080 }, { "720p",  1280, 720 } }
+};
+
+static void read_target(const Size* out, uint8_t* pixels)
+{
+	glReadPixels(0, 0, out->width, out->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+static void run_scale(GXRenderer* renderer, GXScaler* scaler, GXScaleMode mode, BMDPixelFormat fmt, const Size* in, const Size* out, unsigned int frames, const uint8_t* data)
+{
+	size_t row_bytes = row_bytes_for(fmt, in->width);
+	size_t pixels_size = (size_t) out->width * out->height * 4;
+	uint8_t* reference = (uint8_t*) malloc(pixels_size);
+	uint8_t* pixels = (uint8_t*) malloc(pixels_size);
+
+	Target target;
+	create_target(&target, out->width, out->height);
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	GXUploadFrame(renderer, fmt, in->width, in->height, row_bytes, data);
+	GXScalerSetMode(scaler, GX_SCALE_BILINEAR);
+	GXScalerDraw(scaler, 0, renderer, 1.0);
+	read_target(out, reference);
+	GXScalerSetMode(scaler, mode);
+
+	GLuint64 scale_gpu = 0;
+
+	// the first 3 iterations warm up
+	for(unsigned int f = 0; f < frames + 3; f++) {
+		if(f == 3) {
+			scale_gpu = 0;
+		}
+
+		GXUploadFrame(renderer, fmt, in->width, in->height, row_bytes, data);
+		GXUnpackFrame(renderer);
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		GXScalerDraw(scaler, 0, renderer, 1.0);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		scale_gpu += query_result(query);
+	}
+
+	GL_ERROR();
+
+	read_target(out, pixels);
+	double diff = 0.0;
+	for(size_t i = 0; i < pixels_size; i++) {
+		diff += abs(pixels[i] - reference[i]);
+	}
+
+	printf("{\"scale\":\"%s\",\"format\":\"%s\",\"input\":\"%s\",\"output\":\"%s\","
+		"\"frames\":%u,\"scale_gpu_ms\":%.3f,\"mean_diff_vs_bilinear\":%.3f}\n",
+		GXScaleModeName(mode), format_name(fmt), in->name, out->name,
+		frames,
+		scale_gpu / 1000000.0 / frames,
+		diff / pixels_size);
+	fflush(stdout);
+
+	glDeleteQueries(1, &query);
+	destroy_target(&target);
+	free(reference);
+	free(pixels);
+}
+
+// UYVY with luma rising left to right and top to bottom, neutral chroma
+static void fill_ramp(uint8_t* data, const Size* in)
+{
+	size_t row_bytes = row_bytes_for(bmdFormat8BitYUV, in->width);
+	for(unsigned int y = 0; y < in->height; y++) {
+		for(unsigned int x = 0; x < in->width; x++) {
+			uint8_t* p = data + y * row_bytes + x * 2;
+			p[0] = 128;
+			p[1] = (uint8_t) (16 + 219 * (x + y) / (in->width + in->height));
+		}
+	}
+}
+
+static void bench_scale(GXRenderer* share, unsigned int frames, const char* only_input, const char* only_output)
+{
+	uint8_t* data = (uint8_t*) malloc(row_bytes_for(bmdFormat8BitYUV, 3840) * 2160);
+
+	GXRenderer renderer;
+	memset(&renderer, 0, sizeof(renderer));
+	GXRendererInit(&renderer, share);
+	GXSetUploadMode(&renderer, GX_UPLOAD_DIRECT);
+
+	// no budget, every mode is measured as it is
+	GXScaler scaler;
+	GXScalerInit(&scaler, share, GX_SCALE_BILINEAR, 0);
+
+	for(unsigned int c = 0; c < COUNT(scale_cases); c++) {
+		const Size* in = &scale_cases[c][0];
+		const Size* out = &scale_cases[c][1];
+		if((only_input && strcmp(only_input, in->name)) || (only_output && strcmp(only_output, out->name))) {
+			continue;
+		}
+
+		fill_ramp(data, in);
+		for(unsigned int m = 0; m < GX_SCALE_CNT; m++) {
+			run_scale(&renderer, &scaler, (GXScaleMode) m, bmdFormat8BitYUV, in, out, frames, data);
+		}
+	}
+
+	GXScalerDestroy(&scaler);
+	GXUploadDestroy(&renderer);
+	free(data);
+}
+
+// Deinterlaces a new frame each iteration, both fields, in every mode. Only
+// the second fields are timed, the first ones include the unpack. The
+// frame is the same noise every time, a still picture, which the adaptive
+// mode shows as woven, at full vertical resolution, and bob does not.
+static const Size interlaced_inputs[] = {
+	{ "576i",  720,  576 },
+	{ "1080i", 1920, 1080 }
+};
+
+static void run_deinterlace(GXRenderer* renderer, GXDeinterlacer* deinterlacer, GXDeinterlaceMode mode, BMDPixelFormat fmt, const Size* in, unsigned int frames, const uint8_t* data)
+{
+	size_t row_bytes = row_bytes_for(fmt, in->width);
+	size_t pixels_size = (size_t) in->width * in->height * 4;
+	uint8_t* reference = (uint8_t*) malloc(pixels_size);
+	uint8_t* pixels = (uint8_t*) malloc(pixels_size);
+
+	Target target;
+	create_target(&target, in->width, in->height);
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	GXUploadFrame(renderer, fmt, in->width, in->height, row_bytes, data);
+	GXUnpackFrame(renderer);
+	renderer->shown = renderer->unpacked;
+	GXDraw(renderer, false, 1.0);
+	read_target(in, reference);
+	GXDeinterlacerSetMode(deinterlacer, mode);
+
+	GLuint64 field_gpu = 0;
+
+	// the first 3 iterations warm up
+	for(unsigned int f = 0; f < frames + 3; f++) {
+		if(f == 3) {
+			field_gpu = 0;
+		}
+
+		GXUploadFrame(renderer, fmt, in->width, in->height, row_bytes, data);
+		GXDeinterlacerDraw(deinterlacer, 0, renderer, 0, true);
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		GXDeinterlacerDraw(deinterlacer, 0, renderer, 1, false);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		field_gpu += query_result(query);
+	}
+
+	GXDraw(renderer, false, 1.0);
+	GL_ERROR();
+
+	read_target(in, pixels);
+	double diff = 0.0;
+	for(size_t i = 0; i < pixels_size; i++) {
+		diff += abs(pixels[i] - reference[i]);
+	}
+
+	printf("{\"deinterlace\":\"%s\",\"format\":\"%s\",\"input\":\"%s\","
+		"\"frames\":%u,\"field_gpu_ms\":%.3f,\"mean_diff_vs_weave\":%.3f}\n",
+		GXDeinterlaceModeName(mode), format_name(fmt), in->name,
+		frames,
+		field_gpu / 1000000.0 / frames,
+		diff / pixels_size);
+	fflush(stdout);
+
+	glDeleteQueries(1, &query);
+	destroy_target(&target);
+	free(reference);
+	free(pixels);
+}
+
+static void bench_deinterlace(GXRenderer* share, unsigned int frames, const char* only_input, const uint8_t* data)
+{
+	GXRenderer renderer;
+	memset(&renderer, 0, sizeof(renderer));
+	GXRendererInit(&renderer, share);
+	GXSetUploadMode(&renderer, GX_UPLOAD_DIRECT);
+
+	GXDeinterlacer deinterlacer;
+	GXDeinterlacerInit(&deinterlacer, share, GX_DEINTERLACE_WEAVE);
+
+	for(unsigned int i = 0; i < COUNT(interlaced_inputs); i++) {
+		if(only_input && strcmp(only_input, interlaced_inputs[i].name)) {
+			continue;
+		}
+
+		for(unsigned int m = 0; m < GX_DEINTERLACE_CNT; m++) {
+			run_deinterlace(&renderer, &deinterlacer, (GXDeinterlaceMode) m, bmdFormat8BitYUV, &interlaced_inputs[i], frames, data);
+		}
+	}
+
+	GXDeinterlacerDestroy(&deinterlacer);
+	GXUploadDestroy(&renderer);
+}
+
+// Unpacks a frame of reference white (Y' 235, neutral chroma) with every
+// colorimetry variant. The first unpack after switching is timed on its
+// own and once more after the others, both with the CPU waiting for them:
+// the variants are built with the renderer, so the first should cost what
+// the later ones do. white is the red channel it shows as: 255 where 235
+// is the top of the range, for HDR its peak, tone mapped to white, and less
+// at full range.
+static void run_colorimetry(GXRenderer* renderer, const GXColorimetry* c, const Size* in, unsigned int frames, const uint8_t* data)
+{
+	size_t row_bytes = row_bytes_for(bmdFormat8BitYUV, in->width);
+
+	Target target;
+	create_target(&target, in->width, in->height);
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	GXUploadFrame(renderer, bmdFormat8BitYUV, in->width, in->height, row_bytes, data);
+
+	glFinish();
+	int64_t start = bench_time_us();
+	GXSetColorimetry(renderer, c);
+	GXUnpackFrame(renderer);
+	glFinish();
+	int64_t first = bench_time_us() - start;
+
+	GLuint64 unpack_gpu = 0;
+
+	// the first 3 iterations warm up
+	for(unsigned int f = 0; f < frames + 3; f++) {
+		if(f == 3) {
+			unpack_gpu = 0;
+		}
+
+		GXUploadFrame(renderer, bmdFormat8BitYUV, in->width, in->height, row_bytes, data);
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		GXUnpackFrame(renderer);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		unpack_gpu += query_result(query);
+	}
+
+	GXUploadFrame(renderer, bmdFormat8BitYUV, in->width, in->height, row_bytes, data);
+	glFinish();
+	start = bench_time_us();
+	GXUnpackFrame(renderer);
+	glFinish();
+	int64_t again = bench_time_us() - start;
+
+	renderer->shown = renderer->unpacked;
+	GXDraw(renderer, false, 1.0);
+	GL_ERROR();
+
+	uint8_t pixel[4];
+	glReadPixels(in->width / 2, in->height / 2, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+
+	printf("{\"colorspace\":\"%s\",\"range\":\"%s\",\"transfer\":\"%s\",\"format\":\"%s\",\"input\":\"%s\","
+		"\"frames\":%u,\"first_unpack_ms\":%.3f,\"unpack_ms\":%.3f,\"unpack_gpu_ms\":%.3f,\"white\":%u}\n",
+		GXColorspaceName(c->colorspace), GXRangeName(c->range), GXTransferName(c->transfer), format_name(bmdFormat8BitYUV), in->name,
+		frames,
+		first / 1000.0,
+		again / 1000.0,
+		unpack_gpu / 1000000.0 / frames,
+		pixel[0]);
+	fflush(stdout);
+
+	glDeleteQueries(1, &query);
+	destroy_target(&target);
+}
+
+static void bench_colorimetry(GXRenderer* share, unsigned int frames, const char* only_input)
+{
+	uint8_t* data = (uint8_t*) malloc(row_bytes_for(bmdFormat8BitYUV, 3840) * 2160);
+
+	GXRenderer renderer;
+	memset(&renderer, 0, sizeof(renderer));
+	GXRendererInit(&renderer, share);
+	GXSetUploadMode(&renderer, GX_UPLOAD_DIRECT);
+
+	for(unsigned int i = 0; i < COUNT(inputs); i++) {
+		if(only_input && strcmp(only_input, inputs[i].name)) {
+			continue;
+		}
+
+		size_t row_bytes = row_bytes_for(bmdFormat8BitYUV, inputs[i].width);
+		for(unsigned int y = 0; y < inputs[i].height; y++) {
+			for(unsigned int x = 0; x < inputs[i].width; x++) {
+				uint8_t* p = data + y * row_bytes + x * 2;
+				p[0] = 128;
+				p[1] = 235;
+			}
+		}
+
+		GXColorimetry c;
+		for(unsigned int cs = 0; cs < GX_COLORSPACE_CNT; cs++) {
+			for(unsigned int r = 0; r < GX_RANGE_CNT; r++) {
+				for(unsigned int t = 0; t < GX_TRANSFER_CNT; t++) {
+					c.colorspace = (GXColorspace) cs;
+					c.range = (GXRange) r;
+					c.transfer = (GXTransfer) t;
+					run_colorimetry(&renderer, &c, &inputs[i], frames, data);
+				}
+			}
+		}
+	}
+
+	GXUploadDestroy(&renderer);
+	free(data);
+}
+
+static void usage(const char* self)
+{
+	printf("Usage: %s [-k gl|cpu|audio|multiview|scopes|scale|deinterlace|colorimetry] [-n frames] [-i 720p|1080p|2160p|576i|1080i] [-o 720p|1080p|2160p] [-u direct|pbo] [-t threads]\n", self);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int frames = 30;
+	const char* only_input = NULL;
+	const char* only_output = NULL;
+	const char* only_upload = NULL;
+	const char* only_kind = NULL;
+	unsigned int threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	int opt;
+	while((opt = getopt(argc, argv, "n:i:o:u:k:t:h")) != -1) {
+		switch(opt) {
+			case 'n':
+				frames = atoi(optarg);
+				break;
+			case 'i':
+				only_input = optarg;
+				break;
+			case 'o':
+				only_output = optarg;
+				break;
+			case 'u':
+				only_upload = optarg;
+				break;
+			case 'k':
+				only_kind = optarg;
+				break;
+			case 't':
+				threads = atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if(!only_kind || !strcmp(only_kind, "cpu")) {
+		bench_convert(frames, threads);
+	}
+
+	if(!only_kind || !strcmp(only_kind, "audio")) {
+		bench_meter();
+		bench_mix();
+		bench_resample();
+	}
+
+	if(only_kind && strcmp(only_kind, "gl") && strcmp(only_kind, "multiview") && strcmp(only_kind, "scopes") && strcmp(only_kind, "scale") && strcmp(only_kind, "deinterlace") && strcmp(only_kind, "colorimetry")) {
+		return 0;
+	}
+
+	if(!init_egl()) {
+		return 1;
+	}
+
+	fprintf(stderr, "GL Renderer: %s\n", glGetString(GL_RENDERER));
+	fprintf(stderr, "GL Version:  %s\n", glGetString(GL_VERSION));
+
+	GXRenderer renderer;
+	memset(&renderer, 0, sizeof(renderer));
+	int64_t start = bench_time_us();
+	GXRendererInit(&renderer, NULL);
+	fprintf(stderr, "Renderer:    %.1f ms to build the shaders\n", (bench_time_us() - start) / 1000.0);
+
+	size_t max_size = 0;
+	for(unsigned int f = 0; f < COUNT(formats); f++) {
+		if(row_bytes_for(formats[f], 3840) * 2160 > max_size) {
+			max_size = row_bytes_for(formats[f], 3840) * 2160;
+		}
+	}
+
+	uint8_t* data = (uint8_t*) malloc(max_size);
+	bench_fill(data, max_size);
+
+	for(unsigned int f = 0; f < COUNT(formats) && (!only_kind || !strcmp(only_kind, "gl")); f++) {
+		for(unsigned int i = 0; i < COUNT(inputs); i++) {
+			if(only_input && strcmp(only_input, inputs[i].name)) {
+				continue;
+			}
+
+			for(unsigned int o = 0; o < COUNT(outputs); o++) {
+				if(only_output && strcmp(only_output, outputs[o].name)) {
+					continue;
+				}
+
+				for(unsigned int u = 0; u < COUNT(upload_modes); u++) {
+					if(only_upload && strcmp(only_upload, GXUploadModeName(upload_modes[u]))) {
+						continue;
+					}
+
+					for(int interpolate = 0; interpolate < 2; interpolate++) {
+						run_case(&renderer, formats[f], &inputs[i], &outputs[o], interpolate, upload_modes[u], frames, data);
+					}
+				}
+			}
+		}
+	}
+
+	if(!only_kind || !strcmp(only_kind, "multiview")) {
+		bench_multiview(&renderer, frames, only_input, only_output, data);
+	}
+
+	if(!only_kind || !strcmp(only_kind, "scopes")) {
+		bench_scopes(&renderer, frames, only_input, data);
+	}
+
+	if(!only_kind || !strcmp(only_kind, "scale")) {
+		bench_scale(&renderer, frames, only_input, only_output);
+	}
+
+	if(!only_kind || !strcmp(only_kind, "deinterlace")) {
+		bench_deinterlace(&renderer, frames, only_input, data);
+	}
+
+	if(!only_kind || !strcmp(only_kind, "colorimetry")) {
+		bench_colorimetry(&renderer, frames, only_input);
+	}
+
+	free(data);
+	GXUploadDestroy(&renderer);
+	destroy_egl();
+
+	return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <cstdint>
+
+int64_t	bench_time_us(void);
+void	bench_fill(uint8_t* data, size_t size);
+void	bench_convert(unsigned int frames, unsigned int threads);
+void	bench_meter(void);
+void	bench_mix(void);
+void	bench_resample(void);
+
+#endif /* __BENCH_H__ */
@@ -0,0 +1,339 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "deckview.h"
+#include "bench.h"
+
+// Throughput of the CPU conversion kernels per instruction set, against the
+// scalar reference. Every SIMD result is compared with the reference output.
+
+typedef struct {
+	const char*	name;
+	unsigned int	width;
+	unsigned int	height;
+} Size;
+
+static const Size sizes[] = {
+	{ "1080p", 1920, 1080 },
+	{ "2160p", 3840, 2160 }
+};
+
+#define	COUNT(x)	(sizeof(x) / sizeof(*(x)))
+
+static size_t input_row_bytes(CXKernel kernel, unsigned int width)
+{
+	switch(kernel) {
+		case CX_UYVY_RGBA8:
+			return width * 2;
+		default:
+			return ((width + 47) / 48) * 128;
+	}
+}
+
+static double run(CXKernel kernel, CXIsa isa, const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride, const Size* size, unsigned int frames, unsigned int threads)
+{
+	// warm up caches and page in the output
+	CXConvert(kernel, isa, src, src_stride, dst, dst_stride, size->width, size->height, threads);
+
+	int64_t start = bench_time_us();
+	for(unsigned int i = 0; i < frames; i++) {
+		CXConvert(kernel, isa, src, src_stride, dst, dst_stride, size->width, size->height, threads);
+	}
+	return (bench_time_us() - start) / 1000000.0;
+}
+
+void bench_convert(unsigned int frames, unsigned int threads)
+{
+	for(unsigned int s = 0; s < COUNT(sizes); s++) {
+		const Size* size = &sizes[s];
+
+		for(int k = 0; k < CX_KERNEL_CNT; k++) {
+			CXKernel kernel = (CXKernel) k;
+			size_t src_stride = input_row_bytes(kernel, size->width);
+			size_t dst_stride = CXOutputRowBytes(kernel, size->width);
+			size_t src_size = src_stride * size->height;
+			size_t dst_size = dst_stride * size->height;
+
+			uint8_t* src = (uint8_t*) malloc(src_size);
+			uint8_t* reference = (uint8_t*) malloc(dst_size);
+			uint8_t* dst = (uint8_t*) malloc(dst_size);
+			bench_fill(src, src_size);
+
+			double scalar = 0.0;
+			for(int i = 0; i < CX_ISA_CNT; i++) {
+				CXIsa isa = (CXIsa) i;
+				if(!CXIsaSupported(isa)) {
+					continue;
+				}
+
+				unsigned int thread_counts[2] = { 1, threads };
+				for(unsigned int t = 0; t < (threads > 1 ? 2u : 1u); t++) {
+					double seconds = run(kernel, isa, src, src_stride, isa == CX_ISA_SCALAR && t == 0 ? reference : dst, dst_stride, size, frames, thread_counts[t]);
+					if(isa == CX_ISA_SCALAR && t == 0) {
+						scalar = seconds;
+					}
+
+					size_t mismatch = 0;
+					if(isa != CX_ISA_SCALAR || t != 0) {
+						for(size_t b = 0; b < dst_size; b++) {
+							mismatch += dst[b] != reference[b];
+						}
+					}
+
+					printf("{\"kernel\":\"%s\",\"isa\":\"%s\",\"input\":\"%s\",\"threads\":%u,\"frames\":%u,"
+						"\"ms\":%.3f,\"in_gbps\":%.3f,\"out_gbps\":%.3f,\"speedup\":%.2f,\"mismatch\":%zu}\n",
+						CXKernelName(kernel), CXIsaName(isa), size->name, thread_counts[t], frames,
+						seconds * 1000.0 / frames,
+						(double) src_size * frames / seconds / 1e9,
+						(double) dst_size * frames / seconds / 1e9,
+						scalar / seconds, mismatch);
+					fflush(stdout);
+				}
+			}
+
+			free(src);
+			free(reference);
+			free(dst);
+		}
+	}
+}
+
+// Audio meters over a minute of test tones: a 1 kHz sine per channel, each
+// 2 dB quieter than the one before. A -20 dBFS sine in one channel reads
+// -23.0 LUFS.
+#define	METER_RATE	48000
+#define	METER_SECONDS	60
+#define	METER_PACKET	1024
+
+static const unsigned int meter_channels[] = { 2, 8, 16 };
+static const unsigned int meter_bits[] = { 16, 32 };
+
+static void fill_tones(void* data, unsigned int channels, unsigned int bit, size_t frames)
+{
+	for(size_t f = 0; f < frames; f++) {
+		double phase = sin(2.0 * M_PI * 1000.0 * f / METER_RATE);
+		for(unsigned int c = 0; c < channels; c++) {
+			double v = phase * pow(10.0, (-20.0 - 2.0 * c) / 20.0);
+			if(bit == 16) {
+				((int16_t*) data)[f * channels + c] = (int16_t) lrint(v * 32767.0);
+			} else {
+				((int32_t*) data)[f * channels + c] = (int32_t) lrint(v * 2147483647.0);
+			}
+		}
+	}
+}
+
+void bench_meter(void)
+{
+	size_t frames = (size_t) METER_RATE * METER_SECONDS;
+
+	for(unsigned int b = 0; b < COUNT(meter_bits); b++) {
+		for(unsigned int n = 0; n < COUNT(meter_channels); n++) {
+			unsigned int bit = meter_bits[b];
+			unsigned int channels = meter_channels[n];
+			size_t frame_bytes = channels * bit / 8;
+
+			uint8_t* data = (uint8_t*) malloc(frames * frame_bytes);
+			fill_tones(data, channels, bit, frames);
+
+			AXMeterLevels reference;
+			for(int i = 0; i < CX_ISA_CNT; i++) {
+				CXIsa isa = (CXIsa) i;
+				if(!CXIsaSupported(isa)) {
+					continue;
+				}
+
+				AXMeterInit(channels, bit, isa);
+
+				// in packets like the audio thread gets them
+				int64_t start = bench_time_us();
+				for(size_t f = 0; f < frames; f += METER_PACKET) {
+					AXMeterProcess(data + f * frame_bytes, frames - f < METER_PACKET ? frames - f : METER_PACKET);
+				}
+				double seconds = (bench_time_us() - start) / 1000000.0;
+
+				AXMeterLevels levels;
+				AXMeterGet(&levels);
+				if(isa == CX_ISA_SCALAR) {
+					reference = levels;
+				}
+
+				float deviation = 0.0f;
+				for(unsigned int c = 0; c < channels; c++) {
+					deviation = fmaxf(deviation, fabsf(levels.short_term[c] - reference.short_term[c]));
+					deviation = fmaxf(deviation, fabsf(levels.rms[c] - reference.rms[c]));
+					deviation = fmaxf(deviation, fabsf(levels.peak[c] - reference.peak[c]));
+				}
+
+				printf("{\"kernel\":\"meter\",\"isa\":\"%s\",\"channels\":%u,\"bits\":%u,\"seconds\":%u,"
+					"\"ms\":%.3f,\"load_pct\":%.4f,\"first_lufs\":%.2f,\"first_rms_db\":%.2f,\"program_lufs\":%.2f,\"max_deviation_db\":%.4f}\n",
+					CXIsaName(isa), channels, bit, METER_SECONDS,
+					seconds * 1000.0,
+					seconds / METER_SECONDS * 100.0,
+					levels.short_term[0], levels.rms[0], levels.program_short_term, deviation);
+				fflush(stdout);
+			}
+
+			free(data);
+		}
+	}
+}
+
+// Routing of a minute of audio in packets, against the scalar reference
+static const char* mix_routes[] = { "1,2", "5.1", "1,2,3,4,5,6,7,8" };
+
+void bench_mix(void)
+{
+	size_t frames = (size_t) METER_RATE * METER_SECONDS;
+
+	for(unsigned int b = 0; b < COUNT(meter_bits); b++) {
+		for(unsigned int n = 0; n < COUNT(meter_channels); n++) {
+			unsigned int bit = meter_bits[b];
+			unsigned int channels = meter_channels[n];
+			size_t frame_bytes = channels * bit / 8;
+
+			uint8_t* data = (uint8_t*) malloc(frames * frame_bytes);
+			fill_tones(data, channels, bit, frames);
+
+			for(unsigned int r = 0; r < COUNT(mix_routes); r++) {
+				AXRoute route;
+				if(!AXRouteParse(mix_routes[r], channels, &route)) {
+					continue;
+				}
+
+				size_t out_size = frames * route.outputs + AX_MIX_PAD;
+				float* reference = (float*) malloc(out_size * sizeof(float));
+				float* out = (float*) malloc(out_size * sizeof(float));
+
+				for(int i = 0; i < CX_ISA_CNT; i++) {
+					CXIsa isa = (CXIsa) i;
+					if(!CXIsaSupported(isa)) {
+						continue;
+					}
+
+					AXMixInit(channels, bit, &route, isa);
+					float* dst = isa == CX_ISA_SCALAR ? reference : out;
+
+					int64_t start = bench_time_us();
+					for(size_t f = 0; f < frames; f += METER_PACKET) {
+						AXMix(data + f * frame_bytes, frames - f < METER_PACKET ? frames - f : METER_PACKET, dst + f * route.outputs);
+					}
+					double seconds = (bench_time_us() - start) / 1000000.0;
+
+					size_t mismatch = 0;
+					if(isa != CX_ISA_SCALAR) {
+						for(size_t s = 0; s < frames * route.outputs; s++) {
+							mismatch += fabsf(out[s] - reference[s]) > 1e-6f;
+						}
+					}
+
+					printf("{\"kernel\":\"mix\",\"isa\":\"%s\",\"channels\":%u,\"bits\":%u,\"route\":\"%s\",\"outputs\":%u,\"seconds\":%u,"
+						"\"ms\":%.3f,\"load_pct\":%.4f,\"mismatch\":%zu}\n",
+						CXIsaName(isa), channels, bit, mix_routes[r], route.outputs, METER_SECONDS,
+						seconds * 1000.0,
+						seconds / METER_SECONDS * 100.0,
+						mismatch);
+					fflush(stdout);
+				}
+
+				free(reference);
+				free(out);
+			}
+
+			free(data);
+		}
+	}
+}
+
+// Resampling of a minute of a sine off by a drift, against the exact sine
+// at the output positions and the scalar reference
+#define	RESAMPLE_PACKET	1024
+#define	RESAMPLE_TONE	997.0
+#define	RESAMPLE_EDGE	64	// frames skipped at the ends
+
+static const unsigned int resample_outputs[] = { 2, 6, 8 };
+static const double resample_ppm[] = { 100.0, -250.0 };
+
+void bench_resample(void)
+{
+	size_t frames = (size_t) METER_RATE * METER_SECONDS;
+
+	for(unsigned int n = 0; n < COUNT(resample_outputs); n++) {
+		unsigned int channels = resample_outputs[n];
+
+		float* data = (float*) malloc(frames * channels * sizeof(float));
+		for(size_t f = 0; f < frames; f++) {
+			for(unsigned int c = 0; c < channels; c++) {
+				data[f * channels + c] = (float) (0.5 * sin(2.0 * M_PI * RESAMPLE_TONE * f / METER_RATE + c));
+			}
+		}
+
+		for(unsigned int d = 0; d < COUNT(resample_ppm); d++) {
+			double ratio = 1.0 + resample_ppm[d] * 1e-6;
+			size_t out_size = (size_t) (frames / ratio + 2) * channels + AX_MIX_PAD;
+			float* reference = (float*) malloc(out_size * sizeof(float));
+			float* out = (float*) malloc(out_size * sizeof(float));
+			size_t reference_frames = 0;
+
+			for(int i = 0; i < CX_ISA_CNT; i++) {
+				CXIsa isa = (CXIsa) i;
+				if(!CXIsaSupported(isa)) {
+					continue;
+				}
+
+				AXResampleInit(channels, isa);
+				float* dst = isa == CX_ISA_SCALAR ? reference : out;
+				size_t written = 0;
+
+				int64_t start = bench_time_us();
+				for(size_t f = 0; f < frames; f += RESAMPLE_PACKET) {
+					size_t count = frames - f < RESAMPLE_PACKET ? frames - f : RESAMPLE_PACKET;
+					written += AXResample(data + f * channels, count, ratio, dst + written * channels);
+				}
+				double seconds = (bench_time_us() - start) / 1000000.0;
+
+				if(isa == CX_ISA_SCALAR) {
+					reference_frames = written;
+				}
+
+				// output frame k is at input frame k * ratio
+				double signal = 0.0;
+				double noise = 0.0;
+				for(size_t k = RESAMPLE_EDGE; k + RESAMPLE_EDGE < written; k++) {
+					for(unsigned int c = 0; c < channels; c++) {
+						double exact = 0.5 * sin(2.0 * M_PI * RESAMPLE_TONE * (k * ratio) / METER_RATE + c);
+						double e = dst[k * channels + c] - exact;
+						signal += exact * exact;
+						noise += e * e;
+					}
+				}
+
+				float deviation = 0.0f;
+				if(isa != CX_ISA_SCALAR) {
+					size_t common = written < reference_frames ? written : reference_frames;
+					for(size_t s = 0; s < common * channels; s++) {
+						deviation = fmaxf(deviation, fabsf(out[s] - reference[s]));
+					}
+				}
+
+				printf("{\"kernel\":\"resample\",\"isa\":\"%s\",\"channels\":%u,\"ppm\":%.1f,\"seconds\":%u,"
+					"\"ms\":%.3f,\"load_pct\":%.4f,\"frames_in\":%zu,\"frames_out\":%zu,\"snr_db\":%.1f,\"max_deviation\":%.2e}\n",
+					CXIsaName(isa), channels, resample_ppm[d], METER_SECONDS,
+					seconds * 1000.0,
+					seconds / METER_SECONDS * 100.0,
+					frames, written,
+					noise > 0.0 ? 10.0 * log10(signal / noise) : 999.0,
+					deviation);
+				fflush(stdout);
+			}
+
+			free(reference);
+			free(out);
+		}
+
+		free(data);
+	}
+}
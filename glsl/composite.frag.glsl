@@ -0,0 +1,39 @@
+#version 330
+
+uniform sampler2DArray frame;
+uniform float brightness = 1.0;
+
+in  vec2 pos;
+flat in int layer;
+flat in vec2 lod_range;
+flat in int copy;
+out vec4 color;
+
+vec4 color_control(vec4 pixel, float brightness)
+{
+	vec3 scaled = pixel.rgb * vec3(brightness);
+	vec3 clamped = clamp(scaled, vec3(0.0), vec3(1.0));
+	return vec4(clamped, pixel.a);
+}
+
+void main(void)
+{
+	vec2 texel = pos * vec2(textureSize(frame, 0).xy);
+
+	if(copy != 0) {
+		color = color_control(texelFetch(frame, ivec3(ivec2(texel), layer), 0), brightness);
+		return;
+	}
+
+	// Only the mip levels this tile needs are valid in its layer, so the
+	// level of detail is computed here and clamped to those instead of
+	// letting the sampler reach into stale levels. Minified tiles get
+	// trilinear filtering.
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+
+	lod = clamp(lod, lod_range.x, lod_range.y);
+
+	color = color_control(textureLod(frame, vec3(pos, float(layer)), lod), brightness);
+}
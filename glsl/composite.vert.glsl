@@ -0,0 +1,34 @@
+#version 330
+
+// GX_MAX_INPUTS
+#define	MAX_TILES	16
+
+layout(location = 0) in vec3 position;
+
+// One instance per input, drawn into layer gl_InstanceID of the array.
+// tile: x, y, width, height in normalized device coordinates
+// source: part of the layer holding the frame in texture coordinates,
+//         lowest and highest valid mip level
+// nearest: tile and frame have the same size
+uniform vec4 tile[MAX_TILES];
+uniform vec4 source[MAX_TILES];
+uniform int nearest[MAX_TILES];
+
+out vec2 pos;
+flat out int layer;
+flat out vec2 lod_range;
+flat out int copy;
+
+void main(void)
+{
+	vec4 t = tile[gl_InstanceID];
+
+	vec2 screen = (position.xy + vec2(1.0, 1.0)) / 2.0;
+
+	gl_Position = vec4(t.xy + screen * t.zw, 0.0, 1.0);
+
+	pos = vec2(screen.x, 1.0 - screen.y) * source[gl_InstanceID].xy;
+	layer = gl_InstanceID;
+	lod_range = source[gl_InstanceID].zw;
+	copy = nearest[gl_InstanceID];
+}
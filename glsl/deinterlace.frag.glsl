@@ -0,0 +1,60 @@
+#version 330
+
+// Both unpacked frames, fields woven, top down
+uniform sampler2D frame;
+uniform sampler2D previous;
+
+// 1: bob, 2: motion adaptive
+uniform int mode;
+// rows of the field shown, 0: even (top field), 1: odd
+uniform int parity;
+// the field shown is the first of its frame in time: the other field of
+// the frame comes one field later, the one of the previous frame one
+// field earlier
+uniform bool first;
+uniform ivec2 last;
+
+out vec4 color;
+
+// motion below shows the temporal, above the spatial interpolation
+const float still = 0.02;
+const float moving = 0.08;
+
+float luma(vec4 c)
+{
+	return dot(c.rgb, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main(void)
+{
+	ivec2 px = ivec2(gl_FragCoord.xy);
+
+	if((px.y & 1) == parity) {
+		color = texelFetch(frame, px, 0);
+		return;
+	}
+
+	// the lines of the field above and below, mirrored at the edges
+	ivec2 up = ivec2(px.x, px.y > 0 ? px.y - 1 : px.y + 1);
+	ivec2 down = ivec2(px.x, px.y < last.y ? px.y + 1 : px.y - 1);
+	vec4 above = texelFetch(frame, up, 0);
+	vec4 below = texelFetch(frame, down, 0);
+	vec4 spatial = (above + below) * 0.5;
+
+	if(mode == 1) {
+		color = spatial;
+		return;
+	}
+
+	// The missing line one field before and after, and how much it and
+	// the lines around it changed from the previous frame to this one
+	vec4 other = texelFetch(frame, px, 0);
+	vec4 other_prev = texelFetch(previous, px, 0);
+	vec4 temporal = first ? (other + other_prev) * 0.5 : other;
+
+	float diff = abs(luma(other) - luma(other_prev));
+	diff = max(diff, abs(luma(above) - luma(texelFetch(previous, up, 0))));
+	diff = max(diff, abs(luma(below) - luma(texelFetch(previous, down, 0))));
+
+	color = mix(temporal, spatial, smoothstep(still, moving, diff));
+}
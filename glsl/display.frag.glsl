@@ -0,0 +1,21 @@
+#version 330
+
+uniform sampler2D frame;
+uniform float brightness = 1.0;
+
+in  vec2 pos;
+out vec4 color;
+
+vec4 color_control(vec4 pixel, float brightness)
+{
+	vec3 scaled = pixel.rgb * vec3(brightness);
+	vec3 clamped = clamp(scaled, vec3(0.0), vec3(1.0));
+	return vec4(clamped, pixel.a);
+}
+
+void main(void)
+{
+	// The frame was unpacked to RGB, so the sampler bound by the renderer
+	// does the nearest or bilinear filtering.
+	color = color_control(texture(frame, pos), brightness);
+}
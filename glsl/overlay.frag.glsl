@@ -0,0 +1,9 @@
+#version 330
+
+in  vec4 fill;
+out vec4 color;
+
+void main(void)
+{
+	color = fill;
+}
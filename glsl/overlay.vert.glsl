@@ -0,0 +1,12 @@
+#version 330
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec4 color;
+
+out vec4 fill;
+
+void main(void)
+{
+	gl_Position = vec4(position.xy, 0.0, 1.0);
+	fill = color;
+}
@@ -0,0 +1,46 @@
+#version 330
+
+uniform sampler2DArray frame;
+uniform int layer;
+
+// the deinterlaced field of an input, reduced into the first level of its
+// layer when scale is set
+uniform sampler2D field;
+uniform int scale = 0;
+
+out vec4 color;
+
+void main(void)
+{
+	// A field is reduced like the unpack shaders reduce frames: each
+	// fragment averages a scale x scale block of it, clamped to the edge.
+	if(scale > 0) {
+		ivec2 last = textureSize(field, 0) - ivec2(1);
+		ivec2 px = ivec2(gl_FragCoord.xy) * scale;
+
+		vec4 sum = vec4(0.0);
+		for(int y = 0; y < scale; y++) {
+			for(int x = 0; x < scale; x++) {
+				sum += texelFetch(field, min(px + ivec2(x, y), last), 0);
+			}
+		}
+
+		color = sum / float(scale * scale);
+		return;
+	}
+
+	// Renders one mip level of a layer with a 2x2 box filter. The renderer
+	// sets the base level of the array to the level above, so level 0
+	// here is the source and textureSize() its size. The last row and
+	// column of odd sized levels are clamped to the edge.
+	ivec2 size = textureSize(frame, 0).xy;
+	ivec2 px0 = ivec2(gl_FragCoord.xy) * 2;
+	ivec2 px1 = min(px0 + ivec2(1), size - ivec2(1));
+
+	vec4 sum = texelFetch(frame, ivec3(px0.x, px0.y, layer), 0) +
+		texelFetch(frame, ivec3(px1.x, px0.y, layer), 0) +
+		texelFetch(frame, ivec3(px0.x, px1.y, layer), 0) +
+		texelFetch(frame, ivec3(px1.x, px1.y, layer), 0);
+
+	color = sum * 0.25;
+}
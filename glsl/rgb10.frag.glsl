@@ -0,0 +1,83 @@
+#version 330
+#extension GL_GOOGLE_include_directive : require
+#include "colorimetry.glsli"
+
+uniform sampler2D frame;
+
+// block of frame pixels averaged per fragment, see yuv8.frag.glsl
+uniform int scale = 1;
+uniform ivec2 last;
+
+// drawn straight into the viewport, see yuv8.frag.glsl
+uniform int direct = 0;
+uniform vec4 viewport;
+uniform float brightness = 1.0;
+
+out vec4 color;
+
+// r210 stores one pixel per big endian 32bit word as 2:10:10:10 (x:R:G:B).
+// The frame is uploaded like v210, so each RGB10_A2 texel holds the little
+// endian reading of that word. Reassemble the word from the normalized
+// components, swap the bytes and extract the components.
+vec3 textureGetRGB(sampler2D sampler, ivec2 px)
+{
+	vec4 texel = texelFetch(sampler, px, 0);
+	uvec4 c = uvec4(round(texel * vec4(1023.0, 1023.0, 1023.0, 3.0)));
+
+	uint word = c.r | (c.g << 10) | (c.b << 20) | (c.a << 30);
+	word = (word >> 24) | ((word >> 8) & 0xff00u) | ((word << 8) & 0xff0000u) | (word << 24);
+
+	uvec3 rgb = uvec3(word >> 20, word >> 10, word) & uvec3(0x3ffu);
+
+	return rgb_levels(vec3(rgb), 10.0);
+}
+
+vec4 unpack(ivec2 px)
+{
+	return vec4(to_display(textureGetRGB(frame, px)), 1.0);
+}
+
+vec4 unpack_clamped(ivec2 px)
+{
+	return unpack(clamp(px, ivec2(0), last));
+}
+
+// see yuv8.frag.glsl
+vec4 unpack_direct(void)
+{
+	vec2 pos = (gl_FragCoord.xy - viewport.xy) / viewport.zw;
+	pos = vec2(pos.x, 1.0 - pos.y) * vec2(last + 1);
+
+	if(direct == 1) {
+		return unpack_clamped(ivec2(pos));
+	}
+
+	vec2 p = pos - 0.5;
+	ivec2 p0 = ivec2(floor(p));
+	vec2 f = p - vec2(p0);
+	vec4 top = mix(unpack_clamped(p0), unpack_clamped(p0 + ivec2(1, 0)), f.x);
+	vec4 bottom = mix(unpack_clamped(p0 + ivec2(0, 1)), unpack_clamped(p0 + ivec2(1, 1)), f.x);
+	return mix(top, bottom, f.y);
+}
+
+void main(void)
+{
+	if(direct != 0) {
+		vec4 c = unpack_direct();
+		color = vec4(clamp(c.rgb * brightness, vec3(0.0), vec3(1.0)), c.a);
+		return;
+	}
+
+	// Runs once per frame pixel, or per block of pixels, into the
+	// unpacked RGB texture
+	ivec2 px = ivec2(gl_FragCoord.xy) * scale;
+
+	vec4 sum = vec4(0.0);
+	for(int y = 0; y < scale; y++) {
+		for(int x = 0; x < scale; x++) {
+			sum += unpack(min(px + ivec2(x, y), last));
+		}
+	}
+
+	color = sum / float(scale * scale);
+}
@@ -0,0 +1,52 @@
+#version 330
+
+uniform sampler2D frame;
+
+// One row per output column (horizontal pass) or row (vertical pass): the
+// first frame texel under the filter in the red channel of texel 0, then
+// the weights of the taps, four per texel
+uniform sampler2D weights;
+uniform int taps;
+
+// 0: horizontal, from the unpacked frame into the intermediate texture
+// 1: vertical, from the intermediate texture into the viewport at origin,
+//    rows high
+uniform int axis;
+uniform ivec2 origin = ivec2(0);
+uniform int rows;
+uniform ivec2 last;
+uniform float brightness = 1.0;
+
+out vec4 color;
+
+void main(void)
+{
+	ivec2 px = ivec2(gl_FragCoord.xy) - origin;
+
+	// the frame is top down, the viewport bottom up
+	if(axis == 1) {
+		px.y = rows - 1 - px.y;
+	}
+
+	int i = px[axis];
+	ivec2 step = axis == 0 ? ivec2(1, 0) : ivec2(0, 1);
+	ivec2 src = px;
+	src[axis] = int(texelFetch(weights, ivec2(0, i), 0).r);
+
+	vec4 w = vec4(0.0);
+	vec4 sum = vec4(0.0);
+	for(int t = 0; t < taps; t++) {
+		if((t & 3) == 0) {
+			w = texelFetch(weights, ivec2(1 + t / 4, i), 0);
+		}
+		sum += w[t & 3] * texelFetch(frame, clamp(src + step * t, ivec2(0), last), 0);
+	}
+
+	// the intermediate keeps the ringing, the output is clamped like the
+	// display pass does
+	if(axis == 0) {
+		color = sum;
+	} else {
+		color = vec4(clamp(sum.rgb * brightness, vec3(0.0), vec3(1.0)), 1.0);
+	}
+}
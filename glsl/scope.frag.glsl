@@ -0,0 +1,125 @@
+#version 330
+
+// Draws the counts accumulated by scope_scatter with graticule. Counts are
+// mapped to intensity by 1 - exp(-count * gain), gain is derived from the
+// number of samples so the trace looks the same at any frame size.
+
+uniform sampler2D accum;
+uniform int scope;		// GXScope
+uniform float gain;
+
+in  vec2 pos;
+out vec4 color;
+
+const vec3 luma = vec3(0.2126, 0.7152, 0.0722);
+const vec4 background = vec4(0.0, 0.0, 0.0, 0.75);
+const vec3 graticule = vec3(0.6, 0.5, 0.2);
+
+float level(float v)
+{
+	return (v + 0.07) / 1.16;
+}
+
+vec4 fetch(vec2 at)
+{
+	ivec2 size = textureSize(accum, 0);
+	ivec2 px = clamp(ivec2(at * vec2(size)), ivec2(0), size - 1);
+	return texelFetch(accum, px, 0);
+}
+
+vec3 intensity(vec3 count)
+{
+	return 1.0 - exp(-count * gain);
+}
+
+// 1 within a pixel of value v along an axis whose derivative is d
+float line(float at, float v, float d)
+{
+	return 1.0 - step(d, abs(at - v));
+}
+
+// horizontal lines at 0, 25, 50, 75 and 100 %
+float levels(float v)
+{
+	float d = fwidth(v);
+	float g = 0.0;
+	for(int i = 0; i <= 4; i++) {
+		g = max(g, line(v, level(float(i) * 0.25), d));
+	}
+	return g;
+}
+
+vec4 waveform(vec2 at)
+{
+	vec3 trace = intensity(vec3(fetch(at).r)) * vec3(0.4, 1.0, 0.4);
+	return vec4(max(trace, graticule * levels(at.y)), 1.0);
+}
+
+vec4 parade(vec2 at)
+{
+	int channel = min(int(at.x * 3.0), 2);
+	vec2 local = vec2(at.x * 3.0 - float(channel), at.y);
+	vec3 tint = vec3(0.0);
+	tint[channel] = 1.0;
+	vec3 trace = intensity(vec3(fetch(local)[channel])) * (tint * 0.8 + 0.2);
+	float border = line(local.x, 0.0, fwidth(local.x));
+	return vec4(max(trace, graticule * max(levels(at.y), border)), 1.0);
+}
+
+vec2 chroma(vec3 rgb)
+{
+	float y = dot(rgb, luma);
+	return vec2((rgb.b - y) / 1.8556, (rgb.r - y) / 1.5748);
+}
+
+vec4 vectorscope(vec2 at)
+{
+	vec3 trace = intensity(vec3(fetch(at).r)) * vec3(0.4, 1.0, 0.4);
+
+	vec2 c = at - 0.5;
+	float d = fwidth(at.x);
+	float g = max(line(length(c), 0.5, d), max(line(c.x, 0.0, d), line(c.y, 0.0, d)) * step(length(c), 0.5));
+
+	// targets of 75 % colour bars
+	const vec3 bars[6] = vec3[6](
+		vec3(0.75, 0.0, 0.0), vec3(0.75, 0.75, 0.0), vec3(0.0, 0.75, 0.0),
+		vec3(0.0, 0.75, 0.75), vec3(0.0, 0.0, 0.75), vec3(0.75, 0.0, 0.75));
+	for(int i = 0; i < 6; i++) {
+		vec2 target = chroma(bars[i]);
+		g = max(g, line(length(c - target), 0.02, d));
+	}
+
+	return vec4(max(trace, graticule * g), 1.0);
+}
+
+vec4 histogram(vec2 at)
+{
+	vec4 count = fetch(vec2(at.x, 0.5));
+	vec4 height = 1.0 - exp(-count * gain);
+	vec4 fill = vec4(greaterThan(height, vec4(at.y)));
+
+	vec3 rgb = fill.rgb * 0.8 + fill.a * 0.25;
+	float d = fwidth(at.x);
+	float g = max(line(at.x, level(0.0), d), line(at.x, level(1.0), d));
+	return vec4(max(rgb, graticule * g), 1.0);
+}
+
+void main(void)
+{
+	// level axes point up
+	vec2 at = vec2(pos.x, 1.0 - pos.y);
+
+	vec4 scoped;
+	if(scope == 0) {
+		scoped = waveform(at);
+	} else if(scope == 1) {
+		scoped = parade(at);
+	} else if(scope == 2) {
+		scoped = vectorscope(at);
+	} else {
+		scoped = histogram(at);
+	}
+
+	// drawn with premultiplied alpha over the darkened picture
+	color = vec4(scoped.rgb, background.a);
+}
@@ -0,0 +1,58 @@
+#version 330
+
+// One point per sampled frame pixel, no vertex attributes: the point is
+// placed at the cell of the scope the pixel falls into and adds its weight
+// there through additive blending.
+
+uniform sampler2D frame;	// unpacked RGB, video levels in [0..1]
+uniform int scope;		// GXScope
+uniform int columns;		// sampled pixels per row
+uniform int step;		// distance between sampled pixels
+uniform ivec2 size;		// of the frame
+uniform int bins;		// histogram bins
+
+out vec4 weight;
+
+const vec3 luma = vec3(0.2126, 0.7152, 0.0722);
+
+// level on the vertical axis, from below black to above white like the 10
+// bit code range 4..1019
+float level(float v)
+{
+	return (v + 0.07) / 1.16;
+}
+
+void main(void)
+{
+	ivec2 px = ivec2(gl_VertexID % columns, gl_VertexID / columns) * step;
+	vec3 rgb = texelFetch(frame, px, 0).rgb;
+	float y = dot(rgb, luma);
+	float x = (float(px.x) + 0.5) / float(size.x);
+
+	vec2 pos;
+	weight = vec4(0.0);
+
+	if(scope == 0) {
+		// waveform
+		pos = vec2(x, level(y));
+		weight.r = 1.0;
+	} else if(scope == 1) {
+		// parade, one instance per channel
+		pos = vec2(x, level(rgb[gl_InstanceID]));
+		weight[gl_InstanceID] = 1.0;
+	} else if(scope == 2) {
+		// vectorscope, Rec.709 colour differences scaled to [-0.5..0.5]
+		float cb = (rgb.b - y) / 1.8556;
+		float cr = (rgb.r - y) / 1.5748;
+		pos = vec2(cb, cr) + 0.5;
+		weight.r = 1.0;
+	} else {
+		// histogram, one instance each for R, G, B and luma
+		float v = gl_InstanceID < 3 ? rgb[gl_InstanceID] : y;
+		float bin = floor(clamp(level(v), 0.0, 1.0) * float(bins - 1) + 0.5);
+		pos = vec2((bin + 0.5) / float(bins), 0.5);
+		weight[gl_InstanceID] = 1.0;
+	}
+
+	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -1,44 +1,19 @@
 #version 330
+#extension GL_GOOGLE_include_directive : require
+#include "colorimetry.glsli"
 
 uniform sampler2D frame;
-uniform ivec2 frame_size;
-uniform bool interpolate = false;
-uniform float brightness = 1.0;
-
-in  vec2 pos;
-out vec4 color;
-
-vec4 rec709YCbCr2rgba(float Y, float Cb, float Cr, float a)
-{
-	float r, g, b;
-
-	// Y: Undo 1/256 texture value scaling and scale [16..235] to [0..1] range
-	// C: Undo 1/256 texture value scaling and scale [16..240] to [-0.5 .. + 0.5] range
-	Y = (Y * 256.0 - 16.0) / 219.0;
-	Cb = (Cb * 256.0 - 16.0) / 224.0 - 0.5;
-	Cr = (Cr * 256.0 - 16.0) / 224.0 - 0.5;
 
-	// Convert to RGB using Rec.709 conversion matrix (see eq 26.7 in Poynton 2003)
-	r = Y + 1.5748 * Cr;
-	g = Y - 0.1873 * Cb - 0.4681 * Cr;
-	b = Y + 1.8556 * Cb;
+// block of frame pixels averaged per fragment, see yuv8.frag.glsl
+uniform int scale = 1;
+uniform ivec2 last;
 
-	return vec4(r, g, b, a);
-}
+// drawn straight into the viewport, see yuv8.frag.glsl
+uniform int direct = 0;
+uniform vec4 viewport;
+uniform float brightness = 1.0;
 
-// Perform bilinear interpolation between the provided components.
-// The samples are expected as shown:
-// +-------+
-// | X | Y |
-// |---+---|
-// | W | Z |
-// +-------+
-vec4 bilinear(vec4 W, vec4 X, vec4 Y, vec4 Z, vec2 weight)
-{
-	vec4 m0 = mix(W, Z, weight.x);
-	vec4 m1 = mix(X, Y, weight.x);
-	return mix(m0, m1, weight.y);
-}
+out vec4 color;
 
 vec3 textureGetYUV(sampler2D sampler, ivec2 px)
 {
@@ -86,42 +61,59 @@ vec3 textureGetYUV(sampler2D sampler, ivec2 px)
 	}
 }
 
-void textureGatherYUV(sampler2D sampler, vec2 tc, out vec3 W, out vec3 X, out vec3 Y, out vec3 Z)
+vec4 unpack(ivec2 px)
 {
-	ivec2 px = ivec2(tc * frame_size);
+	vec3 yuv = textureGetYUV(frame, px);
 
-	ivec2 tmin = ivec2(0, 0);
-	ivec2 tmax = frame_size - ivec2(1, 1);
+	// alpha < 1 leaves trails when drawing without clear
+	float alpha = 0.2;
 
-	W = textureGetYUV(sampler, px);
-	X = textureGetYUV(sampler, clamp(px + ivec2(0, 1), tmin, tmax));
-	Y = textureGetYUV(sampler, clamp(px + ivec2(1, 1), tmin, tmax));
-	Z = textureGetYUV(sampler, clamp(px + ivec2(1, 0), tmin, tmax));
+	// undo the 1/1023 texture value scaling
+	vec3 ycbcr = ycbcr_levels(yuv * 1023.0, 10.0);
+	return vec4(to_display(ycbcr_to_rgb(ycbcr)), alpha);
 }
 
-vec4 color_control(vec4 pixel, float brightness)
+vec4 unpack_clamped(ivec2 px)
 {
-	vec3 scaled = pixel.rgb * vec3(brightness);
-	vec3 clamped = clamp(scaled, vec3(0.0), vec3(1.0));
-	return vec4(clamped, pixel.a);
+	return unpack(clamp(px, ivec2(0), last));
 }
 
-void main(void)
+// see yuv8.frag.glsl
+vec4 unpack_direct(void)
 {
-	vec3 W, X, Y, Z;
-	textureGatherYUV(frame, pos, W, X, Y, Z);
+	vec2 pos = (gl_FragCoord.xy - viewport.xy) / viewport.zw;
+	pos = vec2(pos.x, 1.0 - pos.y) * vec2(last + 1);
 
-	float alpha = 0.2;
+	if(direct == 1) {
+		return unpack_clamped(ivec2(pos));
+	}
 
-	vec4 pixel = color_control(rec709YCbCr2rgba(W.r, W.g, W.b, alpha), brightness);
-	vec4 pixel_u = color_control(rec709YCbCr2rgba(X.r, X.g, X.b, alpha), brightness);
-	vec4 pixel_ur = color_control(rec709YCbCr2rgba(Y.r, Y.g, Y.b, alpha), brightness);
-	vec4 pixel_r = color_control(rec709YCbCr2rgba(Z.r, Z.g, Z.b, alpha), brightness);
+	vec2 p = pos - 0.5;
+	ivec2 p0 = ivec2(floor(p));
+	vec2 f = p - vec2(p0);
+	vec4 top = mix(unpack_clamped(p0), unpack_clamped(p0 + ivec2(1, 0)), f.x);
+	vec4 bottom = mix(unpack_clamped(p0 + ivec2(0, 1)), unpack_clamped(p0 + ivec2(1, 1)), f.x);
+	return mix(top, bottom, f.y);
+}
 
-	if(interpolate) {
-		vec2 off = fract(pos * frame_size);
-		color = bilinear(pixel, pixel_u, pixel_ur, pixel_r, off);
-	} else {
-		color = pixel;
+void main(void)
+{
+	if(direct != 0) {
+		vec4 c = unpack_direct();
+		color = vec4(clamp(c.rgb * brightness, vec3(0.0), vec3(1.0)), c.a);
+		return;
 	}
+
+	// Runs once per frame pixel into the unpacked RGB texture, so the
+	// display pass no longer decodes v210 for each of its samples
+	ivec2 px = ivec2(gl_FragCoord.xy) * scale;
+
+	vec4 sum = vec4(0.0);
+	for(int y = 0; y < scale; y++) {
+		for(int x = 0; x < scale; x++) {
+			sum += unpack(min(px + ivec2(x, y), last));
+		}
+	}
+
+	color = sum / float(scale * scale);
 }
@@ -1,101 +1,84 @@
 #version 330
+#extension GL_GOOGLE_include_directive : require
+#include "colorimetry.glsli"
 
 uniform sampler2D frame;
-uniform bool interpolate = false;
+
+// Frames of minified multiview tiles are unpacked straight into a reduced
+// mip level: each fragment then averages a scale x scale block of frame
+// pixels, clamped to last, the bottom right pixel of the frame.
+uniform int scale = 1;
+uniform ivec2 last;
+
+// Drawn straight into a viewport at or below the frame size instead
+// (GXDraw): 1 decodes the nearest frame pixel per fragment, 2 the 2x2
+// around it for bilinear filtering. Brightness and the clamp of the display
+// pass are applied here then.
+uniform int direct = 0;
+uniform vec4 viewport;
 uniform float brightness = 1.0;
 
-in  vec2 pos;
 out vec4 color;
 
-vec4 rec709YCbCr2rgba(float Y, float Cb, float Cr, float a)
+vec4 unpack(ivec2 px)
 {
-	float r, g, b;
-
-	// Y: Undo 1/256 texture value scaling and scale [16..235] to [0..1] range
-	// C: Undo 1/256 texture value scaling and scale [16..240] to [-0.5 .. + 0.5] range
-	Y = (Y * 256.0 - 16.0) / 219.0;
-	Cb = (Cb * 256.0 - 16.0) / 224.0 - 0.5;
-	Cr = (Cr * 256.0 - 16.0) / 224.0 - 0.5;
+	/* Each RGBA texel holds one UY/VY macropixel, two pixels sharing the
+	 * chroma:
+	 * +---------------+
+	 * | Y0 | Y1       |   =>   Y0: macro.g, Y1: macro.a
+	 * |----+----------|          Cb: macro.b, Cr: macro.r
+	 * | RG/BA         |
+	 * +---------------+ */
+	vec4 macro = texelFetch(frame, ivec2(px.x / 2, px.y), 0);
 
-	// Convert to RGB using Rec.709 conversion matrix (see eq 26.7 in Poynton 2003)
-	r = Y + 1.5748 * Cr;
-	g = Y - 0.1873 * Cb - 0.4681 * Cr;
-	b = Y + 1.8556 * Cb;
+	float Y = (px.x % 2) == 0 ? macro.g : macro.a;
 
-	return vec4(r, g, b, a);
+	// undo the 1/255 texture value scaling
+	vec3 ycbcr = ycbcr_levels(vec3(Y, macro.b, macro.r) * 255.0, 8.0);
+	return vec4(to_display(ycbcr_to_rgb(ycbcr)), 1.0);
 }
 
-// Perform bilinear interpolation between the provided components.
-// The samples are expected as shown:
-// +-------+
-// | X | Y |
-// |---+---|
-// | W | Z |
-// +-------+
-vec4 bilinear(vec4 W, vec4 X, vec4 Y, vec4 Z, vec2 weight)
+vec4 unpack_clamped(ivec2 px)
 {
-	vec4 m0 = mix(W, Z, weight.x);
-	vec4 m1 = mix(X, Y, weight.x);
-	return mix(m0, m1, weight.y);
+	return unpack(clamp(px, ivec2(0), last));
 }
 
-// Gather neighboring YUV macropixels from the given texture coordinate
-void textureGatherYUV(sampler2D sampler, vec2 tc, out vec4 W, out vec4 X, out vec4 Y, out vec4 Z)
+vec4 unpack_direct(void)
 {
-	ivec2 tx = ivec2(tc * textureSize(sampler, 0));
-	ivec2 tmin = ivec2(0, 0);
-	ivec2 tmax = textureSize(sampler, 0) - ivec2(1, 1);
-	W = texelFetch(sampler, tx, 0);
-	X = texelFetch(sampler, clamp(tx + ivec2(0, 1), tmin, tmax), 0);
-	Y = texelFetch(sampler, clamp(tx + ivec2(1, 1), tmin, tmax), 0);
-	Z = texelFetch(sampler, clamp(tx + ivec2(1, 0), tmin, tmax), 0);
-}
+	// fragment to frame position, row 0 of the frame at the top
+	vec2 pos = (gl_FragCoord.xy - viewport.xy) / viewport.zw;
+	pos = vec2(pos.x, 1.0 - pos.y) * vec2(last + 1);
 
-vec4 color_control(vec4 pixel, float brightness)
-{
-	vec3 scaled = pixel.rgb * vec3(brightness);
-	vec3 clamped = clamp(scaled, vec3(0.0), vec3(1.0));
-	return vec4(clamped, pixel.a);
+	if(direct == 1) {
+		return unpack_clamped(ivec2(pos));
+	}
+
+	vec2 p = pos - 0.5;
+	ivec2 p0 = ivec2(floor(p));
+	vec2 f = p - vec2(p0);
+	vec4 top = mix(unpack_clamped(p0), unpack_clamped(p0 + ivec2(1, 0)), f.x);
+	vec4 bottom = mix(unpack_clamped(p0 + ivec2(0, 1)), unpack_clamped(p0 + ivec2(1, 1)), f.x);
+	return mix(top, bottom, f.y);
 }
 
 void main(void)
 {
-	/* The shader uses texelFetch to obtain the YUV macropixels to avoid
-	 * unwanted interpolation introduced by the GPU interpreting the YUV
-	 * data as RGBA pixels. The YUV macropixels are converted into
-	 * individual RGB pixels and bilinear interpolation is applied. */
-	float alpha = 1.0;
-
-	vec4 macro, macro_u, macro_r, macro_ur;
-	vec4 pixel, pixel_r, pixel_u, pixel_ur;
+	if(direct != 0) {
+		vec4 c = unpack_direct();
+		color = vec4(clamp(c.rgb * brightness, vec3(0.0), vec3(1.0)), c.a);
+		return;
+	}
 
-	textureGatherYUV(frame, pos, macro, macro_u, macro_ur, macro_r);
+	// Runs once per frame pixel, or per block of pixels, into the
+	// unpacked RGB texture
+	ivec2 px = ivec2(gl_FragCoord.xy) * scale;
 
-	// Select the components for the bilinear interpolation based on the
-	// texture coordinate location within the YUV macropixel:
-	// +---------------+          +--------------------+
-	// | UY/VY | UY/VY |          | macro_u | macro_ur |
-	// |-------|-------|    =>    |---------|----------|
-	// | UY/VY | UY/VY |          | macro   | macro_r  |
-	// |-------|-------|          +--------------------+
-	// | RG/BA | RG/BA |
-	// +---------------+
-	vec2 off = fract(pos * textureSize(frame, 0));
-	if(off.x > 0.5) { // right half of macropixel
-		pixel = color_control(rec709YCbCr2rgba(macro.a, macro.b, macro.r, alpha), brightness);
-		pixel_r = color_control(rec709YCbCr2rgba(macro_r.g, macro_r.b, macro_r.r, alpha), brightness);
-		pixel_u = color_control(rec709YCbCr2rgba(macro_u.a, macro_u.b, macro_u.r, alpha), brightness);
-		pixel_ur = color_control(rec709YCbCr2rgba(macro_ur.g, macro_ur.b, macro_ur.r, alpha), brightness);
-	} else { // left half & center of macropixel
-		pixel = color_control(rec709YCbCr2rgba(macro.g, macro.b, macro.r, alpha), brightness);
-		pixel_r = color_control(rec709YCbCr2rgba(macro.a, macro.b, macro.r, alpha), brightness);
-		pixel_u = color_control(rec709YCbCr2rgba(macro_u.g, macro_u.b, macro_u.r, alpha), brightness);
-		pixel_ur = color_control(rec709YCbCr2rgba(macro_u.a, macro_u.b, macro_u.r, alpha), brightness);
+	vec4 sum = vec4(0.0);
+	for(int y = 0; y < scale; y++) {
+		for(int x = 0; x < scale; x++) {
+			sum += unpack(min(px + ivec2(x, y), last));
+		}
 	}
 
-	if(interpolate) {
-		color = bilinear(pixel, pixel_u, pixel_ur, pixel_r, off);
-	} else {
-		color = pixel;
-	}
+	color = sum / float(scale * scale);
 }
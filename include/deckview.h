@@ -5,45 +5,760 @@
 #include <GL/glext.h>
 #include <DeckLinkAPI.h>
 
+#ifdef NDEBUG
+#define	GL_ERROR()
+#else
+#define	GL_ERROR()	check_error(__FILE__, __LINE__)
+
+void	check_error(const char* filename, unsigned int line);
+#endif
+
+#define	GX_PBO_CNT	3
+
+// also the size of the tile arrays in glsl/composite.vert.glsl
+#define	GX_MAX_INPUTS	16
+
+// Captured frames are held by reference, out of the DeckLink capture pool,
+// until they are drawn, written or exported. All holders of one input
+// together stay within GX_FRAME_BUDGET frames, so the card always has
+// buffers left to capture into: the renderer's ring and presentation queue
+// and, on the first input while they run, the recorder and export queues.
+#define	GX_FRAME_BUDGET	16
+#define	GX_FRAME_RINGCNT	3
+#define	RX_QUEUECNT	6
+#define	EX_QUEUECNT	2
+
+typedef enum {
+	GX_UPLOAD_DIRECT,	// glTexImage2D from client memory
+	GX_UPLOAD_PBO		// persistently mapped PBO ring into immutable storage
+} GXUploadMode;
+
+typedef enum {
+	GX_COLORSPACE_REC601,
+	GX_COLORSPACE_REC709,
+	GX_COLORSPACE_REC2020,
+	GX_COLORSPACE_CNT
+} GXColorspace;
+
+typedef enum {
+	GX_RANGE_LIMITED,	// video levels, 16-235 and 16-240 at 8 bit
+	GX_RANGE_FULL,
+	GX_RANGE_CNT
+} GXRange;
+
+typedef enum {
+	GX_TRANSFER_SDR,	// BT.709 / BT.1886 gamma
+	GX_TRANSFER_PQ,		// SMPTE ST 2084, tone mapped
+	GX_TRANSFER_HLG,	// ARIB STD-B67, tone mapped
+	GX_TRANSFER_CNT
+} GXTransfer;
+
+// How the samples of a frame map to colours. Where a field is _CNT it is
+// not known, or not forced, and detected.
+typedef struct {
+	GXColorspace	colorspace;
+	GXRange	range;
+	GXTransfer	transfer;
+} GXColorimetry;
+
+#define	GX_COLORIMETRY_CNT	(GX_COLORSPACE_CNT * GX_RANGE_CNT * GX_TRANSFER_CNT)
+
+typedef struct {
+	GLuint	shader;
+	GLuint	shader_tex;
+	GLuint	shader_scale;
+	GLuint	shader_last;
+	GLuint	shader_direct;
+	GLuint	shader_viewport;
+	GLuint	shader_brightness;
+} GXUnpackShader;
+
+// Unpack passes, packed frame to RGB, per pixel format and colorimetry.
+// Each is compiled with the defines of its colorimetry when the first
+// renderer is created, so the conversion has no branches at run time and
+// switching between them costs nothing.
+typedef struct {
+	GXUnpackShader	yuv8[GX_COLORIMETRY_CNT];
+	GXUnpackShader	yuv10[GX_COLORIMETRY_CNT];
+	GXUnpackShader	rgb10[GX_COLORIMETRY_CNT];
+} GXUnpackShaders;
+
 typedef struct {
-	GLuint	yuv8_shader;
-	GLuint	yuv8_shader_tex;
-	GLuint	yuv8_shader_brightness;
-	GLuint	yuv8_shader_interpolate;
+	// shared by all renderers
+	GXUnpackShaders*	unpack_shaders;
+	GXColorimetry	colorimetry;
+
+	// draws the unpacked frame with hardware filtering
+	GLuint	display_shader;
+	GLuint	display_shader_tex;
+	GLuint	display_shader_brightness;
 
-	GLuint	yuv10_shader;
-	GLuint	yuv10_shader_tex;
-	GLuint	yuv10_shader_size;
-	GLuint	yuv10_shader_brightness;
-	GLuint	yuv10_shader_interpolate;
+	GLuint	sampler_nearest;
+	GLuint	sampler_linear;
+
+	GLuint	unpacked;
+	GLuint	unpack_fbo;
+	GLuint	shown;		// what the display pass draws: unpacked or a deinterlaced field of it
+	GLsizei	unpacked_width;
+	GLsizei	unpacked_height;
+	bool	unpack_pending;	// unpacked is behind frame
+	unsigned long	frame_count;	// frames uploaded
 
 	GLuint	frame;
+	BMDPixelFormat	frame_format;
+	unsigned int	frame_width;
+	unsigned int	frame_height;
+
+	GXUploadMode	upload_mode;
+	bool	frame_immutable;
+	GLenum	frame_internal_format;
+	GLsizei	frame_tex_width;
+	GLsizei	frame_tex_height;
+
+	GLuint	pbo[GX_PBO_CNT];
+	void*	pbo_ptr[GX_PBO_CNT];
+	GLsync	pbo_fence[GX_PBO_CNT];
+	size_t	pbo_size;
+	unsigned int	pbo_idx;
 
 	GLuint	quad_vao;
 	GLuint	quad_vbo;
 } GXRenderer;
 
-bool	GXInit(IDeckLink* device);
+typedef enum {
+	GX_COMPOSE_TILES,	// one draw per input from its own unpacked frame
+	GX_COMPOSE_ARRAY	// inputs unpacked into a mipmapped texture array, one instanced draw
+} GXComposeMode;
+
+typedef struct {
+	int	x;		// in pixels of the viewport, origin bottom left
+	int	y;
+	int	width;
+	int	height;
+} GXTile;
+
+// Multiview compositor: every input is unpacked into one layer of an
+// RGBA16F texture array of the largest frame size, straight into the first
+// mip level its tile samples and box filtered down to the last one, and all
+// tiles are drawn at once. Deinterlaced inputs are reduced from their field.
+typedef struct {
+	GLuint	layers;
+	GLuint	fbo;
+	GLsizei	width;
+	GLsizei	height;
+	GLsizei	count;
+	GLint	levels;
+
+	GLuint	reduce_shader;
+	GLuint	reduce_shader_tex;
+	GLuint	reduce_shader_layer;
+	GLuint	reduce_shader_field;
+	GLuint	reduce_shader_scale;
+
+	GLuint	tile_shader;
+	GLuint	tile_shader_tex;
+	GLuint	tile_shader_tile;
+	GLuint	tile_shader_source;
+	GLuint	tile_shader_nearest;
+	GLuint	tile_shader_brightness;
+
+	GLuint	sampler;
+	GLuint	quad_vao;
+
+	// frame size each layer was unpacked at and its valid mip levels
+	// [base, levels), levels is 0 until the layer holds a frame
+	GLsizei	layer_width[GX_MAX_INPUTS];
+	GLsizei	layer_height[GX_MAX_INPUTS];
+	GLint	layer_base[GX_MAX_INPUTS];
+	GLint	layer_levels[GX_MAX_INPUTS];
+	unsigned long	layer_frame[GX_MAX_INPUTS];	// frame_count of the input unpacked
+} GXComposite;
+
+typedef enum {
+	GX_SCOPE_WAVEFORM,	// luma level per column
+	GX_SCOPE_PARADE,	// R, G and B levels per column, side by side
+	GX_SCOPE_VECTORSCOPE,	// Cb against Cr
+	GX_SCOPE_HISTOGRAM,	// distribution of R, G, B and luma levels
+	GX_SCOPE_CNT
+} GXScope;
+
+#define	GX_SCOPE_QUERYCNT	4
+
+typedef struct {
+	double	scatter_ms;	// GPU time per new frame
+	double	draw_ms;	// GPU time per drawn frame
+	unsigned long	scatter_count;
+	unsigned long	draw_count;
+	unsigned int	samples;	// pixels per frame counted
+} GXScopeStats;
+
+// Scopes are counted on the GPU by scattering one point per sampled pixel
+// of the unpacked frame into a float target with additive blending, GL 3.3
+// has neither atomic counters nor image stores
+typedef struct {
+	GLuint	scatter_shader;
+	GLuint	scatter_shader_tex;
+	GLuint	scatter_shader_scope;
+	GLuint	scatter_shader_columns;
+	GLuint	scatter_shader_step;
+	GLuint	scatter_shader_size;
+	GLuint	scatter_shader_bins;
+
+	GLuint	draw_shader;
+	GLuint	draw_shader_tex;
+	GLuint	draw_shader_scope;
+	GLuint	draw_shader_gain;
+
+	GLuint	accum[GX_SCOPE_CNT];
+	GLuint	fbo[GX_SCOPE_CNT];
+	GLsizei	accum_width[GX_SCOPE_CNT];
+	GLsizei	accum_height[GX_SCOPE_CNT];
+	GLuint	points_vao;
+	GLuint	quad_vao;
+
+	bool	enabled[GX_SCOPE_CNT];
+	const GXRenderer*	source[GX_SCOPE_CNT];
+	unsigned long	source_frame[GX_SCOPE_CNT];
+	unsigned int	samples[GX_SCOPE_CNT];
+
+	// two timer queries, scatter and draw, per frame in flight
+	GLuint	queries[GX_SCOPE_CNT][GX_SCOPE_QUERYCNT][2];
+	bool	query_pending[GX_SCOPE_CNT][GX_SCOPE_QUERYCNT][2];
+	unsigned int	query_idx[GX_SCOPE_CNT];
+	GLuint64	scatter_time[GX_SCOPE_CNT];
+	GLuint64	draw_time[GX_SCOPE_CNT];
+	unsigned long	scatter_count[GX_SCOPE_CNT];
+	unsigned long	draw_count[GX_SCOPE_CNT];
+} GXScopes;
+
+typedef enum {
+	GX_SCALE_BILINEAR,	// hardware filtering in the display pass
+	GX_SCALE_BICUBIC,	// Catmull-Rom, two separable passes
+	GX_SCALE_LANCZOS3,	// Lanczos-3, two separable passes
+	GX_SCALE_CNT
+} GXScaleMode;
+
+#define	GX_SCALE_QUERYCNT	(2 * GX_MAX_INPUTS)	// two frames of tiles
+#define	GX_SCALE_BUDGET		3.0	// GPU ms of all draws of a frame before falling back to a cheaper mode
+
+typedef struct {
+	double	gpu_ms;		// per draw, both passes
+	unsigned long	count;
+	double	frame_ms;	// all draws of a frame
+	unsigned long	frames;
+} GXScaleStats;
+
+// Per input: the intermediate texture of output width and frame height, and
+// the weights of both passes for the sizes and mode they were computed for
+typedef struct {
+	GLuint	intermediate;
+	GLuint	fbo;
+	GLsizei	intermediate_width;
+	GLsizei	intermediate_height;
+
+	GLuint	weights[2];	// horizontal, vertical
+	GLint	taps[2];
+	GLsizei	weights_src[2];
+	GLsizei	weights_dst[2];
+	GXScaleMode	weights_mode[2];
+} GXScaleTarget;
+
+// Scales unpacked frames to sizes other than their own in two separable
+// passes, horizontally into an intermediate texture and vertically into the
+// viewport. The filter weights of every output column and row are computed
+// on the CPU whenever a size or the mode changes, not per frame.
+typedef struct {
+	GLuint	shader;
+	GLuint	shader_tex;
+	GLuint	shader_weights;
+	GLuint	shader_taps;
+	GLuint	shader_axis;
+	GLuint	shader_origin;
+	GLuint	shader_rows;
+	GLuint	shader_last;
+	GLuint	shader_brightness;
+
+	GLuint	quad_vao;
+
+	GXScaleMode	mode;
+	double	budget;		// ms, 0 for none
+	GXScaleTarget	targets[GX_MAX_INPUTS];
+
+	// timestamps before and after a draw, read back a few draws later
+	GLuint	queries[GX_SCALE_QUERYCNT][2];
+	GXScaleMode	query_mode[GX_SCALE_QUERYCNT];
+	unsigned long	query_frame[GX_SCALE_QUERYCNT];
+	bool	query_pending[GX_SCALE_QUERYCNT];
+	unsigned int	query_idx;
+	GLuint64	time[GX_SCALE_CNT];
+	unsigned long	count[GX_SCALE_CNT];
+
+	// the draws of a frame summed as their results come in, frames with
+	// draws of several modes or untimed ones are left out
+	unsigned long	frame;		// GXScalerFrameDone calls
+	bool	frame_untimed[GX_SCALE_QUERYCNT];	// by frame
+	unsigned long	sum_frame;
+	GXScaleMode	sum_mode;
+	GLuint64	sum_time;
+	unsigned int	sum_count;
+	bool	sum_mixed;
+	GLuint64	frame_time[GX_SCALE_CNT];
+	unsigned long	frames[GX_SCALE_CNT];
+	GLuint64	window_time;	// frames of the current mode since the last budget check
+	unsigned long	window_count;
+} GXScaler;
+
+typedef enum {
+	GX_DEINTERLACE_WEAVE,		// both fields as captured, at the frame rate
+	GX_DEINTERLACE_BOB,		// each field with its missing lines interpolated
+	GX_DEINTERLACE_ADAPTIVE,	// woven where still, interpolated where moving
+	GX_DEINTERLACE_CNT
+} GXDeinterlaceMode;
+
+#define	GX_DEINTERLACE_QUERYCNT	16
+
+typedef struct {
+	double	gpu_ms;		// per field
+	unsigned long	count;
+} GXDeinterlaceStats;
+
+// Per input: the unpacked frame before the current one, exchanged with the
+// unpack target of the renderer before every new frame is unpacked, and
+// the deinterlaced field
+typedef struct {
+	GLuint	previous;
+	GLsizei	previous_width;
+	GLsizei	previous_height;
+	unsigned long	previous_count;	// frame_count of the frame it holds
+	unsigned long	unpacked_count;	// same for the unpack target
+
+	GLuint	output;
+	GLuint	fbo;
+	GLsizei	output_width;
+	GLsizei	output_height;
+} GXDeinterlaceTarget;
+
+// Turns the woven frames of interlaced inputs into one full height picture
+// per field, in a pass over the unpacked frame. The motion adaptive mode
+// takes the missing lines from the neighbouring fields where the picture
+// stands still and interpolates them within the field where it moves.
+typedef struct {
+	GLuint	shader;
+	GLuint	shader_tex;
+	GLuint	shader_previous;
+	GLuint	shader_mode;
+	GLuint	shader_parity;
+	GLuint	shader_first;
+	GLuint	shader_last;
+
+	GLuint	quad_vao;
+
+	GXDeinterlaceMode	mode;
+	GXDeinterlaceTarget	targets[GX_MAX_INPUTS];
+
+	// timestamps before and after a draw, read back a few draws later
+	GLuint	queries[GX_DEINTERLACE_QUERYCNT][2];
+	GXDeinterlaceMode	query_mode[GX_DEINTERLACE_QUERYCNT];
+	bool	query_pending[GX_DEINTERLACE_QUERYCNT];
+	unsigned int	query_idx;
+	GLuint64	time[GX_DEINTERLACE_CNT];
+	unsigned long	count[GX_DEINTERLACE_CNT];
+} GXDeinterlacer;
+
+// Where frames come from: a DeckLink card or a hardware-free stand-in. All
+// sources deliver through the IDeckLinkInputCallback they are given.
+class CaptureSource
+{
+	public:
+		virtual ~CaptureSource() { }
+
+		// connect the source to the capture callback
+		virtual bool	Init(IDeckLinkInputCallback* callback, BMDPixelFormat fmt) = 0;
+		// enable video with format detection and audio, start streaming
+		virtual bool	Start(BMDPixelFormat fmt, unsigned int sample_depth, unsigned int channels) = 0;
+		// switch the capture format, called from VideoInputFormatChanged
+		virtual bool	SetVideoMode(IDeckLinkDisplayMode* mode, BMDPixelFormat fmt) = 0;
+		// mode Start enables the input with, kept until format detection
+		// reports another one; owned by the source
+		virtual IDeckLinkDisplayMode*	StartMode(void) = 0;
+		virtual void	Stop(void) = 0;
+		// clock of the hardware reference timestamps of captured frames, us
+		virtual int64_t	ReferenceTime(void) = 0;
+		// jump to a frame of a recording, absolute or relative to the
+		// current one; live sources can't
+		virtual bool	Seek(int64_t frame, bool relative) { return false; }
+};
+
+typedef struct {
+	const char*	mode;		// display mode name, e.g. 1080p50
+	unsigned int	depth;		// 8 or 10 bit YUV
+	bool	rgb;		// 10 bit RGB 4:4:4 (r210) instead of 10 bit YUV
+	const char*	video_path;	// raw frames to replay, NULL for test pattern
+	const char*	audio_path;	// raw PCM in the capture format to replay, NULL for tone
+	const char*	capture_path;	// recording to play back, overrides the above
+	double	start;		// play back from this many seconds in
+	unsigned int	burst;		// deliver frames in bursts of this many
+	double	format_interval;	// toggle 8/10 bit every n seconds, 0 = never
+} SyntheticConfig;
+
+CaptureSource*	CreateDeckLinkSource(IDeckLink* device);
+CaptureSource*	CreateSyntheticSource(const SyntheticConfig* config);
+void	ListSyntheticModes(void);
+
+typedef enum {
+	GX_PACE_AUTO,		// pick one of the below from the input cadence
+	GX_PACE_VSYNC,		// present every frame on the next vsync
+	GX_PACE_INTERVAL,	// swap interval n for inputs at 1/n of the refresh rate
+	GX_PACE_LATCH		// take the newest frame just before vsync
+} GXPaceMode;
+
+typedef struct {
+	double	input_rate;
+	double	refresh_rate;
+	GXPaceMode	strategy;
+	int	swap_interval;
+	int64_t	latency_last;	// capture to swap, us
+	int64_t	latency_min;
+	int64_t	latency_max;
+	double	latency_avg;
+	unsigned long	latency_cnt;
+} GXPaceStats;
+
+typedef enum {
+	AX_OUTPUT_STREAM,	// asynchronous pa_stream, fed from its write callback
+	AX_OUTPUT_SIMPLE	// blocking pa_simple, the fallback
+} AXOutput;
+
+typedef struct {
+	GXUploadMode	upload_mode;
+	int	av_tolerance;	// A/V sync tolerance in us, < 0 disables sync
+	GXPaceMode	pace_mode;
+	const char*	stats_csv;	// per frame timings are written here, or NULL
+	GXComposeMode	compose_mode;
+	const char*	record_path;	// recording of the first input, or NULL
+	const char*	export_name;	// shared memory export of the first input, or NULL
+	unsigned int	audio_channels;	// captured, 2, 8 or 16
+	unsigned int	audio_depth;	// 16 or 32 bit
+	const char*	audio_route;	// see AXRoute
+	AXOutput	audio_output;
+	int64_t	audio_latency;	// output latency target, us
+	bool	audio_drift;	// resample to compensate the clock drift
+	GXScaleMode	scale_mode;
+	GXDeinterlaceMode	deinterlace_mode;
+	GXColorimetry	colorimetry;	// forced, the rest detected
+} GXConfig;
+
+bool	GXInit(CaptureSource** sources, unsigned int count, const GXConfig* config);
 void	GXMain(void);
 void	GXDestroy(void);
 
 GLuint	GXCompileShader(GLuint type, const char* src);
 GLuint	GXCreateShader(const char* vs_src, const char* fs_src);
 
-void	GXRendererInit(GXRenderer* self);
+bool	GXExtensionSupported(const char* name);
+
+void	GXRendererInit(GXRenderer* self, const GXRenderer* share);
 void	GXCreateBuffers(GXRenderer* self);
 void	GXCreateTexture(GXRenderer* self);
+void	GXSetColorimetry(GXRenderer* self, const GXColorimetry* colorimetry);
+bool	GXColorimetryParse(const char* spec, GXColorimetry* colorimetry);
+const char*	GXColorspaceName(GXColorspace colorspace);
+const char*	GXRangeName(GXRange range);
+const char*	GXTransferName(GXTransfer transfer);
+bool	GXUnpackDraw(GXRenderer* self, unsigned int scale);
+void	GXUnpackFrame(GXRenderer* self);
+void	GXSwapUnpacked(GXRenderer* self, GLuint* texture, GLsizei* width, GLsizei* height);
+void	GXDraw(GXRenderer* self, bool interpolate, float brightness);
+
+void	GXCompositeInit(GXComposite* self, const GXRenderer* share, unsigned int count);
+void	GXCompositeInvalidate(GXComposite* self);
+void	GXCompositeUnpack(GXComposite* self, unsigned int layer, GXRenderer* input, const GXTile* tile);
+void	GXCompositeDraw(GXComposite* self, const GXTile* tiles, unsigned int count, float brightness);
+void	GXCompositeDestroy(GXComposite* self);
+const char*	GXComposeModeName(GXComposeMode mode);
+
+void	GXScopesInit(GXScopes* self, const GXRenderer* share);
+bool	GXScopesToggle(GXScopes* self, GXScope scope);
+bool	GXScopesEnabled(const GXScopes* self, GXScope scope);
+bool	GXScopesCompute(GXScopes* self, GXScope scope, GXRenderer* input);
+void	GXScopesDraw(GXScopes* self, GXScope scope);
+void	GXScopesRender(GXScopes* self, GXRenderer* input, const GXTile* rects);
+void	GXScopesGetStats(GXScopes* self, GXScope scope, GXScopeStats* stats);
+void	GXScopesDestroy(GXScopes* self);
+const char*	GXScopeName(GXScope scope);
+
+void	GXScalerInit(GXScaler* self, const GXRenderer* share, GXScaleMode mode, double budget);
+void	GXScalerSetMode(GXScaler* self, GXScaleMode mode);
+void	GXScalerDraw(GXScaler* self, unsigned int slot, GXRenderer* input, float brightness);
+void	GXScalerFrameDone(GXScaler* self);
+void	GXScalerGetStats(GXScaler* self, GXScaleMode mode, GXScaleStats* stats);
+void	GXScalerDestroy(GXScaler* self);
+const char*	GXScaleModeName(GXScaleMode mode);
+
+void	GXDeinterlacerInit(GXDeinterlacer* self, const GXRenderer* share, GXDeinterlaceMode mode);
+void	GXDeinterlacerSetMode(GXDeinterlacer* self, GXDeinterlaceMode mode);
+void	GXDeinterlacerDraw(GXDeinterlacer* self, unsigned int slot, GXRenderer* input, unsigned int parity, bool first);
+void	GXDeinterlacerGetStats(GXDeinterlacer* self, GXDeinterlaceMode mode, GXDeinterlaceStats* stats);
+void	GXDeinterlacerDestroy(GXDeinterlacer* self);
+const char*	GXDeinterlaceModeName(GXDeinterlaceMode mode);
+
+bool	GXUploadSupported(GXUploadMode mode);
+void	GXSetUploadMode(GXRenderer* self, GXUploadMode mode);
+void	GXUploadFrame(GXRenderer* self, BMDPixelFormat fmt, unsigned int width, unsigned int height, unsigned int row_bytes, const void* data);
+void	GXUploadDestroy(GXRenderer* self);
+const char*	GXUploadModeName(GXUploadMode mode);
+
+void	GXPaceInit(GXPaceMode mode, double refresh_rate, int64_t (*clock)(void));
+void	GXPaceFrameArrived(int64_t arrival);
+void	GXPaceSetFields(unsigned int fields);
+GXPaceMode	GXPaceStrategy(void);
+int64_t	GXPaceLatchWait(void);
+void	GXPaceSwapped(bool new_frame, int64_t capture_time);
+void	GXPaceGetStats(GXPaceStats* stats);
+const char*	GXPaceModeName(GXPaceMode mode);
+
+typedef enum {
+	GX_STAT_ARRIVAL_JITTER,	// deviation of the callback interval from its average
+	GX_STAT_CALLBACK,	// time spent in VideoInputFrameArrived of the audio input
+	GX_STAT_AUDIO_COPY,	// copying audio into the ring in the callback
+	GX_STAT_UPLOAD,		// texture upload in the render loop
+	GX_STAT_GPU_DRAW,	// GPU time of the draw, from timer queries
+	GX_STAT_SWAP,		// glfwSwapBuffers
+	GX_STAT_AUDIO_QUEUE,	// audio queued for playback, us
+	GX_STAT_CNT
+} GXStat;
+
+extern volatile bool gx_stats_active;
+
+static inline bool GXStatsActive(void)
+{
+	return gx_stats_active;
+}
+
+bool	GXStatsInit(const char* csv_path);
+void	GXStatsDestroy(void);
+int64_t	GXStatsTime(void);
+void	GXStatsRecord(GXStat stat, int64_t value);
+void	GXStatsArrival(int64_t now);
+void	GXStatsGPUBegin(void);
+void	GXStatsGPUEnd(void);
+void	GXStatsFrameDone(void);
+void	GXStatsToggleOverlay(void);
+void	GXStatsToggleMeters(void);
+void	GXStatsDrawOverlay(void);
 
-bool	AXInit(unsigned int channels, unsigned int bit);
+#define	AX_MAX_CHANNELS	16
+#define	AX_MAX_OUTPUTS	8
+#define	AX_MIX_PAD	8	// floats the mixer may write past the last frame
+
+// Which captured channels go to the sound card and how loud, output by
+// input. Parsed from a list of outputs like "1,2", "3,4" or
+// "1+3*0.71+5*0.71,2+3*0.71+6*0.71", input channels counted from 1, or
+// "5.1" for the ITU stereo downmix of channels 1-6.
+typedef struct {
+	unsigned int	outputs;
+	float	gain[AX_MAX_OUTPUTS][AX_MAX_CHANNELS];
+} AXRoute;
+
+typedef struct {
+	size_t	queued;		// sample frames waiting for playback
+	size_t	capacity;	// ring size in sample frames
+	unsigned long	overruns;
+	unsigned long	underruns;
+	AXOutput	output;
+	int64_t	latency_target;	// us
+	int64_t	latency;	// measured output latency, us, -1 before playback
+	double	latency_avg;
+	bool	drift_locked;	// the latency is held, the rest is valid
+	double	drift;		// estimated capture to output clock drift, ppm
+	double	correction;	// resampling ratio off 1, ppm
+	double	hold_target;	// queue and output latency held, us
+	double	hold_level;	// filtered queue and output latency, us
+} AXStats;
+
+bool	AXInit(unsigned int channels, unsigned int bit, const AXRoute* route, AXOutput mode, int64_t latency, bool drift);
 void	AXStart(void);
-void	AXPlay(void* data, size_t size);
+void	AXPlay(void* data, size_t size, int64_t packet_time);
 void	AXStop(void);
 void	AXDestroy(void);
+void	AXGetStats(AXStats* stats);
+bool	AXGetClock(int64_t* stream_time);
+const char*	AXOutputName(AXOutput mode);
+
+// Capture files, written by the recorder and played back by the play:
+// source. A block sized header is followed by fixed size slots, one per
+// frame, and the frame index. Slot n starts at data_offset + n * slot_stride
+// with the frame as captured; the audio part of the slot at audio_offset
+// starts with the index entry of the frame followed by its audio, so the
+// index of an interrupted recording can be recovered from the slots. All
+// offsets are block aligned, for direct I/O and mmap.
+#define	RX_FILE_MAGIC	"DVCAPT01"
+#define	RX_FILE_ALIGN	4096
+
+typedef struct {
+	char	magic[8];
+	uint32_t	display_mode;	// BMDDisplayMode
+	uint32_t	pixel_format;	// BMDPixelFormat
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	row_bytes;
+	uint32_t	audio_channels;
+	uint32_t	sample_depth;
+	uint32_t	audio_offset;	// of the audio part within a slot
+	int64_t	frame_duration;	// in timescale units
+	int64_t	timescale;
+	uint64_t	data_offset;	// of slot 0
+	uint64_t	slot_stride;
+	uint64_t	frame_count;	// 0 if the recording was interrupted
+	uint64_t	index_offset;	// 0 if the recording was interrupted
+} RXFileHeader;
+
+typedef struct {
+	int64_t	stream_time;	// of the frame, in timescale units
+	int64_t	capture_time;	// hardware reference time of arrival, us
+	int64_t	packet_time;	// of the audio, in 48 kHz sample frames
+	uint32_t	audio_frames;	// sample frames following in the slot
+	uint32_t	flags;		// reserved
+} RXFileIndex;
+
+typedef struct {
+	unsigned long	frames;		// video frames written
+	unsigned long	dropped;	// video frames dropped, the queue was full
+	unsigned long	audio_dropped;	// audio packets cut short, larger than a slot
+	unsigned long	skipped;	// frames not matching the format of the file
+	uint64_t	video_bytes;
+	uint64_t	audio_bytes;
+	unsigned int	queue_max;	// most frames queued at once
+	unsigned int	queue_size;
+	int64_t	write_time;	// writer thread busy with video, us
+	bool	direct;		// video bypasses the page cache (O_DIRECT)
+	bool	failed;		// a write failed, nothing is written anymore
+} RXStats;
+
+bool	RXStart(const char* path, unsigned int channels, unsigned int bit);
+void	RXFormat(IDeckLinkDisplayMode* mode, BMDPixelFormat fmt);
+void	RXFrame(IDeckLinkVideoInputFrame* video, IDeckLinkAudioInputPacket* audio);
+void	RXStop(void);
+bool	RXActive(void);
+void	RXGetStats(RXStats* stats);
+
+// Shared memory export of the first input, for other local processes. The
+// POSIX shared memory object holds an EXRingHeader followed by slot_count
+// slots of slot_stride bytes, frame n goes to slot n % slot_count. A slot
+// starts with its EXSlotHeader, the frame and its audio follow at
+// video_offset and audio_offset within the slot; width is 0 for audio
+// without a video signal.
+//
+// Every slot is a seqlock, seq is odd while the slot is written. A reader
+// takes the slot of latest - 1, loads seq (acquire), uses the data in place
+// and loads seq again after an acquire fence: the data was intact if both
+// are equal and even. The writer never waits for readers, a reader too
+// slow for the ring just sees seq change and drops the frame.
+#define	EX_RING_MAGIC	"DVSHM001"
+
+typedef struct {
+	char	magic[8];
+	uint32_t	slot_count;
+	uint32_t	slot_offset;	// of slot 0
+	uint64_t	slot_stride;
+	uint64_t	video_size;	// room for a frame in a slot
+	uint64_t	audio_size;	// room for audio in a slot
+	volatile uint64_t	latest;	// frames published so far
+} EXRingHeader;
+
+typedef struct {
+	volatile uint64_t	seq;
+	uint64_t	frame;		// number of the frame in the slot
+	uint32_t	display_mode;	// BMDDisplayMode
+	uint32_t	pixel_format;	// BMDPixelFormat
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	row_bytes;
+	uint32_t	audio_channels;
+	uint32_t	sample_depth;
+	uint32_t	audio_frames;
+	int64_t	frame_duration;	// in timescale units
+	int64_t	timescale;
+	int64_t	stream_time;	// in timescale units
+	int64_t	capture_time;	// hardware reference time of arrival, us
+	int64_t	packet_time;	// of the audio, in 48 kHz sample frames
+	uint32_t	video_offset;
+	uint32_t	audio_offset;
+} EXSlotHeader;
+
+typedef struct {
+	unsigned long	frames;		// frames published
+	unsigned long	dropped;	// the queue to the export thread was full
+	unsigned long	oversize;	// too large for a slot, published as audio only
+	int64_t	copy_time;	// export thread busy copying, us
+} EXStats;
+
+bool	EXStart(const char* name, unsigned int channels, unsigned int bit);
+void	EXFormat(IDeckLinkDisplayMode* mode, BMDPixelFormat fmt);
+void	EXFrame(IDeckLinkVideoInputFrame* video, IDeckLinkAudioInputPacket* audio);
+void	EXStop(void);
+bool	EXActive(void);
+void	EXGetStats(EXStats* stats);
+
+typedef enum {
+	CX_UYVY_RGBA8,		// 8 bit UYVY to 8 bit RGBA
+	CX_V210_RGBA16,		// v210 to 16 bit RGBA
+	CX_V210_RGB10,		// v210 to 2:10:10:10 RGB, the GL_RGB10_A2 layout
+	CX_KERNEL_CNT
+} CXKernel;
+
+typedef enum {
+	CX_ISA_SCALAR,		// reference implementation
+	CX_ISA_SSE41,
+	CX_ISA_AVX2,
+	CX_ISA_CNT
+} CXIsa;
+
+CXIsa	CXDetectIsa(void);
+bool	CXIsaSupported(CXIsa isa);
+const char*	CXIsaName(CXIsa isa);
+const char*	CXKernelName(CXKernel kernel);
+size_t	CXOutputRowBytes(CXKernel kernel, unsigned int width);
+void	CXConvert(CXKernel kernel, CXIsa isa, const void* src, size_t src_stride, void* dst, size_t dst_stride, unsigned int width, unsigned int height, unsigned int threads);
+
+#define	AX_METER_FLOOR	-100.0f	// dB, reported for silence
+
+// Levels of the played audio, updated every 100 ms. Loudness follows EBU
+// R128 (ITU-R BS.1770 K-weighting, ungated), the program loudness weighs all
+// channels alike as the channel layout is not known.
+typedef struct {
+	unsigned int	channels;
+	float	peak[AX_MAX_CHANNELS];		// sample peak of the last 100 ms, dBFS
+	float	peak_hold[AX_MAX_CHANNELS];	// of the last 3 s
+	float	rms[AX_MAX_CHANNELS];		// of the last 400 ms, dBFS, a full scale sine reads -3
+	float	momentary[AX_MAX_CHANNELS];	// of the last 400 ms, LUFS
+	float	short_term[AX_MAX_CHANNELS];	// of the last 3 s, LUFS
+	float	program_momentary;
+	float	program_short_term;
+	uint64_t	blocks;		// 100 ms blocks measured
+	double	load;		// time spent measuring per audio time
+} AXMeterLevels;
+
+bool	AXMeterInit(unsigned int channels, unsigned int bit, CXIsa isa);
+void	AXMeterProcess(const void* data, size_t frames);
+bool	AXMeterGet(AXMeterLevels* levels);
+// interleaved 16 or 32 bit samples to rows of floats, stride floats apart
+void	AXSpread(const void* src, unsigned int channels, unsigned int bit, unsigned int n, float* rows, unsigned int stride, CXIsa isa);
+
+bool	AXRouteParse(const char* spec, unsigned int channels, AXRoute* route);
+void	AXRoutePrint(const AXRoute* route, unsigned int channels);
+bool	AXMixInit(unsigned int channels, unsigned int bit, const AXRoute* route, CXIsa isa);
+void	AXMix(const void* src, size_t frames, float* dst);
+
+bool	AXResampleInit(unsigned int channels, CXIsa isa);
+size_t	AXResample(const float* src, size_t frames, double ratio, float* dst);
+
+struct GXInput;
 
 class DeckLinkCaptureDelegate : public IDeckLinkInputCallback
 {
 	public:
-		DeckLinkCaptureDelegate() : refcnt(1) { }
+		DeckLinkCaptureDelegate(GXInput* input) : refcnt(1), input(input) { }
 
 		virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, LPVOID* ppv) {
 			return E_NOINTERFACE;
@@ -67,6 +782,7 @@ class DeckLinkCaptureDelegate : public IDeckLinkInputCallback
 
 	private:
 		unsigned int	refcnt;
+		GXInput*	input;
 };
 
 #endif
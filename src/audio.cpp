@@ -1,89 +1,533 @@
+#include <cstdio>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <cmath>
+#include <ctime>
+#include <climits>
 #include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <pulse/simple.h>
+#include <pulse/pulseaudio.h>
 
 #include "deckview.h"
 
-static pa_simple* pulse;
 static pthread_t thread;
-static pthread_mutex_t mutex;
 
 static volatile bool quit;
 
-#define	AUDIO_BUFCNT	4
+// Single producer (DeckLink callback) / single consumer (ax_thread) ring
+// buffer. Read and write positions are free running byte counters that only
+// ever grow; each side only writes its own counter. The reader sleeps on a
+// futex which the writer bumps after every packet, so the writer never
+// takes a lock and the reader never spins.
+#define	AUDIO_RATE		48000
+#define	AUDIO_RING_FRAMES	16384
+#define	AUDIO_CHUNK_FRAMES	1024
+#define	AUDIO_WAIT_TIMEOUT	100000000 /* ns */
+
+static uint8_t* ring = NULL;
+static size_t ring_size = 0;
+static size_t frame_bytes = 0;
+
+// one chunk routed to the output channels, and resampled
+static float* output = NULL;
+static float* resampled = NULL;
+static unsigned int output_channels = 0;
+
+static volatile uint64_t ring_r;
+static volatile uint64_t ring_w;
+static volatile uint32_t ring_futex;
+static volatile uint32_t ring_waiting;
+
+static volatile unsigned long overruns;
+static volatile unsigned long underruns;
+
+// Output to PulseAudio, preferably an asynchronous stream whose write
+// callback pulls from the ring as the server asks for data and that
+// ax_thread tops up whenever a packet arrives, both with the mainloop
+// locked. The blocking pa_simple API is the fallback, written to from
+// ax_thread. Both ask for a buffer of the latency target instead of the
+// server default of up to 2 s.
+static AXOutput output_mode;
+static pa_sample_spec sample_spec;
+static pa_buffer_attr buffer_attr;
+static int64_t latency_target;
+
+static pa_simple* pulse;
+
+static pa_threaded_mainloop* mainloop;
+static pa_context* context;
+static pa_stream* stream;
+static bool feeding;	// between AXStart and AXStop, under the mainloop lock
+
+// measured output latency, written by whoever feeds
+static int64_t latency_last;
+static int64_t latency_min;
+static int64_t latency_max;
+static int64_t latency_sum;
+static unsigned long latency_cnt;
+
+// Drift compensation: the card and the sound card run off different
+// clocks, so the queue between them slowly fills up or drains. The queue
+// and the measured output latency are low passed and, once settled, held at
+// the level they settled at by resampling the output a little faster or
+// slower. The ratio comes from a critically damped PI loop; its integral
+// converges on the clock drift itself.
+#define	DRIFT_SETTLE	5000000	/* us before the level is locked */
+#define	DRIFT_FILTER	2.0	/* s, time constant of the level */
+#define	DRIFT_PERIOD	600.0	/* s, natural period of the loop */
+#define	DRIFT_LIMIT	1000.0	/* ppm */
+
+static bool drift_enabled;
+static int64_t drift_start;
+static int64_t drift_last;
+static double drift_level;	// s, filtered queue and output latency
+static double drift_target;	// s, < 0 until locked
+static double drift_integral;	// ppm, the drift estimate
+static double drift_correction;	// ppm, applied to the ratio
+
+// Stream time (in sample frames) of ring position 0, updated from the
+// packet time of every captured audio packet.
+static volatile int64_t ring_base;
+
+// Audio clock: stream time of the sample currently leaving the speakers as
+// of clock_mono, published by ax_thread through a seqlock.
+#define	AUDIO_CLOCK_STALE	500000 /* us */
+
+static volatile uint32_t clock_seq;
+static volatile int64_t clock_stream;
+static volatile int64_t clock_mono;
+static volatile bool clock_valid;
+
+static void futex_wait(volatile uint32_t* addr, uint32_t val, long timeout_ns)
+{
+	struct timespec ts;
+	ts.tv_sec = timeout_ns / 1000000000;
+	ts.tv_nsec = timeout_ns % 1000000000;
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+static void futex_wake(volatile uint32_t* addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static void ring_signal(void)
+{
+	__atomic_add_fetch(&ring_futex, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&ring_waiting, __ATOMIC_SEQ_CST)) {
+		futex_wake(&ring_futex);
+	}
+}
+
+static int64_t monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void publish_clock(int64_t stream_time)
+{
+	__atomic_add_fetch(&clock_seq, 1, __ATOMIC_ACQ_REL);
+	clock_stream = stream_time;
+	clock_mono = monotonic_us();
+	clock_valid = true;
+	__atomic_add_fetch(&clock_seq, 1, __ATOMIC_RELEASE);
+}
+
+const char* AXOutputName(AXOutput mode)
+{
+	switch(mode) {
+		case AX_OUTPUT_STREAM:
+			return "stream";
+		case AX_OUTPUT_SIMPLE:
+			return "simple";
+		default:
+			return "unknown";
+	}
+}
+
+static double clamp_ppm(double ppm)
+{
+	return ppm > DRIFT_LIMIT ? DRIFT_LIMIT : ppm < -DRIFT_LIMIT ? -DRIFT_LIMIT : ppm;
+}
+
+// Takes the queue and output latency after every write. A queue above
+// the target means the capture clock runs fast, so more input is consumed
+// per output frame.
+static void steer(int64_t queued)
+{
+	int64_t now = monotonic_us();
+	double level = queued / 1000000.0;
+
+	if(!drift_last) {
+		drift_start = drift_last = now;
+		drift_level = level;
+		return;
+	}
+
+	double dt = (now - drift_last) / 1000000.0;
+	drift_last = now;
+
+	double alpha = dt / DRIFT_FILTER;
+	drift_level += (level - drift_level) * (alpha < 1.0 ? alpha : 1.0);
+
+	if(drift_target < 0) {
+		if(now - drift_start >= DRIFT_SETTLE) {
+			drift_target = drift_level;
+		}
+		return;
+	}
+
+	// error in s, gains in ppm per s of error
+	double wn = 2.0 * M_PI / DRIFT_PERIOD;
+	double error = drift_level - drift_target;
+	drift_integral = clamp_ppm(drift_integral + wn * wn * 1e6 * error * dt);
+	drift_correction = clamp_ppm(drift_integral + 2.0 * wn * 1e6 * error);
+}
+
+static void record_latency(int64_t latency)
+{
+	latency_last = latency;
+	if(!latency_cnt || latency < latency_min) {
+		latency_min = latency;
+	}
+	if(!latency_cnt || latency > latency_max) {
+		latency_max = latency;
+	}
+	latency_sum += latency;
+	latency_cnt++;
+}
+
+// Routes up to max_frames of the queue to the sound card, returns the
+// number of frames written. Called on ax_thread or, for the stream, in its
+// write callback, always with the mainloop locked.
+static size_t feed(size_t max_frames)
+{
+	uint64_t r = ring_r;
+	uint64_t w = __atomic_load_n(&ring_w, __ATOMIC_ACQUIRE);
+
+	// the contiguous part up to the end of the ring
+	size_t offset = r % ring_size;
+	size_t size = w - r;
+	if(size > ring_size - offset) {
+		size = ring_size - offset;
+	}
+	if(size > AUDIO_CHUNK_FRAMES * frame_bytes) {
+		size = AUDIO_CHUNK_FRAMES * frame_bytes;
+	}
+	if(size > max_frames * frame_bytes) {
+		size = max_frames * frame_bytes;
+	}
+	if(size == 0) {
+		return 0;
+	}
+
+	size_t frames = size / frame_bytes;
+	AXMix(ring + offset, frames, output);
+
+	float* out = output;
+	size_t out_frames = frames;
+	if(drift_enabled) {
+		out = resampled;
+		out_frames = AXResample(output, frames, 1.0 + drift_correction * 1e-6, resampled);
+	}
+	size_t bytes = out_frames * output_channels * sizeof(float);
+
+	pa_usec_t latency = (pa_usec_t) -1;
+	if(stream) {
+		if(bytes) {
+			pa_stream_write(stream, out, bytes, NULL, 0, PA_SEEK_RELATIVE);
+		}
+
+		int negative = 0;
+		if(pa_stream_get_latency(stream, &latency, &negative) < 0) {
+			latency = (pa_usec_t) -1;
+		} else if(negative) {
+			latency = 0;
+		}
+	} else {
+		pa_simple_write(pulse, out, bytes, NULL);
+		latency = pa_simple_get_latency(pulse, NULL);
+	}
+
+	AXMeterProcess(ring + offset, frames);
+
+	__atomic_store_n(&ring_r, r + size, __ATOMIC_RELEASE);
+
+	// everything written so far minus what is still queued in
+	// PulseAudio is what is audible right now
+	if(latency != (pa_usec_t) -1) {
+		int64_t base = __atomic_load_n(&ring_base, __ATOMIC_RELAXED);
+		int64_t written = (int64_t) ((r + size) / frame_bytes) + base;
+		int64_t played = written * 1000000 / AUDIO_RATE - (int64_t) latency;
+		publish_clock(played);
+		record_latency(latency);
+
+		if(drift_enabled) {
+			int64_t queued = (int64_t) ((w - r - size) / frame_bytes) * 1000000 / AUDIO_RATE;
+			steer(queued + (int64_t) latency);
+		}
+	}
+
+	return frames;
+}
+
+// Writes as much as the stream takes and the queue holds
+static void feed_stream(void)
+{
+	size_t writable = pa_stream_writable_size(stream);
+	if(!feeding || writable == (size_t) -1) {
+		return;
+	}
+
+	size_t frames = writable / (output_channels * sizeof(float));
+	while(frames > 0) {
+		size_t n = feed(frames);
+		if(n == 0) {
+			break;
+		}
+		frames -= n;
+	}
+}
+
+static void context_state(pa_context* c, void* userdata)
+{
+	pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void stream_state(pa_stream* s, void* userdata)
+{
+	pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void stream_write(pa_stream* s, size_t nbytes, void* userdata)
+{
+	feed_stream();
+}
+
+static void stream_underflow(pa_stream* s, void* userdata)
+{
+	if(feeding) {
+		__atomic_add_fetch(&underruns, 1, __ATOMIC_RELAXED);
+	}
+}
+
+// The mainloop must not be locked
+static void close_stream(void)
+{
+	if(mainloop) {
+		pa_threaded_mainloop_stop(mainloop);
+	}
+
+	if(stream) {
+		pa_stream_disconnect(stream);
+		pa_stream_unref(stream);
+		stream = NULL;
+	}
+
+	if(context) {
+		pa_context_disconnect(context);
+		pa_context_unref(context);
+		context = NULL;
+	}
 
-static volatile void* audio_data[AUDIO_BUFCNT];
-static volatile size_t audio_size[AUDIO_BUFCNT];
-static volatile unsigned int audio_buf_r;
-static volatile unsigned int audio_buf_w;
+	if(mainloop) {
+		pa_threaded_mainloop_free(mainloop);
+		mainloop = NULL;
+	}
+}
 
-bool AXInit(unsigned int channels, unsigned int bit)
+static bool open_stream(void)
 {
-	pa_sample_spec ss;
+	mainloop = pa_threaded_mainloop_new();
+	if(!mainloop) {
+		return false;
+	}
+
+	context = pa_context_new(pa_threaded_mainloop_get_api(mainloop), "DeckLink View");
+	if(!context) {
+		close_stream();
+		return false;
+	}
+	pa_context_set_state_callback(context, context_state, NULL);
+
+	if(pa_threaded_mainloop_start(mainloop) < 0) {
+		close_stream();
+		return false;
+	}
 
-	pthread_mutex_init(&mutex, NULL);
+	pa_threaded_mainloop_lock(mainloop);
 
-	switch(bit) {
-		case 16:
-			ss.format = PA_SAMPLE_S16NE;
+	bool ok = pa_context_connect(context, NULL, PA_CONTEXT_NOFLAGS, NULL) >= 0;
+	while(ok) {
+		pa_context_state_t state = pa_context_get_state(context);
+		if(state == PA_CONTEXT_READY) {
 			break;
-		case 24:
-			ss.format = PA_SAMPLE_S24NE;
+		}
+		ok = PA_CONTEXT_IS_GOOD(state);
+		if(ok) {
+			pa_threaded_mainloop_wait(mainloop);
+		}
+	}
+
+	if(ok) {
+		stream = pa_stream_new(context, "Capture Audio", &sample_spec, NULL);
+		ok = stream != NULL;
+	}
+
+	if(ok) {
+		pa_stream_set_state_callback(stream, stream_state, NULL);
+		pa_stream_set_write_callback(stream, stream_write, NULL);
+		pa_stream_set_underflow_callback(stream, stream_underflow, NULL);
+
+		pa_stream_flags_t flags = (pa_stream_flags_t) (PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_ADJUST_LATENCY);
+		ok = pa_stream_connect_playback(stream, NULL, &buffer_attr, flags, NULL, NULL) >= 0;
+	}
+
+	while(ok) {
+		pa_stream_state_t state = pa_stream_get_state(stream);
+		if(state == PA_STREAM_READY) {
 			break;
+		}
+		ok = PA_STREAM_IS_GOOD(state);
+		if(ok) {
+			pa_threaded_mainloop_wait(mainloop);
+		}
+	}
+
+	if(ok) {
+		const pa_buffer_attr* attr = pa_stream_get_buffer_attr(stream);
+		printf("Audio output: stream, %.1f ms buffer for a %.1f ms target\n", pa_bytes_to_usec(attr->tlength, &sample_spec) / 1000.0, latency_target / 1000.0);
+	} else {
+		printf("Audio output: stream failed: %s\n", pa_strerror(pa_context_errno(context)));
 	}
 
-	ss.channels = channels;
-	ss.rate = 48000;
+	pa_threaded_mainloop_unlock(mainloop);
+
+	if(!ok) {
+		close_stream();
+	}
+	return ok;
+}
 
+static bool open_simple(void)
+{
 	pulse = pa_simple_new(NULL,	// Use the default server.
 		"DeckLink View",	// Our application's name.
 		PA_STREAM_PLAYBACK,
 		NULL,			// Use the default device.
 		"Capture Audio",	// Description of our stream.
-		&ss,			// Our sample format.
+		&sample_spec,		// Our sample format.
 		NULL,			// Use default channel map
-		NULL,			// Use default buffering attributes.
+		&buffer_attr,		// Buffer for the latency target.
 		NULL);			// Ignore error code.
 
+	if(pulse) {
+		printf("Audio output: simple, %.1f ms target\n", latency_target / 1000.0);
+	}
 	return pulse != NULL;
 }
 
+// Captured audio is queued as it comes, channels and sample format of the
+// card, and routed to the sound card as float samples. A stream output
+// falls back to pa_simple if it can't be set up. With drift set the output
+// is resampled to hold the latency.
+bool AXInit(unsigned int channels, unsigned int bit, const AXRoute* route, AXOutput mode, int64_t latency, bool drift)
+{
+	sample_spec.format = PA_SAMPLE_FLOAT32NE;
+	sample_spec.channels = route->outputs;
+	sample_spec.rate = AUDIO_RATE;
+
+	// the server requests data in quarters of the target
+	latency_target = latency;
+	buffer_attr.maxlength = (uint32_t) -1;
+	buffer_attr.tlength = pa_usec_to_bytes(latency, &sample_spec);
+	buffer_attr.prebuf = (uint32_t) -1;
+	buffer_attr.minreq = pa_usec_to_bytes(latency / 4, &sample_spec);
+	buffer_attr.fragsize = (uint32_t) -1;
+
+	frame_bytes = channels * (bit / 8);
+	ring_size = AUDIO_RING_FRAMES * frame_bytes;
+	ring = (uint8_t*) malloc(ring_size);
+	if(!ring) {
+		return false;
+	}
+
+	output_channels = route->outputs;
+	output = (float*) malloc((AUDIO_CHUNK_FRAMES * output_channels + AX_MIX_PAD) * sizeof(float));
+	if(!output) {
+		return false;
+	}
+
+	// a chunk resampled by at most DRIFT_LIMIT
+	drift_enabled = drift;
+	resampled = (float*) malloc(((AUDIO_CHUNK_FRAMES + 2) * output_channels + AX_MIX_PAD) * sizeof(float));
+	if(!resampled) {
+		return false;
+	}
+
+	if(!AXMixInit(channels, bit, route, CXDetectIsa())) {
+		return false;
+	}
+	if(!AXResampleInit(output_channels, CXDetectIsa())) {
+		return false;
+	}
+	AXMeterInit(channels, bit, CXDetectIsa());
+
+	if(mode == AX_OUTPUT_STREAM) {
+		if(open_stream()) {
+			output_mode = AX_OUTPUT_STREAM;
+			return true;
+		}
+		printf("Audio output: falling back to simple\n");
+	}
+
+	output_mode = AX_OUTPUT_SIMPLE;
+	return open_simple();
+}
+
 static void* ax_thread(void* arg)
 {
-	void* buf = NULL;
-	size_t sz = 0;
+	bool playing = false;
+
 	while(!quit) {
-		pthread_mutex_lock(&mutex);
-		unsigned int r = audio_buf_r;
-		audio_buf_r = (audio_buf_r + 1) % AUDIO_BUFCNT;
+		uint32_t seq = __atomic_load_n(&ring_futex, __ATOMIC_SEQ_CST);
 
-		volatile void* abuf = audio_data[r];
-		size_t asz = audio_size[r];
+		// top up the stream, the write callback takes the rest
+		if(stream) {
+			pa_threaded_mainloop_lock(mainloop);
+			feed_stream();
+			pa_threaded_mainloop_unlock(mainloop);
 
-		if(asz == 0) {
-			pthread_mutex_unlock(&mutex);
+			__atomic_store_n(&ring_waiting, 1, __ATOMIC_SEQ_CST);
+			futex_wait(&ring_futex, seq, AUDIO_WAIT_TIMEOUT);
+			__atomic_store_n(&ring_waiting, 0, __ATOMIC_SEQ_CST);
 			continue;
 		}
 
-		if(buf == NULL) {
-			buf = malloc(asz);
-			sz = asz;
-		} else if(sz != asz) {
-			buf = realloc((void*) buf, asz);
-			sz = asz;
-		}
+		uint64_t r = ring_r;
+		uint64_t w = __atomic_load_n(&ring_w, __ATOMIC_ACQUIRE);
 
-		memcpy(buf, (void*) abuf, asz);
-		pthread_mutex_unlock(&mutex);
+		if(w == r) {
+			__atomic_store_n(&ring_waiting, 1, __ATOMIC_SEQ_CST);
+			futex_wait(&ring_futex, seq, AUDIO_WAIT_TIMEOUT);
+			__atomic_store_n(&ring_waiting, 0, __ATOMIC_SEQ_CST);
 
-		if(buf && sz > 0) {
-			pa_simple_write(pulse, buf, sz, NULL);
+			// no data within the timeout while streaming
+			if(playing && __atomic_load_n(&ring_w, __ATOMIC_ACQUIRE) == r && !quit) {
+				__atomic_add_fetch(&underruns, 1, __ATOMIC_RELAXED);
+				playing = false;
+			}
+			continue;
 		}
-	}
 
-	if(buf) {
-		free(buf);
+		playing = true;
+		feed(AUDIO_CHUNK_FRAMES);
 	}
 
 	return NULL;
@@ -91,17 +535,62 @@ static void* ax_thread(void* arg)
 
 void AXStart(void)
 {
+	if(stream) {
+		pa_threaded_mainloop_lock(mainloop);
+	}
+
 	quit = false;
-	audio_buf_r = AUDIO_BUFCNT - 1;
-	audio_buf_w = 0;
+	ring_r = 0;
+	ring_w = 0;
+	overruns = 0;
+	underruns = 0;
+	ring_base = 0;
+	clock_valid = false;
+	latency_cnt = 0;
+	latency_sum = 0;
+	drift_last = 0;
+	drift_target = -1;
+	drift_integral = 0;
+	drift_correction = 0;
+	AXResampleInit(output_channels, CXDetectIsa());
+	feeding = true;
+
+	if(stream) {
+		pa_threaded_mainloop_unlock(mainloop);
+	}
+
 	pthread_create(&thread, NULL, ax_thread, NULL);
 }
 
 void AXStop(void)
 {
 	if(thread) {
+		if(stream) {
+			pa_threaded_mainloop_lock(mainloop);
+			feeding = false;
+			pa_threaded_mainloop_unlock(mainloop);
+		}
+
 		quit = true;
+		ring_signal();
 		pthread_join(thread, NULL);
+
+		if(overruns || underruns) {
+			printf("Audio: %lu overruns, %lu underruns\n", (unsigned long) overruns, (unsigned long) underruns);
+		}
+
+		if(latency_cnt) {
+			printf("Audio output (%s): %.1f ms latency average, %.1f ms min, %.1f ms max, %.1f ms target\n", AXOutputName(output_mode), latency_sum / 1000.0 / latency_cnt, latency_min / 1000.0, latency_max / 1000.0, latency_target / 1000.0);
+		}
+
+		if(drift_enabled && drift_target >= 0) {
+			printf("Audio clock drift: %+.2f ppm, latency held at %.1f ms (%.1f ms at the end)\n", drift_integral, drift_target * 1000.0, drift_level * 1000.0);
+		}
+
+		AXMeterLevels meter;
+		if(AXMeterGet(&meter)) {
+			printf("Audio: %.1f LUFS short-term at the end, meters %.3f%% of the audio time (%s)\n", meter.program_short_term, meter.load * 100.0, CXIsaName(CXDetectIsa()));
+		}
 	}
 	thread = 0;
 }
@@ -111,25 +600,96 @@ void AXDestroy(void)
 	if(thread) {
 		AXStop();
 	}
-	pa_simple_free(pulse);
+
+	close_stream();
+	if(pulse) {
+		pa_simple_free(pulse);
+		pulse = NULL;
+	}
+
+	if(ring) {
+		free(ring);
+		ring = NULL;
+	}
+
+	free(output);
+	output = NULL;
+	free(resampled);
+	resampled = NULL;
 }
 
-void AXPlay(void* data, size_t size)
+void AXGetStats(AXStats* stats)
 {
-	pthread_mutex_lock(&mutex);
-	unsigned int w = audio_buf_w;
-	audio_buf_w = (audio_buf_w + 1) % AUDIO_BUFCNT;
+	uint64_t r = __atomic_load_n(&ring_r, __ATOMIC_ACQUIRE);
+	uint64_t w = __atomic_load_n(&ring_w, __ATOMIC_ACQUIRE);
 
-	volatile void** abuf = &audio_data[w];
-	volatile size_t* asz = &audio_size[w];
+	stats->queued = frame_bytes ? (w - r) / frame_bytes : 0;
+	stats->capacity = AUDIO_RING_FRAMES;
+	stats->overruns = overruns;
+	stats->underruns = underruns;
+	stats->output = output_mode;
+	stats->latency_target = latency_target;
+	stats->latency = latency_cnt ? latency_last : -1;
+	stats->latency_avg = latency_cnt ? (double) latency_sum / latency_cnt : 0;
+	stats->drift_locked = drift_enabled && drift_target >= 0;
+	stats->drift = drift_integral;
+	stats->correction = drift_correction;
+	stats->hold_target = drift_target * 1000000.0;
+	stats->hold_level = drift_level * 1000000.0;
+}
+
+bool AXGetClock(int64_t* stream_time)
+{
+	uint32_t seq;
+	int64_t stream;
+	int64_t mono;
+	bool valid;
 
-	if(*abuf == NULL) {
-		*abuf = malloc(size);
-		*asz = size;
-	} else if(size != *asz) {
-		*abuf = realloc((void*) *abuf, size);
-		*asz = size;
+	do {
+		seq = __atomic_load_n(&clock_seq, __ATOMIC_ACQUIRE);
+		stream = clock_stream;
+		mono = clock_mono;
+		valid = clock_valid;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while((seq & 1) || seq != __atomic_load_n(&clock_seq, __ATOMIC_RELAXED));
+
+	int64_t elapsed = monotonic_us() - mono;
+	if(!valid || elapsed > AUDIO_CLOCK_STALE) {
+		return false;
 	}
-	memcpy((void*) *abuf, data, size);
-	pthread_mutex_unlock(&mutex);
+
+	*stream_time = stream + elapsed;
+	return true;
+}
+
+// Called from the DeckLink callback: must not block or allocate
+void AXPlay(void* data, size_t size, int64_t packet_time)
+{
+	uint64_t w = ring_w;
+	uint64_t r = __atomic_load_n(&ring_r, __ATOMIC_ACQUIRE);
+
+	__atomic_store_n(&ring_base, packet_time - (int64_t) (w / frame_bytes), __ATOMIC_RELAXED);
+	size_t space = ring_size - (w - r);
+
+	// keep as many whole sample frames as fit, drop the rest
+	if(size > space) {
+		size = space - (space % frame_bytes);
+		__atomic_add_fetch(&overruns, 1, __ATOMIC_RELAXED);
+	}
+
+	if(size == 0) {
+		return;
+	}
+
+	size_t offset = w % ring_size;
+	size_t first = ring_size - offset;
+	if(first > size) {
+		first = size;
+	}
+
+	memcpy(ring + offset, data, first);
+	memcpy(ring, (uint8_t*) data + first, size - first);
+
+	__atomic_store_n(&ring_w, w + size, __ATOMIC_RELEASE);
+	ring_signal();
 }
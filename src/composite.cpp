@@ -0,0 +1,346 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "deckview.h"
+
+extern "C" {
+extern const char reduce_vert[];
+extern const char reduce_frag[];
+extern const char composite_vert[];
+extern const char composite_frag[];
+}
+
+// the quad of GXCreateBuffers
+#define	QUAD_VTX_CNT	6
+
+const char* GXComposeModeName(GXComposeMode mode)
+{
+	switch(mode) {
+		case GX_COMPOSE_TILES:
+			return "tiles";
+		case GX_COMPOSE_ARRAY:
+			return "array";
+		default:
+			return "unknown";
+	}
+}
+
+static GLsizei level_size(GLsizei size, GLint level)
+{
+	size >>= level;
+	return size ? size : 1;
+}
+
+// Texels of a level covering the first size pixels of level 0
+static GLsizei level_extent(GLsizei size, GLsizei layer_size, GLint level)
+{
+	GLsizei extent = (size + (1 << level) - 1) >> level;
+	GLsizei max = level_size(layer_size, level);
+	return extent < max ? extent : max;
+}
+
+// Levels a tile samples from: trilinear filtering blends the two levels
+// around the minification factor, a tile at frame size or larger only uses
+// level 0. base is the finest level, levels the count from level 0.
+static GLint levels_for(GLsizei width, GLsizei height, const GXTile* tile, GLint max, GLint* base)
+{
+	GLint levels = 1;
+	while(levels < max && ((tile->width << (levels - 1)) < width || (tile->height << (levels - 1)) < height)) {
+		levels++;
+	}
+
+	*base = 0;
+	while(*base + 1 < levels && ((tile->width << (*base + 1)) <= width || (tile->height << (*base + 1)) <= height)) {
+		(*base)++;
+	}
+
+	return levels;
+}
+
+// Grows the array to hold frames of the given size. Layers are unpacked
+// again afterwards, the frame textures of the inputs still hold their
+// last frame.
+static void resize_layers(GXComposite* self, GLsizei width, GLsizei height)
+{
+	GLint levels = 1;
+	while((width >> levels) > 0 || (height >> levels) > 0) {
+		levels++;
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, self->layers);
+	for(GLint l = 0; l < levels; l++) {
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_RGBA16F, level_size(width, l), level_size(height, l), self->count, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	GL_ERROR();
+
+	self->width = width;
+	self->height = height;
+	self->levels = levels;
+
+	GXCompositeInvalidate(self);
+}
+
+static void attach_level(GXComposite* self, unsigned int layer, GLint level)
+{
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, self->layers, level, layer);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Composite framebuffer is incomplete\n");
+	}
+}
+
+// Box filter reductions only ever write the part of a level covering the
+// frame, so a layer is cleared once when its frame size changes to keep the
+// texels along the edge of smaller frames black.
+static void clear_layer(GXComposite* self, unsigned int layer)
+{
+	static const GLfloat black[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+	for(GLint l = 0; l < self->levels; l++) {
+		attach_level(self, layer, l);
+		glViewport(0, 0, level_size(self->width, l), level_size(self->height, l));
+		glClearBufferfv(GL_COLOR, 0, black);
+	}
+}
+
+static void reduce_layer(GXComposite* self, unsigned int layer, GLint first, GLint last)
+{
+	glUseProgram(self->reduce_shader);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, self->layers);
+	glUniform1i(self->reduce_shader_tex, 0);
+	glUniform1i(self->reduce_shader_field, 1);
+	glUniform1i(self->reduce_shader_layer, layer);
+	glUniform1i(self->reduce_shader_scale, 0);
+	glBindVertexArray(self->quad_vao);
+
+	for(GLint l = first; l <= last; l++) {
+		// reading the level above while rendering into this one is only
+		// defined when this one is outside the sampled level range
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, l - 1);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, l - 1);
+
+		attach_level(self, layer, l);
+		glViewport(0, 0, level_extent(self->layer_width[layer], self->width, l), level_extent(self->layer_height[layer], self->height, l));
+		glDrawArrays(GL_TRIANGLES, 0, QUAD_VTX_CNT);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, self->levels - 1);
+}
+
+// Averages blocks of scale x scale pixels of a deinterlaced field into the
+// attached level, like GXUnpackDraw does with the packed frame. The array
+// is unbound meanwhile: the level written is within its sampled range, and
+// a bound feedback loop is undefined even if the shader never reads it.
+static void reduce_field(GXComposite* self, GLuint field, unsigned int scale)
+{
+	glUseProgram(self->reduce_shader);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, field);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glUniform1i(self->reduce_shader_tex, 0);
+	glUniform1i(self->reduce_shader_field, 1);
+	glUniform1i(self->reduce_shader_scale, scale);
+	glBindVertexArray(self->quad_vao);
+	glDrawArrays(GL_TRIANGLES, 0, QUAD_VTX_CNT);
+}
+
+// Unpacks a newly uploaded frame of an input into its layer and reduces it
+// down to the levels its tile needs. Levels finer than the tile samples are
+// skipped: the frame is unpacked straight into the first level it needs,
+// averaging blocks of frame pixels, so the RGBA16F writes follow the tile
+// size rather than the frame size. Inputs showing a deinterlaced field are
+// reduced from that field instead, so the tiles of interlaced inputs are not
+// combed. Without a new frame this only adds levels when the tile got
+// smaller.
+void GXCompositeUnpack(GXComposite* self, unsigned int layer, GXRenderer* input, const GXTile* tile)
+{
+	if(layer >= (unsigned int) self->count || !input->frame_width || !input->frame_height || tile->width <= 0 || tile->height <= 0) {
+		return;
+	}
+
+	GLsizei frame_width = input->frame_width;
+	GLsizei frame_height = input->frame_height;
+
+	if(frame_width > self->width || frame_height > self->height) {
+		resize_layers(self, frame_width > self->width ? frame_width : self->width, frame_height > self->height ? frame_height : self->height);
+	}
+
+	GLint base;
+	GLint levels = levels_for(frame_width, frame_height, tile, self->levels, &base);
+	bool resized = self->layer_width[layer] != frame_width || self->layer_height[layer] != frame_height;
+	bool unpack = input->frame_count != self->layer_frame[layer] || resized || !self->layer_levels[layer] || base < self->layer_base[layer];
+
+	if(!unpack && levels <= self->layer_levels[layer]) {
+		return;
+	}
+
+	GLint framebuffer;
+	GLint viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean blend = glIsEnabled(GL_BLEND);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, self->fbo);
+	glDisable(GL_BLEND);
+
+	GLint first = self->layer_levels[layer];
+	if(unpack) {
+		if(resized) {
+			clear_layer(self, layer);
+			self->layer_width[layer] = frame_width;
+			self->layer_height[layer] = frame_height;
+		}
+
+		attach_level(self, layer, base);
+		glViewport(0, 0, level_extent(frame_width, self->width, base), level_extent(frame_height, self->height, base));
+		if(input->shown != input->unpacked) {
+			reduce_field(self, input->shown, 1 << base);
+		} else if(!GXUnpackDraw(input, 1 << base)) {
+			levels = 0;
+		}
+
+		self->layer_frame[layer] = input->frame_count;
+		self->layer_base[layer] = base;
+		first = base + 1;
+	}
+
+	if(levels > first) {
+		reduce_layer(self, layer, first, levels - 1);
+	}
+	self->layer_levels[layer] = levels;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	if(blend) {
+		glEnable(GL_BLEND);
+	}
+
+	GL_ERROR();
+}
+
+// Draws tile i from layer i for all count tiles with a single instanced
+// draw. Tiles of layers without a frame are collapsed to nothing.
+void GXCompositeDraw(GXComposite* self, const GXTile* tiles, unsigned int count, float brightness)
+{
+	if(!self->levels) {
+		// nothing unpacked yet
+		return;
+	}
+
+	if(count > (unsigned int) self->count) {
+		count = self->count;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	GLfloat tile[GX_MAX_INPUTS][4];
+	GLfloat source[GX_MAX_INPUTS][4];
+	GLint nearest[GX_MAX_INPUTS];
+	memset(tile, 0, sizeof(tile));
+	memset(source, 0, sizeof(source));
+	memset(nearest, 0, sizeof(nearest));
+
+	for(unsigned int i = 0; i < count; i++) {
+		if(!self->layer_levels[i]) {
+			continue;
+		}
+
+		tile[i][0] = 2.0f * tiles[i].x / viewport[2] - 1.0f;
+		tile[i][1] = 2.0f * tiles[i].y / viewport[3] - 1.0f;
+		tile[i][2] = 2.0f * tiles[i].width / viewport[2];
+		tile[i][3] = 2.0f * tiles[i].height / viewport[3];
+
+		source[i][0] = (GLfloat) self->layer_width[i] / self->width;
+		source[i][1] = (GLfloat) self->layer_height[i] / self->height;
+		source[i][2] = self->layer_base[i];
+		source[i][3] = self->layer_levels[i] - 1;
+
+		// unscaled tiles are copied texel by texel
+		nearest[i] = tiles[i].width == self->layer_width[i] && tiles[i].height == self->layer_height[i];
+	}
+
+	glUseProgram(self->tile_shader);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, self->layers);
+	glBindSampler(0, self->sampler);
+	glUniform1i(self->tile_shader_tex, 0);
+	glUniform4fv(self->tile_shader_tile, count, &tile[0][0]);
+	glUniform4fv(self->tile_shader_source, count, &source[0][0]);
+	glUniform1iv(self->tile_shader_nearest, count, nearest);
+	glUniform1f(self->tile_shader_brightness, brightness);
+
+	glBindVertexArray(self->quad_vao);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, QUAD_VTX_CNT, count);
+
+	glBindSampler(0, 0);
+	GL_ERROR();
+}
+
+// Forget the contents of all layers, e.g. when the inputs were replaced.
+// Each layer is unpacked again on its next GXCompositeUnpack.
+void GXCompositeInvalidate(GXComposite* self)
+{
+	for(unsigned int i = 0; i < GX_MAX_INPUTS; i++) {
+		self->layer_width[i] = 0;
+		self->layer_height[i] = 0;
+		self->layer_base[i] = 0;
+		self->layer_levels[i] = 0;
+		self->layer_frame[i] = 0;
+	}
+}
+
+// Shares the vertex buffers of the given renderer. The array itself is
+// allocated with the first frame.
+void GXCompositeInit(GXComposite* self, const GXRenderer* share, unsigned int count)
+{
+	self->quad_vao = share->quad_vao;
+	self->count = count;
+	self->width = 0;
+	self->height = 0;
+	self->levels = 0;
+	GXCompositeInvalidate(self);
+
+	glGenTextures(1, &self->layers);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, self->layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffers(1, &self->fbo);
+
+	glGenSamplers(1, &self->sampler);
+	glSamplerParameteri(self->sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glSamplerParameteri(self->sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(self->sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(self->sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	self->reduce_shader = GXCreateShader(reduce_vert, reduce_frag);
+	self->reduce_shader_tex = glGetUniformLocation(self->reduce_shader, "frame");
+	self->reduce_shader_layer = glGetUniformLocation(self->reduce_shader, "layer");
+	self->reduce_shader_field = glGetUniformLocation(self->reduce_shader, "field");
+	self->reduce_shader_scale = glGetUniformLocation(self->reduce_shader, "scale");
+
+	self->tile_shader = GXCreateShader(composite_vert, composite_frag);
+	self->tile_shader_tex = glGetUniformLocation(self->tile_shader, "frame");
+	self->tile_shader_tile = glGetUniformLocation(self->tile_shader, "tile");
+	self->tile_shader_source = glGetUniformLocation(self->tile_shader, "source");
+	self->tile_shader_nearest = glGetUniformLocation(self->tile_shader, "nearest");
+	self->tile_shader_brightness = glGetUniformLocation(self->tile_shader, "brightness");
+}
+
+void GXCompositeDestroy(GXComposite* self)
+{
+	glDeleteProgram(self->reduce_shader);
+	glDeleteProgram(self->tile_shader);
+	glDeleteSamplers(1, &self->sampler);
+	glDeleteFramebuffers(1, &self->fbo);
+	glDeleteTextures(1, &self->layers);
+}
@@ -0,0 +1,559 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define	CX_X86
+#endif
+
+#include "deckview.h"
+
+// CPU conversion of captured frames to RGB for snapshots, export and
+// software GL, using the Rec.709 math of the unpack shaders. Each row is
+// handled in runs of CHUNK pixels in two stages: spread the packed samples
+// into planar 16 bit Y/Cb/Cr (one Cb/Cr per pixel), then convert the planes
+// to the output format. Both stages have a scalar reference and SSE4.1 and
+// AVX2 versions, selected at runtime.
+
+#define	CHUNK		192	// pixels per run, a multiple of 6 (v210) and 16 (AVX2)
+#define	CHUNK_PAD	16	// SIMD spreads write whole vectors past the run
+#define	MAX_THREADS	32
+
+#define	KR	1.5748f
+#define	KGB	0.1873f
+#define	KGR	0.4681f
+#define	KB	1.8556f
+
+typedef enum {
+	INPUT_UYVY,
+	INPUT_V210,
+	INPUT_CNT
+} Input;
+
+typedef enum {
+	OUTPUT_RGBA8,
+	OUTPUT_RGBA16,
+	OUTPUT_RGB10,
+	OUTPUT_CNT
+} Output;
+
+// Video levels of the input and code range of the output
+typedef struct {
+	float	y_off;
+	float	y_scale;
+	float	c_off;
+	float	c_scale;
+	int	max;
+} Levels;
+
+typedef void (*SpreadFunc)(const uint8_t* src, unsigned int x, unsigned int n, int16_t* y, int16_t* cb, int16_t* cr);
+typedef void (*StoreFunc)(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, unsigned int n, uint8_t* dst);
+
+typedef struct {
+	const char*	name;
+	Input	input;
+	Output	output;
+	Levels	levels;
+	unsigned int	pixel_bytes;
+} Kernel;
+
+static const Kernel kernels[CX_KERNEL_CNT] = {
+	{ "uyvy_rgba8",  INPUT_UYVY, OUTPUT_RGBA8,  { 16.0f, 255.0f / 219.0f, 128.0f, 255.0f / 224.0f, 255 }, 4 },
+	{ "v210_rgba16", INPUT_V210, OUTPUT_RGBA16, { 64.0f, 65535.0f / 876.0f, 512.0f, 65535.0f / 896.0f, 65535 }, 8 },
+	{ "v210_rgb10",  INPUT_V210, OUTPUT_RGB10,  { 64.0f, 1023.0f / 876.0f, 512.0f, 1023.0f / 896.0f, 1023 }, 4 }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar reference
+
+static void spread_uyvy_scalar(const uint8_t* src, unsigned int x, unsigned int n, int16_t* y, int16_t* cb, int16_t* cr)
+{
+	for(unsigned int i = 0; i < n; i++) {
+		const uint8_t* m = src + ((x + i) / 2) * 4;
+		y[i] = m[1 + ((x + i) % 2) * 2];
+		cb[i] = m[0];
+		cr[i] = m[2];
+	}
+}
+
+// v210 packs 6 pixels into 4 little endian words:
+// w0: Cb0 Y0 Cr0, w1: Y1 Cb2 Y2, w2: Cr2 Y3 Cb4, w3: Y4 Cr4 Y5
+// Rows are padded to 48 pixels, so whole groups can always be read. x is a
+// multiple of 6 and the last group may write up to 5 pixels past n.
+static void spread_v210_scalar(const uint8_t* src, unsigned int x, unsigned int n, int16_t* y, int16_t* cb, int16_t* cr)
+{
+	const uint32_t* w = (const uint32_t*) (src + (x / 6) * 16);
+
+	for(unsigned int i = 0; i < n; i += 6, w += 4) {
+		y[i + 0] = (w[0] >> 10) & 0x3ff;
+		y[i + 1] = w[1] & 0x3ff;
+		y[i + 2] = (w[1] >> 20) & 0x3ff;
+		y[i + 3] = (w[2] >> 10) & 0x3ff;
+		y[i + 4] = w[3] & 0x3ff;
+		y[i + 5] = (w[3] >> 20) & 0x3ff;
+
+		cb[i + 0] = cb[i + 1] = w[0] & 0x3ff;
+		cb[i + 2] = cb[i + 3] = (w[1] >> 10) & 0x3ff;
+		cb[i + 4] = cb[i + 5] = (w[2] >> 20) & 0x3ff;
+
+		cr[i + 0] = cr[i + 1] = (w[0] >> 20) & 0x3ff;
+		cr[i + 2] = cr[i + 3] = w[2] & 0x3ff;
+		cr[i + 4] = cr[i + 5] = (w[3] >> 10) & 0x3ff;
+	}
+}
+
+static inline int clamp_code(float v, int max)
+{
+	int c = lrintf(v);
+	return c < 0 ? 0 : c > max ? max : c;
+}
+
+// Same operation order as the SIMD versions, so results match exactly
+static inline void rgb_scalar(const Levels* l, int16_t Y, int16_t Cb, int16_t Cr, int* r, int* g, int* b)
+{
+	float yf = ((float) Y - l->y_off) * l->y_scale;
+	float cbf = ((float) Cb - l->c_off) * l->c_scale;
+	float crf = ((float) Cr - l->c_off) * l->c_scale;
+
+	*r = clamp_code(yf + KR * crf, l->max);
+	*g = clamp_code(yf - KGB * cbf - KGR * crf, l->max);
+	*b = clamp_code(yf + KB * cbf, l->max);
+}
+
+static void store_rgba8_scalar(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, unsigned int n, uint8_t* dst)
+{
+	for(unsigned int i = 0; i < n; i++) {
+		int r, g, b;
+		rgb_scalar(l, y[i], cb[i], cr[i], &r, &g, &b);
+		*dst++ = r;
+		*dst++ = g;
+		*dst++ = b;
+		*dst++ = 255;
+	}
+}
+
+static void store_rgba16_scalar(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, unsigned int n, uint8_t* dst)
+{
+	uint16_t* p = (uint16_t*) dst;
+	for(unsigned int i = 0; i < n; i++) {
+		int r, g, b;
+		rgb_scalar(l, y[i], cb[i], cr[i], &r, &g, &b);
+		*p++ = r;
+		*p++ = g;
+		*p++ = b;
+		*p++ = 65535;
+	}
+}
+
+static void store_rgb10_scalar(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, unsigned int n, uint8_t* dst)
+{
+	uint32_t* p = (uint32_t*) dst;
+	for(unsigned int i = 0; i < n; i++) {
+		int r, g, b;
+		rgb_scalar(l, y[i], cb[i], cr[i], &r, &g, &b);
+		*p++ = r | (g << 10) | (b << 20) | (3u << 30);
+	}
+}
+
+#ifdef CX_X86
+////////////////////////////////////////////////////////////////////////////////
+// SSE4.1
+
+// pshufb mask moving 16 bit lanes, -1 clears the lane
+static inline __m128i lanes16(int a, int b, int c, int d, int e, int f, int g, int h)
+{
+#define	LO(l)	(char) ((l) < 0 ? -128 : (l) * 2)
+#define	HI(l)	(char) ((l) < 0 ? -128 : (l) * 2 + 1)
+	return _mm_setr_epi8(LO(a), HI(a), LO(b), HI(b), LO(c), HI(c), LO(d), HI(d),
+		LO(e), HI(e), LO(f), HI(f), LO(g), HI(g), LO(h), HI(h));
+#undef	LO
+#undef	HI
+}
+
+__attribute__((target("sse4.1")))
+static void spread_uyvy_sse41(const uint8_t* src, unsigned int x, unsigned int n, int16_t* y, int16_t* cb, int16_t* cr)
+{
+	const __m128i y_mask = _mm_setr_epi8(1, -128, 3, -128, 5, -128, 7, -128, 9, -128, 11, -128, 13, -128, 15, -128);
+	const __m128i cb_mask = _mm_setr_epi8(0, -128, 0, -128, 4, -128, 4, -128, 8, -128, 8, -128, 12, -128, 12, -128);
+	const __m128i cr_mask = _mm_setr_epi8(2, -128, 2, -128, 6, -128, 6, -128, 10, -128, 10, -128, 14, -128, 14, -128);
+
+	const uint8_t* s = src + x * 2;
+	unsigned int i = 0;
+
+	// 8 pixels per iteration, never reading past the end of the row
+	for(; i + 8 <= n; i += 8, s += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*) s);
+		_mm_storeu_si128((__m128i*) (y + i), _mm_shuffle_epi8(v, y_mask));
+		_mm_storeu_si128((__m128i*) (cb + i), _mm_shuffle_epi8(v, cb_mask));
+		_mm_storeu_si128((__m128i*) (cr + i), _mm_shuffle_epi8(v, cr_mask));
+	}
+
+	spread_uyvy_scalar(src, x + i, n - i, y + i, cb + i, cr + i);
+}
+
+__attribute__((target("sse4.1")))
+static void spread_v210_sse41(const uint8_t* src, unsigned int x, unsigned int n, int16_t* y, int16_t* cb, int16_t* cr)
+{
+	const __m128i mask = _mm_set1_epi32(0x3ff);
+
+	// t0 = [f0.0 f0.1 f0.2 f0.3 f1.0 f1.1 f1.2 f1.3], t1 = [f2.0 .. f2.3 ..]
+	// with fN.k the Nth 10 bit field of word k
+	const __m128i y_t0 = lanes16(4, 1, -1, 6, 3, -1, -1, -1);
+	const __m128i y_t1 = lanes16(-1, -1, 1, -1, -1, 3, -1, -1);
+	const __m128i cb_t0 = lanes16(0, 0, 5, 5, -1, -1, -1, -1);
+	const __m128i cb_t1 = lanes16(-1, -1, -1, -1, 2, 2, -1, -1);
+	const __m128i cr_t0 = lanes16(-1, -1, 2, 2, 7, 7, -1, -1);
+	const __m128i cr_t1 = lanes16(0, 0, -1, -1, -1, -1, -1, -1);
+
+	const uint8_t* s = src + (x / 6) * 16;
+
+	// 6 pixels per group; the 8 lane stores overlap the next group
+	for(unsigned int i = 0; i < n; i += 6, s += 16) {
+		__m128i w = _mm_loadu_si128((const __m128i*) s);
+		__m128i f0 = _mm_and_si128(w, mask);
+		__m128i f1 = _mm_and_si128(_mm_srli_epi32(w, 10), mask);
+		__m128i f2 = _mm_and_si128(_mm_srli_epi32(w, 20), mask);
+
+		__m128i t0 = _mm_packus_epi32(f0, f1);
+		__m128i t1 = _mm_packus_epi32(f2, f2);
+
+		_mm_storeu_si128((__m128i*) (y + i), _mm_or_si128(_mm_shuffle_epi8(t0, y_t0), _mm_shuffle_epi8(t1, y_t1)));
+		_mm_storeu_si128((__m128i*) (cb + i), _mm_or_si128(_mm_shuffle_epi8(t0, cb_t0), _mm_shuffle_epi8(t1, cb_t1)));
+		_mm_storeu_si128((__m128i*) (cr + i), _mm_or_si128(_mm_shuffle_epi8(t0, cr_t0), _mm_shuffle_epi8(t1, cr_t1)));
+	}
+}
+
+// Converts 4 pixels to clamped integer codes
+__attribute__((target("sse4.1")))
+static inline void rgb_sse41(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, __m128i* r, __m128i* g, __m128i* b)
+{
+	__m128 Y = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*) y)));
+	__m128 Cb = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*) cb)));
+	__m128 Cr = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*) cr)));
+
+	__m128 yf = _mm_mul_ps(_mm_sub_ps(Y, _mm_set1_ps(l->y_off)), _mm_set1_ps(l->y_scale));
+	__m128 cbf = _mm_mul_ps(_mm_sub_ps(Cb, _mm_set1_ps(l->c_off)), _mm_set1_ps(l->c_scale));
+	__m128 crf = _mm_mul_ps(_mm_sub_ps(Cr, _mm_set1_ps(l->c_off)), _mm_set1_ps(l->c_scale));
+
+	__m128 R = _mm_add_ps(yf, _mm_mul_ps(_mm_set1_ps(KR), crf));
+	__m128 G = _mm_sub_ps(_mm_sub_ps(yf, _mm_mul_ps(_mm_set1_ps(KGB), cbf)), _mm_mul_ps(_mm_set1_ps(KGR), crf));
+	__m128 B = _mm_add_ps(yf, _mm_mul_ps(_mm_set1_ps(KB), cbf));
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi32(l->max);
+	*r = _mm_min_epi32(_mm_max_epi32(_mm_cvtps_epi32(R), zero), max);
+	*g = _mm_min_epi32(_mm_max_epi32(_mm_cvtps_epi32(G), zero), max);
+	*b = _mm_min_epi32(_mm_max_epi32(_mm_cvtps_epi32(B), zero), max);
+}
+
+__attribute__((target("sse4.1")))
+static void store_rgba8_sse41(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, unsigned int n, uint8_t* dst)
+{
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+	unsigned int i = 0;
+	for(; i + 4 <= n; i += 4, dst += 16) {
+		__m128i r, g, b;
+		rgb_sse41(l, y + i, cb + i, cr + i, &r, &g, &b);
+		__m128i px = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), alpha));
+		_mm_storeu_si128((__m128i*) dst, px);
+	}
+
+	store_rgba8_scalar(l, y + i, cb + i, cr + i, n - i, dst);
+}
+
+__attribute__((target("sse4.1")))
+static void store_rgba16_sse41(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, unsigned int n, uint8_t* dst)
+{
+	const __m128i alpha = _mm_set1_epi32(0xffff0000);
+
+	unsigned int i = 0;
+	for(; i + 4 <= n; i += 4, dst += 32) {
+		__m128i r, g, b;
+		rgb_sse41(l, y + i, cb + i, cr + i, &r, &g, &b);
+		__m128i rg = _mm_or_si128(r, _mm_slli_epi32(g, 16));
+		__m128i ba = _mm_or_si128(b, alpha);
+		_mm_storeu_si128((__m128i*) dst, _mm_unpacklo_epi32(rg, ba));
+		_mm_storeu_si128((__m128i*) (dst + 16), _mm_unpackhi_epi32(rg, ba));
+	}
+
+	store_rgba16_scalar(l, y + i, cb + i, cr + i, n - i, dst);
+}
+
+__attribute__((target("sse4.1")))
+static void store_rgb10_sse41(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, unsigned int n, uint8_t* dst)
+{
+	const __m128i alpha = _mm_set1_epi32(0xc0000000);
+
+	unsigned int i = 0;
+	for(; i + 4 <= n; i += 4, dst += 16) {
+		__m128i r, g, b;
+		rgb_sse41(l, y + i, cb + i, cr + i, &r, &g, &b);
+		__m128i px = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 10)), _mm_or_si128(_mm_slli_epi32(b, 20), alpha));
+		_mm_storeu_si128((__m128i*) dst, px);
+	}
+
+	store_rgb10_scalar(l, y + i, cb + i, cr + i, n - i, dst);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX2. The spreads are shuffle bound and vpshufb only shuffles within
+// 128 bit lanes, so they stay SSE4.1; the conversion runs 8 pixels wide.
+
+// Converts 8 pixels to clamped integer codes
+__attribute__((target("avx2")))
+static inline void rgb_avx2(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, __m256i* r, __m256i* g, __m256i* b)
+{
+	__m256 Y = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) y)));
+	__m256 Cb = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) cb)));
+	__m256 Cr = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) cr)));
+
+	__m256 yf = _mm256_mul_ps(_mm256_sub_ps(Y, _mm256_set1_ps(l->y_off)), _mm256_set1_ps(l->y_scale));
+	__m256 cbf = _mm256_mul_ps(_mm256_sub_ps(Cb, _mm256_set1_ps(l->c_off)), _mm256_set1_ps(l->c_scale));
+	__m256 crf = _mm256_mul_ps(_mm256_sub_ps(Cr, _mm256_set1_ps(l->c_off)), _mm256_set1_ps(l->c_scale));
+
+	__m256 R = _mm256_add_ps(yf, _mm256_mul_ps(_mm256_set1_ps(KR), crf));
+	__m256 G = _mm256_sub_ps(_mm256_sub_ps(yf, _mm256_mul_ps(_mm256_set1_ps(KGB), cbf)), _mm256_mul_ps(_mm256_set1_ps(KGR), crf));
+	__m256 B = _mm256_add_ps(yf, _mm256_mul_ps(_mm256_set1_ps(KB), cbf));
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi32(l->max);
+	*r = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvtps_epi32(R), zero), max);
+	*g = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvtps_epi32(G), zero), max);
+	*b = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvtps_epi32(B), zero), max);
+}
+
+__attribute__((target("avx2")))
+static void store_rgba8_avx2(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, unsigned int n, uint8_t* dst)
+{
+	const __m256i alpha = _mm256_set1_epi32(0xff000000);
+
+	unsigned int i = 0;
+	for(; i + 8 <= n; i += 8, dst += 32) {
+		__m256i r, g, b;
+		rgb_avx2(l, y + i, cb + i, cr + i, &r, &g, &b);
+		__m256i px = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(b, 16), alpha));
+		_mm256_storeu_si256((__m256i*) dst, px);
+	}
+
+	store_rgba8_scalar(l, y + i, cb + i, cr + i, n - i, dst);
+}
+
+__attribute__((target("avx2")))
+static void store_rgba16_avx2(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, unsigned int n, uint8_t* dst)
+{
+	const __m256i alpha = _mm256_set1_epi32(0xffff0000);
+
+	unsigned int i = 0;
+	for(; i + 8 <= n; i += 8, dst += 64) {
+		__m256i r, g, b;
+		rgb_avx2(l, y + i, cb + i, cr + i, &r, &g, &b);
+		__m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(g, 16));
+		__m256i ba = _mm256_or_si256(b, alpha);
+
+		// unpack works per 128 bit lane: lo = p0 p1 | p4 p5, hi = p2 p3 | p6 p7
+		__m256i lo = _mm256_unpacklo_epi32(rg, ba);
+		__m256i hi = _mm256_unpackhi_epi32(rg, ba);
+		_mm256_storeu_si256((__m256i*) dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i*) (dst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	store_rgba16_scalar(l, y + i, cb + i, cr + i, n - i, dst);
+}
+
+__attribute__((target("avx2")))
+static void store_rgb10_avx2(const Levels* l, const int16_t* y, const int16_t* cb, const int16_t* cr, unsigned int n, uint8_t* dst)
+{
+	const __m256i alpha = _mm256_set1_epi32(0xc0000000);
+
+	unsigned int i = 0;
+	for(; i + 8 <= n; i += 8, dst += 32) {
+		__m256i r, g, b;
+		rgb_avx2(l, y + i, cb + i, cr + i, &r, &g, &b);
+		__m256i px = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 10)), _mm256_or_si256(_mm256_slli_epi32(b, 20), alpha));
+		_mm256_storeu_si256((__m256i*) dst, px);
+	}
+
+	store_rgb10_scalar(l, y + i, cb + i, cr + i, n - i, dst);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+#ifdef CX_X86
+static const SpreadFunc spreads[INPUT_CNT][CX_ISA_CNT] = {
+	{ spread_uyvy_scalar, spread_uyvy_sse41, spread_uyvy_sse41 },
+	{ spread_v210_scalar, spread_v210_sse41, spread_v210_sse41 }
+};
+
+static const StoreFunc stores[OUTPUT_CNT][CX_ISA_CNT] = {
+	{ store_rgba8_scalar, store_rgba8_sse41, store_rgba8_avx2 },
+	{ store_rgba16_scalar, store_rgba16_sse41, store_rgba16_avx2 },
+	{ store_rgb10_scalar, store_rgb10_sse41, store_rgb10_avx2 }
+};
+#else
+static const SpreadFunc spreads[INPUT_CNT][CX_ISA_CNT] = {
+	{ spread_uyvy_scalar, spread_uyvy_scalar, spread_uyvy_scalar },
+	{ spread_v210_scalar, spread_v210_scalar, spread_v210_scalar }
+};
+
+static const StoreFunc stores[OUTPUT_CNT][CX_ISA_CNT] = {
+	{ store_rgba8_scalar, store_rgba8_scalar, store_rgba8_scalar },
+	{ store_rgba16_scalar, store_rgba16_scalar, store_rgba16_scalar },
+	{ store_rgb10_scalar, store_rgb10_scalar, store_rgb10_scalar }
+};
+#endif
+
+bool CXIsaSupported(CXIsa isa)
+{
+	switch(isa) {
+		case CX_ISA_SCALAR:
+			return true;
+#ifdef CX_X86
+		case CX_ISA_SSE41:
+			return __builtin_cpu_supports("sse4.1");
+		case CX_ISA_AVX2:
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+	}
+}
+
+CXIsa CXDetectIsa(void)
+{
+	static int isa = -1;
+
+	if(isa < 0) {
+		isa = CX_ISA_SCALAR;
+		for(int i = CX_ISA_CNT - 1; i > CX_ISA_SCALAR; i--) {
+			if(CXIsaSupported((CXIsa) i)) {
+				isa = i;
+				break;
+			}
+		}
+	}
+
+	return (CXIsa) isa;
+}
+
+const char* CXIsaName(CXIsa isa)
+{
+	switch(isa) {
+		case CX_ISA_SCALAR:
+			return "scalar";
+		case CX_ISA_SSE41:
+			return "sse4.1";
+		case CX_ISA_AVX2:
+			return "avx2";
+		default:
+			return "unknown";
+	}
+}
+
+const char* CXKernelName(CXKernel kernel)
+{
+	return kernel < CX_KERNEL_CNT ? kernels[kernel].name : "unknown";
+}
+
+size_t CXOutputRowBytes(CXKernel kernel, unsigned int width)
+{
+	return kernel < CX_KERNEL_CNT ? (size_t) width * kernels[kernel].pixel_bytes : 0;
+}
+
+typedef struct {
+	const Kernel*	kernel;
+	SpreadFunc	spread;
+	StoreFunc	store;
+	const uint8_t*	src;
+	size_t	src_stride;
+	uint8_t*	dst;
+	size_t	dst_stride;
+	unsigned int	width;
+	unsigned int	y0;
+	unsigned int	y1;
+} Slice;
+
+static void convert_slice(const Slice* s)
+{
+	int16_t y[CHUNK + CHUNK_PAD] __attribute__((aligned(32)));
+	int16_t cb[CHUNK + CHUNK_PAD] __attribute__((aligned(32)));
+	int16_t cr[CHUNK + CHUNK_PAD] __attribute__((aligned(32)));
+
+	for(unsigned int row = s->y0; row < s->y1; row++) {
+		const uint8_t* src = s->src + row * s->src_stride;
+		uint8_t* dst = s->dst + row * s->dst_stride;
+
+		for(unsigned int x = 0; x < s->width; x += CHUNK) {
+			unsigned int n = s->width - x < CHUNK ? s->width - x : CHUNK;
+			s->spread(src, x, n, y, cb, cr);
+			s->store(&s->kernel->levels, y, cb, cr, n, dst + x * s->kernel->pixel_bytes);
+		}
+	}
+}
+
+static void* slice_main(void* arg)
+{
+	convert_slice((const Slice*) arg);
+	return NULL;
+}
+
+// Rows are split into one slice per thread. The calling thread converts the
+// first slice, so threads = 1 runs without creating any.
+void CXConvert(CXKernel kernel, CXIsa isa, const void* src, size_t src_stride, void* dst, size_t dst_stride, unsigned int width, unsigned int height, unsigned int threads)
+{
+	if(kernel >= CX_KERNEL_CNT || !CXIsaSupported(isa)) {
+		return;
+	}
+
+	if(threads > MAX_THREADS) {
+		threads = MAX_THREADS;
+	}
+
+	if(threads > height) {
+		threads = height;
+	}
+
+	if(threads < 1) {
+		threads = 1;
+	}
+
+	const Kernel* k = &kernels[kernel];
+
+	Slice slices[MAX_THREADS];
+	pthread_t tids[MAX_THREADS];
+
+	for(unsigned int i = 0; i < threads; i++) {
+		Slice* s = &slices[i];
+		s->kernel = k;
+		s->spread = spreads[k->input][isa];
+		s->store = stores[k->output][isa];
+		s->src = (const uint8_t*) src;
+		s->src_stride = src_stride;
+		s->dst = (uint8_t*) dst;
+		s->dst_stride = dst_stride;
+		s->width = width;
+		s->y0 = (uint64_t) height * i / threads;
+		s->y1 = (uint64_t) height * (i + 1) / threads;
+	}
+
+	unsigned int started = 1;
+	for(unsigned int i = 1; i < threads; i++, started++) {
+		if(pthread_create(&tids[i], NULL, slice_main, &slices[i])) {
+			// convert the remaining slices on this thread
+			for(unsigned int j = i; j < threads; j++) {
+				convert_slice(&slices[j]);
+			}
+			break;
+		}
+	}
+
+	convert_slice(&slices[0]);
+
+	for(unsigned int i = 1; i < started; i++) {
+		pthread_join(tids[i], NULL);
+	}
+}
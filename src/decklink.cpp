@@ -0,0 +1,182 @@
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <DeckLinkAPI.h>
+
+#include "deckview.h"
+
+static const BMDVideoInputFlags input_flags = bmdVideoInputFlagDefault | bmdVideoInputEnableFormatDetection;
+
+class DeckLinkSource : public CaptureSource
+{
+	public:
+		DeckLinkSource(IDeckLink* device);
+		virtual ~DeckLinkSource();
+
+		virtual bool	Init(IDeckLinkInputCallback* callback, BMDPixelFormat fmt);
+		virtual bool	Start(BMDPixelFormat fmt, unsigned int sample_depth, unsigned int channels);
+		virtual bool	SetVideoMode(IDeckLinkDisplayMode* mode, BMDPixelFormat fmt);
+		virtual IDeckLinkDisplayMode*	StartMode(void);
+		virtual void	Stop(void);
+		virtual int64_t	ReferenceTime(void);
+
+	private:
+		IDeckLink*	device;
+		IDeckLinkInput*	input;
+		IDeckLinkProfileAttributes*	attributes;
+		IDeckLinkDisplayMode*	display_mode;
+};
+
+DeckLinkSource::DeckLinkSource(IDeckLink* dev) : device(dev), input(NULL), attributes(NULL), display_mode(NULL)
+{
+	device->AddRef();
+}
+
+DeckLinkSource::~DeckLinkSource()
+{
+	if(display_mode) {
+		display_mode->Release();
+	}
+
+	if(input) {
+		input->SetCallback(NULL);
+		input->Release();
+	}
+
+	if(attributes) {
+		attributes->Release();
+	}
+
+	device->Release();
+}
+
+bool DeckLinkSource::Init(IDeckLinkInputCallback* callback, BMDPixelFormat fmt)
+{
+	int64_t duplex_mode;
+	bool format_detection_supported;
+	bool supported;
+
+	if(device->QueryInterface(IID_IDeckLinkProfileAttributes, (void**)&attributes) != S_OK) {
+		fprintf(stderr, "Unable to get DeckLink attributes interface\n");
+		return false;
+	}
+
+	// Check the DeckLink device is active
+	if(attributes->GetInt(BMDDeckLinkDuplex, &duplex_mode) != S_OK) {
+		fprintf(stderr, "The selected DeckLink device is inactive\n");
+		return false;
+	}
+
+	if(duplex_mode == bmdDuplexInactive) {
+		fprintf(stderr, "The selected DeckLink device is inactive\n");
+		return false;
+	}
+
+	// Get the input (capture) interface of the DeckLink device
+	if(device->QueryInterface(IID_IDeckLinkInput, (void**) &input) != S_OK) {
+		fprintf(stderr, "The selected device does not have an input interface\n");
+		return false;
+	}
+
+	// Check the card supports format detection
+	if(attributes->GetFlag(BMDDeckLinkSupportsInputFormatDetection, &format_detection_supported) != S_OK) {
+		fprintf(stderr, "Format detection is not supported on this device\n");
+		return false;
+	}
+
+	if(!format_detection_supported) {
+		fprintf(stderr, "Format detection is not supported on this device\n");
+		return false;
+	}
+
+	// For format detection mode, use 1080p30 as default mode to start with
+	if(input->GetDisplayMode(bmdModeHD1080p30, &display_mode) != S_OK) {
+		fprintf(stderr, "Unable to get display mode\n");
+		return false;
+	}
+
+	if(display_mode == NULL) {
+		fprintf(stderr, "Unable to get display mode\n");
+		return false;
+	}
+
+	// Check display mode is supported with given options
+	if(input->DoesSupportVideoMode(bmdVideoConnectionUnspecified, display_mode->GetDisplayMode(), fmt, bmdNoVideoInputConversion, bmdSupportedVideoModeDefault, NULL, &supported) != S_OK) {
+		fprintf(stderr, "The display mode is not supported with the selected pixel format\n");
+		return false;
+	}
+
+	if(!supported) {
+		fprintf(stderr, "The display mode is not supported with the selected pixel format\n");
+		return false;
+	}
+
+	input->SetCallback(callback);
+
+	return true;
+}
+
+bool DeckLinkSource::Start(BMDPixelFormat fmt, unsigned int sample_depth, unsigned int channels)
+{
+	if(input->EnableVideoInput(display_mode->GetDisplayMode(), fmt, input_flags) != S_OK) {
+		fprintf(stderr, "Failed to enable video input. Is another application using the card?\n");
+		return false;
+	}
+
+	if(input->EnableAudioInput(bmdAudioSampleRate48kHz, sample_depth, channels) != S_OK) {
+		fprintf(stderr, "Failed to enable audio input. Is another application using the card?\n");
+		return false;
+	}
+
+	if(input->StartStreams() != S_OK) {
+		fprintf(stderr, "Failed to start streams\n");
+		return false;
+	}
+
+	return true;
+}
+
+bool DeckLinkSource::SetVideoMode(IDeckLinkDisplayMode* mode, BMDPixelFormat fmt)
+{
+	input->StopStreams();
+
+	if(input->EnableVideoInput(mode->GetDisplayMode(), fmt, input_flags) != S_OK) {
+		return false;
+	}
+
+	input->StartStreams();
+
+	return true;
+}
+
+IDeckLinkDisplayMode* DeckLinkSource::StartMode(void)
+{
+	return display_mode;
+}
+
+void DeckLinkSource::Stop(void)
+{
+	input->StopStreams();
+	input->DisableAudioInput();
+	input->DisableVideoInput();
+}
+
+int64_t DeckLinkSource::ReferenceTime(void)
+{
+	BMDTimeValue hw_time;
+	BMDTimeValue time_in_frame;
+	BMDTimeValue ticks_per_frame;
+
+	if(input->GetHardwareReferenceClock(1000000, &hw_time, &time_in_frame, &ticks_per_frame) == S_OK) {
+		return hw_time;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+CaptureSource* CreateDeckLinkSource(IDeckLink* device)
+{
+	return new DeckLinkSource(device);
+}
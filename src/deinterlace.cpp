@@ -0,0 +1,215 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "deckview.h"
+
+extern "C" {
+extern const char deinterlace_vert[];
+extern const char deinterlace_frag[];
+}
+
+// the quad of GXCreateBuffers
+#define	QUAD_VTX_CNT	6
+
+static const char* deinterlace_mode_names[GX_DEINTERLACE_CNT] = {
+	"weave",
+	"bob",
+	"adaptive"
+};
+
+const char* GXDeinterlaceModeName(GXDeinterlaceMode mode)
+{
+	return mode < GX_DEINTERLACE_CNT ? deinterlace_mode_names[mode] : "unknown";
+}
+
+static void create_texture(GLuint* texture)
+{
+	glGenTextures(1, texture);
+	glBindTexture(GL_TEXTURE_2D, *texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+}
+
+static void resize_output(GXDeinterlaceTarget* t, GLsizei width, GLsizei height)
+{
+	glBindTexture(GL_TEXTURE_2D, t->output);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, t->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t->output, 0);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Deinterlace framebuffer is incomplete\n");
+	}
+
+	t->output_width = width;
+	t->output_height = height;
+}
+
+// Shares the vertex buffers of the given renderer
+void GXDeinterlacerInit(GXDeinterlacer* self, const GXRenderer* share, GXDeinterlaceMode mode)
+{
+	memset(self, 0, sizeof(*self));
+	self->quad_vao = share->quad_vao;
+	self->mode = mode;
+
+	self->shader = GXCreateShader(deinterlace_vert, deinterlace_frag);
+	self->shader_tex = glGetUniformLocation(self->shader, "frame");
+	self->shader_previous = glGetUniformLocation(self->shader, "previous");
+	self->shader_mode = glGetUniformLocation(self->shader, "mode");
+	self->shader_parity = glGetUniformLocation(self->shader, "parity");
+	self->shader_first = glGetUniformLocation(self->shader, "first");
+	self->shader_last = glGetUniformLocation(self->shader, "last");
+
+	for(unsigned int i = 0; i < GX_MAX_INPUTS; i++) {
+		GXDeinterlaceTarget* t = &self->targets[i];
+		create_texture(&t->previous);
+		create_texture(&t->output);
+		glGenFramebuffers(1, &t->fbo);
+	}
+
+	glGenQueries(GX_DEINTERLACE_QUERYCNT * 2, &self->queries[0][0]);
+	GL_ERROR();
+}
+
+void GXDeinterlacerDestroy(GXDeinterlacer* self)
+{
+	for(unsigned int i = 0; i < GX_MAX_INPUTS; i++) {
+		GXDeinterlaceTarget* t = &self->targets[i];
+		glDeleteFramebuffers(1, &t->fbo);
+		glDeleteTextures(1, &t->previous);
+		glDeleteTextures(1, &t->output);
+	}
+
+	glDeleteQueries(GX_DEINTERLACE_QUERYCNT * 2, &self->queries[0][0]);
+	glDeleteProgram(self->shader);
+}
+
+void GXDeinterlacerSetMode(GXDeinterlacer* self, GXDeinterlaceMode mode)
+{
+	self->mode = mode;
+}
+
+// Timestamps like the scaler's, read back a few draws later without waiting
+static bool timer_begin(GXDeinterlacer* self, GXDeinterlaceMode mode)
+{
+	unsigned int idx = self->query_idx;
+	GLuint* q = self->queries[idx];
+
+	if(self->query_pending[idx]) {
+		GLint available = 0;
+		glGetQueryObjectiv(q[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available) {
+			return false;
+		}
+
+		GLuint64 begin;
+		GLuint64 end;
+		glGetQueryObjectui64v(q[0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(q[1], GL_QUERY_RESULT, &end);
+		self->time[self->query_mode[idx]] += end - begin;
+		self->count[self->query_mode[idx]]++;
+		self->query_pending[idx] = false;
+	}
+
+	glQueryCounter(q[0], GL_TIMESTAMP);
+	self->query_mode[idx] = mode;
+	return true;
+}
+
+static void timer_end(GXDeinterlacer* self)
+{
+	unsigned int idx = self->query_idx;
+	glQueryCounter(self->queries[idx][1], GL_TIMESTAMP);
+	self->query_pending[idx] = true;
+}
+
+// Unpacks the frame of input if it is new, keeping the one before it, and
+// draws the field of the given parity (0 for the even lines) into the
+// output of slot, which the display pass and the scaler then draw from.
+// first tells whether that field is the earlier one of the frame. Weave
+// draws nothing and leaves the unpacked frame to be shown.
+void GXDeinterlacerDraw(GXDeinterlacer* self, unsigned int slot, GXRenderer* input, unsigned int parity, bool first)
+{
+	GXDeinterlaceTarget* t = &self->targets[slot];
+
+	if(input->unpack_pending && input->unpacked_width) {
+		GXSwapUnpacked(input, &t->previous, &t->previous_width, &t->previous_height);
+		t->previous_count = t->unpacked_count;
+	}
+	if(input->unpack_pending) {
+		t->unpacked_count = input->frame_count;
+	}
+	GXUnpackFrame(input);
+
+	input->shown = input->unpacked;
+	if(!input->unpacked_width || self->mode == GX_DEINTERLACE_WEAVE) {
+		return;
+	}
+
+	GLsizei width = input->unpacked_width;
+	GLsizei height = input->unpacked_height;
+
+	// without the frame before this one, at the start or after a format
+	// change, there is nothing to tell the motion from
+	GXDeinterlaceMode mode = self->mode;
+	if(t->previous_count + 1 != t->unpacked_count || t->previous_width != width || t->previous_height != height) {
+		mode = GX_DEINTERLACE_BOB;
+	}
+
+	GLint framebuffer;
+	GLint viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean blend = glIsEnabled(GL_BLEND);
+
+	bool timed = timer_begin(self, mode);
+
+	if(t->output_width != width || t->output_height != height) {
+		resize_output(t, width, height);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, t->fbo);
+	glViewport(0, 0, width, height);
+	glDisable(GL_BLEND);
+
+	glUseProgram(self->shader);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, input->unpacked);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, t->previous);
+	glUniform1i(self->shader_tex, 0);
+	glUniform1i(self->shader_previous, 1);
+	glUniform1i(self->shader_mode, mode);
+	glUniform1i(self->shader_parity, parity);
+	glUniform1i(self->shader_first, first);
+	glUniform2i(self->shader_last, width - 1, height - 1);
+
+	glBindVertexArray(self->quad_vao);
+	glDrawArrays(GL_TRIANGLES, 0, QUAD_VTX_CNT);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	if(blend) {
+		glEnable(GL_BLEND);
+	}
+
+	if(timed) {
+		timer_end(self);
+	}
+	self->query_idx = (self->query_idx + 1) % GX_DEINTERLACE_QUERYCNT;
+
+	input->shown = t->output;
+	GL_ERROR();
+}
+
+void GXDeinterlacerGetStats(GXDeinterlacer* self, GXDeinterlaceMode mode, GXDeinterlaceStats* stats)
+{
+	stats->count = self->count[mode];
+	stats->gpu_ms = stats->count ? self->time[mode] / 1e6 / stats->count : 0;
+}
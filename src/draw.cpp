@@ -0,0 +1,628 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "deckview.h"
+
+extern "C" {
+extern const char colorimetry[];
+extern const char yuv8_vert[];
+extern const char yuv8_frag[];
+extern const char yuv10_vert[];
+extern const char yuv10_frag[];
+extern const char rgb10_vert[];
+extern const char rgb10_frag[];
+extern const char display_vert[];
+extern const char display_frag[];
+}
+
+static const float quad_vertices[] = {
+	-1.0f, -1.0f,  0.0f,
+	 1.0f, -1.0f,  0.0f,
+	 1.0f,  1.0f,  0.0f,
+
+	 1.0f,  1.0f,  0.0f,
+	-1.0f,  1.0f,  0.0f,
+	-1.0f, -1.0f,  0.0f
+};
+
+#define	QUAD_VTX_CNT	(sizeof(quad_vertices) / (sizeof(*quad_vertices) * 3))
+
+// The line of the unpack shaders replaced by the colorimetry functions
+#define	COLORIMETRY_INCLUDE	"#include \"colorimetry.glsli\""
+
+static const char* colorspace_names[GX_COLORSPACE_CNT] = {
+	"rec601",
+	"rec709",
+	"rec2020"
+};
+
+static const char* range_names[GX_RANGE_CNT] = {
+	"limited",
+	"full"
+};
+
+static const char* transfer_names[GX_TRANSFER_CNT] = {
+	"sdr",
+	"pq",
+	"hlg"
+};
+
+// what colorimetry.glsli is specialised with
+static const char* colorspace_defines[GX_COLORSPACE_CNT] = {
+	"#define COLORSPACE_REC601\n",
+	"#define COLORSPACE_REC709\n",
+	"#define COLORSPACE_REC2020\n"
+};
+
+static const char* range_defines[GX_RANGE_CNT] = {
+	"",
+	"#define RANGE_FULL\n"
+};
+
+static const char* transfer_defines[GX_TRANSFER_CNT] = {
+	"",
+	"#define TRANSFER_PQ\n",
+	"#define TRANSFER_HLG\n"
+};
+
+#ifndef NDEBUG
+void check_error(const char* filename, unsigned int line)
+{
+	GLenum error = glGetError();
+	switch(error) {
+		case GL_NO_ERROR:
+			break;
+		case GL_INVALID_ENUM:
+			printf("%s:%u: Error: GL_INVALID_ENUM\n", filename, line);
+			break;
+		case GL_INVALID_VALUE:
+			printf("%s:%u: Error: GL_INVALID_VALUE\n", filename, line);
+			break;
+		case GL_INVALID_OPERATION:
+			printf("%s:%u: Error: GL_INVALID_OPERATION\n", filename, line);
+			break;
+		case GL_INVALID_FRAMEBUFFER_OPERATION:
+			printf("%s:%u: Error: GL_INVALID_FRAMEBUFFER_OPERATION\n", filename, line);
+			break;
+		case GL_OUT_OF_MEMORY:
+			printf("%s:%u: Error: GL_OUT_OF_MEMORY\n", filename, line);
+			exit(1);
+			break;
+		case GL_STACK_UNDERFLOW:
+			printf("%s:%u: Error: GL_STACK_UNDERFLOW\n", filename, line);
+			break;
+		case GL_STACK_OVERFLOW:
+			printf("%s:%u: Error: GL_STACK_OVERFLOW\n", filename, line);
+			break;
+		default:
+			printf("%s:%u: Unknown error 0x%X\n", filename, line, error);
+	}
+}
+#endif
+
+bool GXExtensionSupported(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+	for(GLint i = 0; i < count; i++) {
+		const char* ext = (const char*) glGetStringi(GL_EXTENSIONS, i);
+		if(ext && !strcmp(ext, name)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* GXColorspaceName(GXColorspace colorspace)
+{
+	return colorspace < GX_COLORSPACE_CNT ? colorspace_names[colorspace] : "auto";
+}
+
+const char* GXRangeName(GXRange range)
+{
+	return range < GX_RANGE_CNT ? range_names[range] : "auto";
+}
+
+const char* GXTransferName(GXTransfer transfer)
+{
+	return transfer < GX_TRANSFER_CNT ? transfer_names[transfer] : "auto";
+}
+
+// Parses a comma separated list of names, e.g. "rec2020,pq". The fields not
+// named are left to the detection.
+bool GXColorimetryParse(const char* spec, GXColorimetry* colorimetry)
+{
+	colorimetry->colorspace = GX_COLORSPACE_CNT;
+	colorimetry->range = GX_RANGE_CNT;
+	colorimetry->transfer = GX_TRANSFER_CNT;
+
+	while(spec && *spec) {
+		size_t len = strcspn(spec, ",");
+		bool found = false;
+
+		for(unsigned int i = 0; i < GX_COLORSPACE_CNT; i++) {
+			if(strlen(colorspace_names[i]) == len && !strncmp(spec, colorspace_names[i], len)) {
+				colorimetry->colorspace = (GXColorspace) i;
+				found = true;
+			}
+		}
+		for(unsigned int i = 0; i < GX_RANGE_CNT; i++) {
+			if(strlen(range_names[i]) == len && !strncmp(spec, range_names[i], len)) {
+				colorimetry->range = (GXRange) i;
+				found = true;
+			}
+		}
+		for(unsigned int i = 0; i < GX_TRANSFER_CNT; i++) {
+			if(strlen(transfer_names[i]) == len && !strncmp(spec, transfer_names[i], len)) {
+				colorimetry->transfer = (GXTransfer) i;
+				found = true;
+			}
+		}
+
+		if(!found) {
+			printf("Unknown colorimetry: %.*s\n", (int) len, spec);
+			return false;
+		}
+
+		spec += len;
+		if(*spec == ',') {
+			spec++;
+		}
+	}
+
+	return true;
+}
+
+// The version line of the unpack shader, the defines of the variant, the
+// colorimetry functions in place of the include and the rest of the
+// shader, numbered as in its file
+static GLuint create_unpack_shader(const char* vs_src, const char* fs_src, const GXColorimetry* c)
+{
+	const char* version_end = strchr(fs_src, '\n');
+	const char* include = strstr(fs_src, COLORIMETRY_INCLUDE);
+	const char* body = include ? strchr(include, '\n') : NULL;
+	if(!version_end || !body) {
+		printf("Unpack shader without the colorimetry include\n");
+		exit(1);
+	}
+	body++;
+
+	unsigned int line = 1;
+	for(const char* p = fs_src; p < body; p++) {
+		line += *p == '\n';
+	}
+
+	char header[256];
+	snprintf(header, sizeof(header), "%.*s%s%s%s", (int) (version_end + 1 - fs_src), fs_src, colorspace_defines[c->colorspace], range_defines[c->range], transfer_defines[c->transfer]);
+
+	size_t size = strlen(header) + strlen(colorimetry) + strlen(body) + 32;
+	char* src = (char*) malloc(size);
+	snprintf(src, size, "%s%s\n#line %u\n%s", header, colorimetry, line, body);
+
+	GLuint shader = GXCreateShader(vs_src, src);
+	free(src);
+
+	return shader;
+}
+
+static unsigned int colorimetry_index(const GXColorimetry* c)
+{
+	return (c->colorspace * GX_RANGE_CNT + c->range) * GX_TRANSFER_CNT + c->transfer;
+}
+
+// Every variant of one unpack shader
+static void create_unpack_variants(GXUnpackShader* variants, const char* vs_src, const char* fs_src)
+{
+	GXColorimetry c;
+	for(unsigned int cs = 0; cs < GX_COLORSPACE_CNT; cs++) {
+		for(unsigned int r = 0; r < GX_RANGE_CNT; r++) {
+			for(unsigned int t = 0; t < GX_TRANSFER_CNT; t++) {
+				c.colorspace = (GXColorspace) cs;
+				c.range = (GXRange) r;
+				c.transfer = (GXTransfer) t;
+
+				GXUnpackShader* u = &variants[colorimetry_index(&c)];
+				u->shader = create_unpack_shader(vs_src, fs_src, &c);
+				u->shader_tex = glGetUniformLocation(u->shader, "frame");
+				u->shader_scale = glGetUniformLocation(u->shader, "scale");
+				u->shader_last = glGetUniformLocation(u->shader, "last");
+				u->shader_direct = glGetUniformLocation(u->shader, "direct");
+				u->shader_viewport = glGetUniformLocation(u->shader, "viewport");
+				u->shader_brightness = glGetUniformLocation(u->shader, "brightness");
+			}
+		}
+	}
+}
+
+// The variant for the frame format and colorimetry
+static const GXUnpackShader* unpack_shader(const GXRenderer* self, BMDPixelFormat fmt)
+{
+	const GXUnpackShader* variants;
+	switch(fmt) {
+		case bmdFormat8BitYUV:
+			variants = self->unpack_shaders->yuv8;
+			break;
+		case bmdFormat10BitYUV:
+			variants = self->unpack_shaders->yuv10;
+			break;
+		case bmdFormat10BitRGB:
+			variants = self->unpack_shaders->rgb10;
+			break;
+		default:
+			return NULL;
+	}
+
+	return &variants[colorimetry_index(&self->colorimetry)];
+}
+
+// Takes effect with the next frame unpacked, all variants are built by
+// GXRendererInit
+void GXSetColorimetry(GXRenderer* self, const GXColorimetry* colorimetry)
+{
+	self->colorimetry = *colorimetry;
+}
+
+// The unpacked frame keeps values outside [0..1] (sub-blacks, super-whites)
+// until the display pass applies brightness and clamps.
+static void resize_unpacked(GXRenderer* self, GLsizei width, GLsizei height)
+{
+	glBindTexture(GL_TEXTURE_2D, self->unpacked);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, self->unpack_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, self->unpacked, 0);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Unpack framebuffer is incomplete\n");
+	}
+
+	self->unpacked_width = width;
+	self->unpacked_height = height;
+}
+
+// Draw the unpack pass for the current frame format into the bound
+// framebuffer from the origin of the viewport, one fragment per block of
+// scale x scale frame pixels
+bool GXUnpackDraw(GXRenderer* self, unsigned int scale)
+{
+	const GXUnpackShader* u = unpack_shader(self, self->frame_format);
+	if(!u) {
+		return false;
+	}
+
+	glUseProgram(u->shader);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, self->frame);
+	glUniform1i(u->shader_tex, 0);
+	glUniform1i(u->shader_scale, scale);
+	glUniform2i(u->shader_last, self->frame_width - 1, self->frame_height - 1);
+	glUniform1i(u->shader_direct, 0);
+
+	glBindVertexArray(self->quad_vao);
+	glDrawArrays(GL_TRIANGLES, 0, QUAD_VTX_CNT);
+
+	return true;
+}
+
+// Decode the packed frame once into an RGB texture of the frame size, so
+// the display pass is a single filtered fetch per fragment when it is
+// larger than the frame, and the other passes read RGB. Runs at most once
+// per uploaded frame.
+void GXUnpackFrame(GXRenderer* self)
+{
+	if(!self->unpack_pending) {
+		return;
+	}
+
+	GLint framebuffer;
+	GLint viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean blend = glIsEnabled(GL_BLEND);
+
+	if(self->unpacked_width != (GLsizei) self->frame_width || self->unpacked_height != (GLsizei) self->frame_height) {
+		resize_unpacked(self, self->frame_width, self->frame_height);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, self->unpack_fbo);
+	glViewport(0, 0, self->frame_width, self->frame_height);
+	glDisable(GL_BLEND);
+
+	GXUnpackDraw(self, 1);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	if(blend) {
+		glEnable(GL_BLEND);
+	}
+
+	self->unpack_pending = false;
+	GL_ERROR();
+}
+
+// Exchanges the unpack target with another texture of width x height, 0 x
+// 0 if it has no storage yet; the next frame is unpacked into that one.
+void GXSwapUnpacked(GXRenderer* self, GLuint* texture, GLsizei* width, GLsizei* height)
+{
+	GLuint unpacked = self->unpacked;
+	GLsizei unpacked_width = self->unpacked_width;
+	GLsizei unpacked_height = self->unpacked_height;
+
+	self->unpacked = *texture;
+	self->unpacked_width = *width;
+	self->unpacked_height = *height;
+	self->shown = self->unpacked;
+
+	*texture = unpacked;
+	*width = unpacked_width;
+	*height = unpacked_height;
+
+	GLint framebuffer;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, self->unpack_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, self->unpacked, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+// Decodes the packed frame straight into the viewport, one or four decodes
+// per output pixel instead of the unpack of every frame pixel first, which
+// is cheaper at or below the frame size. Only done while nothing else has
+// unpacked the frame and it is shown as it is.
+static bool draw_direct(GXRenderer* self, bool interpolate, float brightness)
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	if(!self->unpack_pending || self->shown != self->unpacked ||
+			viewport[2] > (GLint) self->frame_width || viewport[3] > (GLint) self->frame_height) {
+		return false;
+	}
+
+	const GXUnpackShader* u = unpack_shader(self, self->frame_format);
+	if(!u) {
+		return false;
+	}
+
+	glUseProgram(u->shader);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, self->frame);
+	glUniform1i(u->shader_tex, 0);
+	glUniform2i(u->shader_last, self->frame_width - 1, self->frame_height - 1);
+	glUniform1i(u->shader_direct, interpolate ? 2 : 1);
+	glUniform4f(u->shader_viewport, viewport[0], viewport[1], viewport[2], viewport[3]);
+	glUniform1f(u->shader_brightness, brightness);
+
+	glBindVertexArray(self->quad_vao);
+	glDrawArrays(GL_TRIANGLES, 0, QUAD_VTX_CNT);
+
+	return true;
+}
+
+// Draws the frame into the viewport, from the unpacked frame unless it is
+// decoded straight into it
+void GXDraw(GXRenderer* self, bool interpolate, float brightness)
+{
+	if(draw_direct(self, interpolate, brightness)) {
+		return;
+	}
+
+	GXUnpackFrame(self);
+
+	if(!self->unpacked_width) {
+		// nothing uploaded yet
+		return;
+	}
+
+	glUseProgram(self->display_shader);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, self->shown);
+	glBindSampler(0, interpolate ? self->sampler_linear : self->sampler_nearest);
+	glUniform1i(self->display_shader_tex, 0);
+	glUniform1f(self->display_shader_brightness, brightness);
+
+	glBindVertexArray(self->quad_vao);
+	glDrawArrays(GL_TRIANGLES, 0, QUAD_VTX_CNT);
+
+	glBindSampler(0, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GLuint GXCompileShader(GLuint type, const char* src)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &src, 0);
+	glCompileShader(shader);
+
+	GLint compiled = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if(compiled == GL_FALSE) {
+		GLint len = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+
+		if(!len) {
+			printf("Failed to retrieve shader compilation error log\n");
+			exit(1);
+		}
+
+		char* log = (char*) malloc(len);
+		glGetShaderInfoLog(shader, len, &len, log);
+		glDeleteShader(shader);
+
+		printf("Failed to compile shader:\n%s\n", log);
+		free(log);
+
+		exit(1);
+	} else {
+		GLint len = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+
+		if(len) {
+			char* log = (char*) malloc(len);
+			glGetShaderInfoLog(shader, len, &len, log);
+			if(len) {
+				printf("shader compilation log:\n%s\n", log);
+			}
+			free(log);
+		}
+	}
+
+	return shader;
+}
+
+GLuint GXCreateShader(const char* vs_src, const char* fs_src)
+{
+	GLuint vs = GXCompileShader(GL_VERTEX_SHADER, vs_src);
+	GLuint fs = GXCompileShader(GL_FRAGMENT_SHADER, fs_src);
+
+	GLuint shader = glCreateProgram();
+
+	glAttachShader(shader, vs);
+	glAttachShader(shader, fs);
+	glLinkProgram(shader);
+
+	GLint linked = 0;
+	glGetProgramiv(shader, GL_LINK_STATUS, &linked);
+	if(linked == GL_FALSE) {
+		GLint len = 0;
+		glGetProgramiv(shader, GL_INFO_LOG_LENGTH, &len);
+
+		if(!len) {
+			printf("Faild to retrieve shader linking error log\n");
+			exit(1);
+		}
+
+		char* log = (char*) malloc(len);
+		glGetProgramInfoLog(shader, len, &len, log);
+
+		glDeleteProgram(shader);
+		glDeleteShader(vs);
+		glDeleteShader(fs);
+
+		printf("Failed to link shader:\n%s\n", log);
+
+		free(log);
+		exit(1);
+	} else {
+		GLint len = 0;
+		glGetProgramiv(shader, GL_INFO_LOG_LENGTH, &len);
+
+		if(len) {
+			char* log = (char*) malloc(len);
+			glGetProgramInfoLog(shader, len, &len, log);
+
+			if(len) {
+				printf("Shader linking error log:\n%s\n", log);
+			}
+
+			free(log);
+		}
+	}
+
+	glDetachShader(shader, vs);
+	glDetachShader(shader, fs);
+
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	return shader;
+}
+
+static void create_unpack_target(GXRenderer* self)
+{
+	glGenTextures(1, &self->unpacked);
+	glBindTexture(GL_TEXTURE_2D, self->unpacked);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glGenFramebuffers(1, &self->unpack_fbo);
+	self->shown = self->unpacked;
+	self->unpacked_width = 0;
+	self->unpacked_height = 0;
+	self->unpack_pending = false;
+	self->frame_count = 0;
+}
+
+// filtering is chosen per draw
+static void create_samplers(GXRenderer* self)
+{
+	glGenSamplers(1, &self->sampler_nearest);
+	glSamplerParameteri(self->sampler_nearest, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glSamplerParameteri(self->sampler_nearest, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glSamplerParameteri(self->sampler_nearest, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(self->sampler_nearest, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenSamplers(1, &self->sampler_linear);
+	glSamplerParameteri(self->sampler_linear, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(self->sampler_linear, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(self->sampler_linear, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(self->sampler_linear, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+// With share set, programs, vertex buffers and samplers are taken from that
+// renderer and only the textures of this one are created. Frames are taken
+// as Rec.709 SDR at video levels until told otherwise.
+void GXRendererInit(GXRenderer* self, const GXRenderer* share)
+{
+	self->colorimetry.colorspace = GX_COLORSPACE_REC709;
+	self->colorimetry.range = GX_RANGE_LIMITED;
+	self->colorimetry.transfer = GX_TRANSFER_SDR;
+
+	if(share) {
+		self->unpack_shaders = share->unpack_shaders;
+		self->display_shader = share->display_shader;
+		self->display_shader_tex = share->display_shader_tex;
+		self->display_shader_brightness = share->display_shader_brightness;
+		self->sampler_nearest = share->sampler_nearest;
+		self->sampler_linear = share->sampler_linear;
+		self->quad_vao = share->quad_vao;
+		self->quad_vbo = share->quad_vbo;
+
+		GXCreateTexture(self);
+		create_unpack_target(self);
+		return;
+	}
+
+	GXCreateBuffers(self);
+	GXCreateTexture(self);
+	create_unpack_target(self);
+	create_samplers(self);
+
+	self->unpack_shaders = (GXUnpackShaders*) calloc(1, sizeof(GXUnpackShaders));
+	create_unpack_variants(self->unpack_shaders->yuv8, yuv8_vert, yuv8_frag);
+	create_unpack_variants(self->unpack_shaders->yuv10, yuv10_vert, yuv10_frag);
+	create_unpack_variants(self->unpack_shaders->rgb10, rgb10_vert, rgb10_frag);
+
+	self->display_shader = GXCreateShader(display_vert, display_frag);
+	self->display_shader_tex = glGetUniformLocation(self->display_shader, "frame");
+	self->display_shader_brightness = glGetUniformLocation(self->display_shader, "brightness");
+}
+
+void GXCreateBuffers(GXRenderer* self)
+{
+	glGenVertexArrays(1, &self->quad_vao);
+	glBindVertexArray(self->quad_vao);
+
+	GLuint loc = 0;
+
+	glGenBuffers(1, &self->quad_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, self->quad_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(loc);
+	glVertexAttribPointer(loc , 3, GL_FLOAT, GL_FALSE, 0, 0);
+}
+
+void GXCreateTexture(GXRenderer* self)
+{
+	glGenTextures(1, &self->frame);
+	glBindTexture(GL_TEXTURE_2D, self->frame);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 64, 64, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
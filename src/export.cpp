@@ -0,0 +1,381 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <climits>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <DeckLinkAPI.h>
+
+#include "deckview.h"
+
+// Shared memory export of one input (see EXRingHeader), so that analysis
+// tools can follow the capture while it is displayed: only one process can
+// own a DeckLink input.
+//
+// Like the recorder, the capture callback only AddRefs the frame into a
+// bounded single producer / single consumer queue, copies the audio into
+// the queue entry and wakes the export thread through a futex; it drops
+// the frame when the queue is full. The export thread copies the frame into
+// the next slot of the ring under its seqlock and publishes it. Readers
+// never hold anything the writer waits for, a slow reader only loses
+// frames. That single copy is unavoidable, the capture buffers belong to
+// the driver; readers use the frames in place.
+//
+// The slots have room for the largest frame of any mode DeckLink cards
+// report, 8K DCI, in the largest format captured, r210. The shared memory
+// is only backed where it was written, so the ring of an HD input costs
+// what HD frames take.
+
+#define	EXPORT_SLOTCNT		4
+#define	EXPORT_ALIGN		4096
+#define	EXPORT_VIDEO_SIZE	((size_t) (8192 + 63) / 64 * 256 * 4320)	/* 8K DCI r210 */
+#define	EXPORT_AUDIO_FRAMES	4096	/* sample frames per slot at most */
+#define	EXPORT_WAIT_TIMEOUT	100000000 /* ns */
+
+typedef struct {
+	BMDDisplayMode	display_mode;
+	BMDTimeValue	duration;
+	BMDTimeScale	timescale;
+} ExportFormat;
+
+typedef struct {
+	IDeckLinkVideoInputFrame*	frame;	// NULL for audio only
+	ExportFormat	format;
+	int64_t	stream_time;
+	int64_t	capture_time;
+	int64_t	packet_time;
+	long	audio_frames;
+	uint8_t*	audio;		// EXPORT_AUDIO_FRAMES sample frames
+} ExportItem;
+
+static pthread_t thread;
+static volatile bool running = false;
+
+static char* shm_name = NULL;
+static uint8_t* ring = NULL;
+static size_t ring_size = 0;
+static unsigned int audio_channels = 0;
+static unsigned int sample_depth = 0;
+static unsigned int audio_frame_bytes = 0;
+
+// capture callback side
+static ExportFormat format;
+
+static ExportItem queue[EX_QUEUECNT];
+static uint8_t* queue_audio = NULL;
+static volatile uint64_t queue_r;
+static volatile uint64_t queue_w;
+
+static volatile uint32_t wake_futex;
+static volatile uint32_t wake_waiting;
+
+static volatile unsigned long frames_published;
+static volatile unsigned long frames_dropped;
+static volatile unsigned long frames_oversize;
+static volatile int64_t copy_time;
+
+static void futex_wait(volatile uint32_t* addr, uint32_t val, long timeout_ns)
+{
+	struct timespec ts;
+	ts.tv_sec = timeout_ns / 1000000000;
+	ts.tv_nsec = timeout_ns % 1000000000;
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+static void futex_wake(volatile uint32_t* addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static void wake_exporter(void)
+{
+	__atomic_add_fetch(&wake_futex, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&wake_waiting, __ATOMIC_SEQ_CST)) {
+		futex_wake(&wake_futex);
+	}
+}
+
+static int64_t monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void publish(const ExportItem* item)
+{
+	EXRingHeader* header = (EXRingHeader*) ring;
+	uint64_t n = header->latest;
+	EXSlotHeader* slot = (EXSlotHeader*) (ring + header->slot_offset + (n % EXPORT_SLOTCNT) * header->slot_stride);
+
+	IDeckLinkVideoInputFrame* f = item->frame;
+	size_t size = f ? (size_t) f->GetRowBytes() * f->GetHeight() : 0;
+	if(size > header->video_size) {
+		// published as audio only, reported when the export stops
+		frames_oversize++;
+		size = 0;
+		f = NULL;
+	}
+
+	uint64_t seq = slot->seq;
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->frame = n;
+	slot->display_mode = item->format.display_mode;
+	slot->pixel_format = f ? f->GetPixelFormat() : 0;
+	slot->width = f ? f->GetWidth() : 0;
+	slot->height = f ? f->GetHeight() : 0;
+	slot->row_bytes = f ? f->GetRowBytes() : 0;
+	slot->audio_channels = audio_channels;
+	slot->sample_depth = sample_depth;
+	slot->audio_frames = item->audio_frames;
+	slot->frame_duration = item->format.duration;
+	slot->timescale = item->format.timescale;
+	slot->stream_time = item->stream_time;
+	slot->capture_time = item->capture_time;
+	slot->packet_time = item->packet_time;
+
+	if(f) {
+		void* bytes;
+		f->GetBytes(&bytes);
+		memcpy((uint8_t*) slot + slot->video_offset, bytes, size);
+	}
+	memcpy((uint8_t*) slot + slot->audio_offset, item->audio, item->audio_frames * audio_frame_bytes);
+
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&header->latest, n + 1, __ATOMIC_RELEASE);
+}
+
+static void* ex_thread(void* arg)
+{
+	for(;;) {
+		uint32_t seq = __atomic_load_n(&wake_futex, __ATOMIC_SEQ_CST);
+		bool run = __atomic_load_n(&running, __ATOMIC_ACQUIRE);
+
+		uint64_t w = __atomic_load_n(&queue_w, __ATOMIC_ACQUIRE);
+		for(uint64_t r = queue_r; r < w; r++) {
+			ExportItem* item = &queue[r % EX_QUEUECNT];
+
+			int64_t start = monotonic_us();
+			publish(item);
+			copy_time += monotonic_us() - start;
+			frames_published++;
+
+			if(item->frame) {
+				item->frame->Release();
+				item->frame = NULL;
+			}
+			__atomic_store_n(&queue_r, r + 1, __ATOMIC_RELEASE);
+		}
+
+		if(!run) {
+			break;
+		}
+
+		__atomic_store_n(&wake_waiting, 1, __ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&queue_w, __ATOMIC_SEQ_CST) == queue_r) {
+			futex_wait(&wake_futex, seq, EXPORT_WAIT_TIMEOUT);
+		}
+		__atomic_store_n(&wake_waiting, 0, __ATOMIC_SEQ_CST);
+	}
+
+	return NULL;
+}
+
+bool EXStart(const char* name, unsigned int channels, unsigned int bit)
+{
+	size_t len = strlen(name);
+	shm_name = (char*) malloc(len + 2);
+	if(!shm_name) {
+		return false;
+	}
+	shm_name[0] = '/';
+	memcpy(shm_name + 1, name, len + 1);
+
+	int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		fprintf(stderr, "Failed to create shared memory %s: %s\n", shm_name, strerror(errno));
+		free(shm_name);
+		shm_name = NULL;
+		return false;
+	}
+
+	audio_channels = channels;
+	sample_depth = bit;
+	audio_frame_bytes = channels * (bit / 8);
+
+	size_t audio_size = (EXPORT_AUDIO_FRAMES * audio_frame_bytes + EXPORT_ALIGN - 1) / EXPORT_ALIGN * EXPORT_ALIGN;
+	size_t video_size = (EXPORT_VIDEO_SIZE + EXPORT_ALIGN - 1) / EXPORT_ALIGN * EXPORT_ALIGN;
+	size_t slot_stride = EXPORT_ALIGN + video_size + audio_size;
+	ring_size = EXPORT_ALIGN + EXPORT_SLOTCNT * slot_stride;
+
+	// sparse, nothing is backed until written
+	if(ftruncate(fd, ring_size) < 0) {
+		fprintf(stderr, "Failed to size shared memory %s: %s\n", shm_name, strerror(errno));
+		close(fd);
+		EXStop();
+		return false;
+	}
+
+	void* map = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		fprintf(stderr, "Failed to map shared memory %s: %s\n", shm_name, strerror(errno));
+		EXStop();
+		return false;
+	}
+	ring = (uint8_t*) map;
+
+	EXRingHeader* header = (EXRingHeader*) ring;
+	header->slot_count = EXPORT_SLOTCNT;
+	header->slot_offset = EXPORT_ALIGN;
+	header->slot_stride = slot_stride;
+	header->video_size = video_size;
+	header->audio_size = audio_size;
+	header->latest = 0;
+
+	for(unsigned int i = 0; i < EXPORT_SLOTCNT; i++) {
+		EXSlotHeader* slot = (EXSlotHeader*) (ring + EXPORT_ALIGN + i * slot_stride);
+		slot->video_offset = EXPORT_ALIGN;
+		slot->audio_offset = EXPORT_ALIGN + video_size;
+	}
+
+	// readers check the magic last
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(header->magic, EX_RING_MAGIC, sizeof(header->magic));
+
+	queue_audio = (uint8_t*) malloc(EX_QUEUECNT * EXPORT_AUDIO_FRAMES * audio_frame_bytes);
+	if(!queue_audio) {
+		EXStop();
+		return false;
+	}
+	for(unsigned int i = 0; i < EX_QUEUECNT; i++) {
+		queue[i].frame = NULL;
+		queue[i].audio = queue_audio + i * EXPORT_AUDIO_FRAMES * audio_frame_bytes;
+	}
+
+	memset(&format, 0, sizeof(format));
+	queue_r = queue_w = 0;
+	frames_published = frames_dropped = frames_oversize = 0;
+	copy_time = 0;
+
+	running = true;
+	if(pthread_create(&thread, NULL, ex_thread, NULL)) {
+		running = false;
+		EXStop();
+		return false;
+	}
+
+	printf("Exporting to shared memory %s\n", shm_name);
+
+	return true;
+}
+
+// Called from VideoInputFormatChanged of the exported input
+void EXFormat(IDeckLinkDisplayMode* mode, BMDPixelFormat fmt)
+{
+	format.display_mode = mode->GetDisplayMode();
+	mode->GetFrameRate(&format.duration, &format.timescale);
+}
+
+// Called from the capture callback, video is NULL without a signal
+void EXFrame(IDeckLinkVideoInputFrame* video, IDeckLinkAudioInputPacket* audio)
+{
+	if(!__atomic_load_n(&running, __ATOMIC_ACQUIRE) || (!video && !audio)) {
+		return;
+	}
+
+	uint64_t w = queue_w;
+	uint64_t r = __atomic_load_n(&queue_r, __ATOMIC_ACQUIRE);
+
+	if(w - r == EX_QUEUECNT) {
+		frames_dropped++;
+		return;
+	}
+
+	ExportItem* item = &queue[w % EX_QUEUECNT];
+	item->frame = video;
+	item->format = format;
+	item->stream_time = 0;
+	item->capture_time = 0;
+	item->packet_time = 0;
+	item->audio_frames = 0;
+
+	BMDTimeValue time;
+	BMDTimeValue duration;
+	if(video) {
+		if(format.timescale && video->GetStreamTime(&time, &duration, format.timescale) == S_OK) {
+			item->stream_time = time;
+		}
+		if(video->GetHardwareReferenceTimestamp(1000000, &time, &duration) == S_OK) {
+			item->capture_time = time;
+		}
+		video->AddRef();
+	}
+
+	if(audio) {
+		void* bytes;
+		audio->GetBytes(&bytes);
+		long frames = audio->GetSampleFrameCount();
+		if(frames > EXPORT_AUDIO_FRAMES) {
+			frames = EXPORT_AUDIO_FRAMES;
+		}
+
+		if(audio->GetPacketTime(&time, bmdAudioSampleRate48kHz) == S_OK) {
+			item->packet_time = time;
+		}
+
+		memcpy(item->audio, bytes, frames * audio_frame_bytes);
+		item->audio_frames = frames;
+	}
+
+	__atomic_store_n(&queue_w, w + 1, __ATOMIC_RELEASE);
+
+	wake_exporter();
+}
+
+// Stops publishing and removes the shared memory object, readers that
+// still have it mapped keep their mapping
+void EXStop(void)
+{
+	if(running) {
+		__atomic_store_n(&running, false, __ATOMIC_RELEASE);
+		wake_exporter();
+		pthread_join(thread, NULL);
+	}
+
+	if(ring) {
+		munmap(ring, ring_size);
+		ring = NULL;
+	}
+
+	if(shm_name) {
+		shm_unlink(shm_name);
+		free(shm_name);
+		shm_name = NULL;
+	}
+
+	free(queue_audio);
+	queue_audio = NULL;
+}
+
+bool EXActive(void)
+{
+	return running;
+}
+
+void EXGetStats(EXStats* stats)
+{
+	stats->frames = frames_published;
+	stats->dropped = frames_dropped;
+	stats->oversize = frames_oversize;
+	stats->copy_time = copy_time;
+}
@@ -1,6 +1,7 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <unistd.h>
 #include <DeckLinkAPI.h>
 
 #include "deckview.h"
@@ -64,30 +65,322 @@ IDeckLink* get_device(const char* name)
 	return NULL;
 }
 
+static void usage(const char* self)
+{
+	printf("Usage: %s [options] device [device...]\n", self);
+	printf("       %s [options] -S pattern|file:VIDEO[:AUDIO]|play:FILE[@S] [-m mode] [-d 8|10|rgb] [-b n] [-x s]\n", self);
+	printf("\n");
+	printf("Options:\n");
+	printf("  -u MODE   texture upload mode (default: pbo)\n");
+	printf("  -a MS     A/V sync tolerance in ms, or off (default: 20)\n");
+	printf("  -p MODE   frame pacing strategy (default: auto)\n");
+	printf("  -c FILE   write per frame pipeline timings to a CSV file\n");
+	printf("  -M MODE   compositing: array (mipmapped, one draw) or tiles (default: array)\n");
+	printf("  -s MODE   scaling: bilinear, bicubic or lanczos3 (default: bicubic)\n");
+	printf("  -i MODE   deinterlacing: weave, bob or adaptive (default: adaptive)\n");
+	printf("  -y LIST   colorimetry instead of the detected one, any of rec601, rec709\n");
+	printf("            or rec2020, limited or full and sdr, pq or hlg, e.g.\n");
+	printf("            rec2020,pq (default: detected, limited range)\n");
+	printf("  -r FILE   record the first input with its audio, play back with -S play:\n");
+	printf("  -e NAME   export the first input to the shared memory ring /NAME\n");
+	printf("  -C N      capture 2, 8 or 16 audio channels (default: 2)\n");
+	printf("  -B BITS   capture 16 or 32 bit audio samples (default: 16)\n");
+	printf("  -R ROUTE  audio output channels from the captured ones, e.g. 3,4 for\n");
+	printf("            the second pair, 1+3*0.5,2+3*0.5 to mix in channel 3 or 5.1\n");
+	printf("            for a stereo downmix of channels 1-6 (default: 1,2)\n");
+	printf("  -O MODE   audio output: stream (asynchronous) or simple (default: stream,\n");
+	printf("            falls back to simple)\n");
+	printf("  -L MS     audio output latency target in ms (default: 60)\n");
+	printf("  -D        don't resample the audio to compensate the clock drift\n");
+	printf("\n");
+	printf("Synthetic sources (no DeckLink hardware required):\n");
+	printf("  -S SRC    pattern: colour bars with a 1 kHz tone\n");
+	printf("            file:VIDEO[:AUDIO]: replay raw frames in the capture\n");
+	printf("            format and raw PCM audio in the capture format\n");
+	printf("            play:FILE[@S]: play back a recording made with -r,\n");
+	printf("            from S seconds in\n");
+	printf("            repeat -S for several inputs, alone or with devices\n");
+	printf("  -m MODE   display mode (default: 1080p50)\n");
+	printf("  -d DEPTH  8 (UYVY), 10 (v210) bit or rgb (r210) (default: 8)\n");
+	printf("  -b N      deliver frames in bursts of N\n");
+	printf("  -x S      switch between 8 and 10 bit every S seconds\n");
+	printf("\n");
+	printf("Several inputs are tiled into one window, keys 1-9 select the input\n");
+	printf("whose audio is played and used for A/V sync, M switches the compositing.\n");
+	printf("Recordings seek with left/right (5 s), down/up (60 s), comma/period\n");
+	printf("(one frame) and home. W, P, V and H show the waveform, RGB parade,\n");
+	printf("vectorscope and histogram of that input, A its audio meters. S cycles\n");
+	printf("the scaling of frames drawn at another size, D the deinterlacing of\n");
+	printf("interlaced inputs.\n");
+	printf("\n");
+	printf("Modes: ");
+	ListSyntheticModes();
+	printf("\n");
+}
+
 int main(int argc, char** argv)
 {
-	if(argc != 2) {
-		list_devices();
-		return 0;
+	GXConfig config;
+	config.upload_mode = GX_UPLOAD_PBO;
+	config.av_tolerance = 20000;
+	config.pace_mode = GX_PACE_AUTO;
+	config.stats_csv = NULL;
+	config.compose_mode = GX_COMPOSE_ARRAY;
+	config.scale_mode = GX_SCALE_BICUBIC;
+	config.deinterlace_mode = GX_DEINTERLACE_ADAPTIVE;
+	GXColorimetryParse(NULL, &config.colorimetry);
+	config.record_path = NULL;
+	config.export_name = NULL;
+	config.audio_channels = 2;
+	config.audio_depth = 16;
+	config.audio_route = "1,2";
+	config.audio_output = AX_OUTPUT_STREAM;
+	config.audio_latency = 60000;
+	config.audio_drift = true;
+
+	const char* synthetic[GX_MAX_INPUTS];
+	unsigned int synthetic_count = 0;
+	SyntheticConfig synthetic_config;
+	synthetic_config.mode = "1080p50";
+	synthetic_config.depth = 8;
+	synthetic_config.rgb = false;
+	synthetic_config.video_path = NULL;
+	synthetic_config.audio_path = NULL;
+	synthetic_config.capture_path = NULL;
+	synthetic_config.start = 0;
+	synthetic_config.burst = 1;
+	synthetic_config.format_interval = 0;
+
+	int opt;
+	while((opt = getopt(argc, argv, "u:a:p:c:M:s:i:y:r:e:C:B:R:O:L:DS:m:d:b:x:h")) != -1) {
+		switch(opt) {
+			case 'u':
+				if(!strcmp(optarg, "direct")) {
+					config.upload_mode = GX_UPLOAD_DIRECT;
+				} else if(!strcmp(optarg, "pbo")) {
+					config.upload_mode = GX_UPLOAD_PBO;
+				} else {
+					printf("Unknown upload mode: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'a':
+				if(!strcmp(optarg, "off")) {
+					config.av_tolerance = -1;
+				} else {
+					config.av_tolerance = atoi(optarg) * 1000;
+				}
+				break;
+			case 'p':
+				if(!strcmp(optarg, "auto")) {
+					config.pace_mode = GX_PACE_AUTO;
+				} else if(!strcmp(optarg, "vsync")) {
+					config.pace_mode = GX_PACE_VSYNC;
+				} else if(!strcmp(optarg, "interval")) {
+					config.pace_mode = GX_PACE_INTERVAL;
+				} else if(!strcmp(optarg, "latch")) {
+					config.pace_mode = GX_PACE_LATCH;
+				} else {
+					printf("Unknown pacing mode: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'c':
+				config.stats_csv = optarg;
+				break;
+			case 'M':
+				if(!strcmp(optarg, "array")) {
+					config.compose_mode = GX_COMPOSE_ARRAY;
+				} else if(!strcmp(optarg, "tiles")) {
+					config.compose_mode = GX_COMPOSE_TILES;
+				} else {
+					printf("Unknown compositing mode: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 's':
+				config.scale_mode = GX_SCALE_CNT;
+				for(int i = 0; i < GX_SCALE_CNT; i++) {
+					if(!strcmp(optarg, GXScaleModeName((GXScaleMode) i))) {
+						config.scale_mode = (GXScaleMode) i;
+					}
+				}
+				if(config.scale_mode == GX_SCALE_CNT) {
+					printf("Unknown scaling mode: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'i':
+				config.deinterlace_mode = GX_DEINTERLACE_CNT;
+				for(int i = 0; i < GX_DEINTERLACE_CNT; i++) {
+					if(!strcmp(optarg, GXDeinterlaceModeName((GXDeinterlaceMode) i))) {
+						config.deinterlace_mode = (GXDeinterlaceMode) i;
+					}
+				}
+				if(config.deinterlace_mode == GX_DEINTERLACE_CNT) {
+					printf("Unknown deinterlacing mode: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'y':
+				if(!GXColorimetryParse(optarg, &config.colorimetry)) {
+					return 1;
+				}
+				break;
+			case 'r':
+				config.record_path = optarg;
+				break;
+			case 'e':
+				config.export_name = optarg;
+				break;
+			case 'C':
+				config.audio_channels = atoi(optarg);
+				if(config.audio_channels != 2 && config.audio_channels != 8 && config.audio_channels != 16) {
+					printf("Unsupported audio channel count: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'B':
+				config.audio_depth = atoi(optarg);
+				if(config.audio_depth != 16 && config.audio_depth != 32) {
+					printf("Unsupported audio sample depth: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'R':
+				config.audio_route = optarg;
+				break;
+			case 'O':
+				if(!strcmp(optarg, "stream")) {
+					config.audio_output = AX_OUTPUT_STREAM;
+				} else if(!strcmp(optarg, "simple")) {
+					config.audio_output = AX_OUTPUT_SIMPLE;
+				} else {
+					printf("Unknown audio output: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'L':
+				config.audio_latency = atoi(optarg) * 1000;
+				if(config.audio_latency <= 0) {
+					printf("Bad audio latency target: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'D':
+				config.audio_drift = false;
+				break;
+			case 'S':
+				if(synthetic_count == GX_MAX_INPUTS) {
+					printf("Too many inputs\n");
+					return 1;
+				}
+				synthetic[synthetic_count++] = optarg;
+				break;
+			case 'm':
+				synthetic_config.mode = optarg;
+				break;
+			case 'd':
+				if(!strcmp(optarg, "rgb")) {
+					synthetic_config.depth = 10;
+					synthetic_config.rgb = true;
+				} else {
+					synthetic_config.depth = atoi(optarg);
+				}
+				break;
+			case 'b':
+				synthetic_config.burst = atoi(optarg);
+				break;
+			case 'x':
+				synthetic_config.format_interval = atof(optarg);
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	CaptureSource* sources[GX_MAX_INPUTS];
+	unsigned int source_count = 0;
+	char* paths[GX_MAX_INPUTS];
+	unsigned int path_count = 0;
+	int ret = 0;
+
+	for(unsigned int i = 0; i < synthetic_count; i++) {
+		synthetic_config.video_path = NULL;
+		synthetic_config.audio_path = NULL;
+		synthetic_config.capture_path = NULL;
+		synthetic_config.start = 0;
+
+		if(!strncmp(synthetic[i], "play:", 5)) {
+			// play:FILE[@SECONDS]
+			char* path = strdup(synthetic[i] + 5);
+			char* start = strrchr(path, '@');
+			if(start) {
+				*start++ = 0;
+				synthetic_config.start = atof(start);
+			}
+			synthetic_config.capture_path = path;
+			paths[path_count++] = path;
+		} else if(!strncmp(synthetic[i], "file:", 5)) {
+			// file:VIDEO[:AUDIO]
+			char* path = strdup(synthetic[i] + 5);
+			char* audio = strchr(path, ':');
+			if(audio) {
+				*audio++ = 0;
+			}
+			synthetic_config.video_path = path;
+			synthetic_config.audio_path = audio;
+			paths[path_count++] = path;
+		} else if(strcmp(synthetic[i], "pattern")) {
+			printf("Unknown synthetic source: %s\n", synthetic[i]);
+			ret = 1;
+			goto done;
+		}
+
+		sources[source_count++] = CreateSyntheticSource(&synthetic_config);
+	}
+
+	if(source_count + argc - optind > GX_MAX_INPUTS) {
+		printf("Too many inputs\n");
+		ret = 1;
+		goto done;
 	}
 
-	const char* name = argv[1];
+	for(int i = optind; i < argc; i++) {
+		IDeckLink* device = get_device(argv[i]);
 
-	IDeckLink* device = get_device(name);
+		if(!device) {
+			printf("Device not found: %s\n", argv[i]);
+			ret = 1;
+			goto done;
+		}
 
-	if(!device) {
-		printf("Device not found\n");
-		return 1;
+		sources[source_count++] = CreateDeckLinkSource(device);
+		device->Release();
 	}
 
-	if(GXInit(device)) {
+	if(source_count == 0) {
+		usage(argv[0]);
+		list_devices();
+		goto done;
+	}
+
+	if(GXInit(sources, source_count, &config)) {
 		GXMain();
 		GXDestroy();
 	}
 
-	device->Release();
+done:
+	for(unsigned int i = 0; i < source_count; i++) {
+		delete sources[i];
+	}
+
+	for(unsigned int i = 0; i < path_count; i++) {
+		free(paths[i]);
+	}
 
 	printf("Bye\n");
 
-	return 0;
+	return ret;
 }
@@ -0,0 +1,481 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define	AX_X86
+#endif
+
+#include "deckview.h"
+
+// Audio meters, fed by ax_thread with what it hands to the sound card, never
+// by the capture callback. Runs of up to RUN sample frames are handled in
+// two stages like the frame conversion: spread the interleaved integer
+// samples into rows of LANES floats, one row per sample frame, then measure
+// the rows with all channels side by side in SIMD lanes. The K-weighting
+// filters are recursive, so consecutive samples of a channel can't be
+// vectorized but the channels can. Every 100 ms block the results are
+// reduced and published through a seqlock for the meter bridge.
+
+#define	AUDIO_RATE	48000
+#define	BLOCK_FRAMES	(AUDIO_RATE / 10)	// 100 ms, the R128 gating step
+#define	MOMENTARY_BLOCKS	4		// 400 ms
+#define	SHORT_BLOCKS	30			// 3 s
+#define	RUN		256
+#define	LANES		AX_MAX_CHANNELS
+
+// BS.1770 K-weighting at 48 kHz: a high shelf modelling the head followed
+// by the RLB high pass
+#define	SHELF_B0	1.53512485958697f
+#define	SHELF_B1	-2.69169618940638f
+#define	SHELF_B2	1.19839281085285f
+#define	SHELF_A1	-1.69065929318241f
+#define	SHELF_A2	0.73248077421585f
+#define	RLB_A1		-1.99004745483398f
+#define	RLB_A2		0.99007225036621f
+
+// Per channel state of the measure stage, all in lanes. The filters are
+// transposed direct form II, the RLB numerator is 1, -2, 1.
+typedef struct {
+	float	shelf_z1[LANES];
+	float	shelf_z2[LANES];
+	float	rlb_z1[LANES];
+	float	rlb_z2[LANES];
+	float	peak[LANES];
+	float	power[LANES];	// sum of squares
+	float	kpower[LANES];	// sum of K-weighted squares
+} __attribute__((aligned(32))) Lanes;
+
+typedef void (*SpreadFunc)(const void* src, unsigned int channels, unsigned int n, float* rows, unsigned int stride);
+typedef void (*MeasureFunc)(Lanes* l, const float* rows, unsigned int stride, unsigned int channels, unsigned int n);
+
+static Lanes lanes;
+static float rows[RUN * LANES] __attribute__((aligned(32)));
+static unsigned int row_stride;
+
+static unsigned int meter_channels = 0;
+static unsigned int meter_bit;
+static SpreadFunc spread;
+static MeasureFunc measure;
+static unsigned int block_fill;
+
+// mean squares of the last SHORT_BLOCKS blocks, a ring indexed by block
+// count
+static double power_history[SHORT_BLOCKS][LANES];
+static double kpower_history[SHORT_BLOCKS][LANES];
+static float peak_history[SHORT_BLOCKS][LANES];
+static uint64_t blocks;
+
+static int64_t busy_time;
+static uint64_t frames_measured;
+
+static volatile uint32_t levels_seq;
+static AXMeterLevels levels;
+
+static int64_t monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar reference
+
+static void spread_s16_scalar(const void* src, unsigned int channels, unsigned int n, float* rows, unsigned int stride)
+{
+	const int16_t* s = (const int16_t*) src;
+	for(unsigned int f = 0; f < n; f++) {
+		for(unsigned int c = 0; c < channels; c++) {
+			rows[f * stride + c] = s[f * channels + c] * (1.0f / 32768.0f);
+		}
+	}
+}
+
+static void spread_s32_scalar(const void* src, unsigned int channels, unsigned int n, float* rows, unsigned int stride)
+{
+	const int32_t* s = (const int32_t*) src;
+	for(unsigned int f = 0; f < n; f++) {
+		for(unsigned int c = 0; c < channels; c++) {
+			rows[f * stride + c] = s[f * channels + c] * (1.0f / 2147483648.0f);
+		}
+	}
+}
+
+static void measure_scalar(Lanes* l, const float* rows, unsigned int stride, unsigned int channels, unsigned int n)
+{
+	for(unsigned int c = 0; c < channels; c++) {
+		float z1 = l->shelf_z1[c];
+		float z2 = l->shelf_z2[c];
+		float w1 = l->rlb_z1[c];
+		float w2 = l->rlb_z2[c];
+		float peak = l->peak[c];
+		float power = l->power[c];
+		float kpower = l->kpower[c];
+
+		for(unsigned int f = 0; f < n; f++) {
+			float x = rows[f * stride + c];
+
+			float y = SHELF_B0 * x + z1;
+			z1 = SHELF_B1 * x - SHELF_A1 * y + z2;
+			z2 = SHELF_B2 * x - SHELF_A2 * y;
+
+			float k = y + w1;
+			w1 = -2.0f * y - RLB_A1 * k + w2;
+			w2 = y - RLB_A2 * k;
+
+			float a = fabsf(x);
+			peak = a > peak ? a : peak;
+			power += x * x;
+			kpower += k * k;
+		}
+
+		l->shelf_z1[c] = z1;
+		l->shelf_z2[c] = z2;
+		l->rlb_z1[c] = w1;
+		l->rlb_z2[c] = w2;
+		l->peak[c] = peak;
+		l->power[c] = power;
+		l->kpower[c] = kpower;
+	}
+}
+
+#ifdef AX_X86
+////////////////////////////////////////////////////////////////////////////////
+// SSE4.1: four channels per vector. The spreads need whole vectors of
+// channels, 2 channel audio is spread by the scalar version.
+
+__attribute__((target("sse4.1")))
+static void spread_s16_sse41(const void* src, unsigned int channels, unsigned int n, float* rows, unsigned int stride)
+{
+	if(channels % 4) {
+		spread_s16_scalar(src, channels, n, rows, stride);
+		return;
+	}
+
+	const int16_t* s = (const int16_t*) src;
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	for(unsigned int f = 0; f < n; f++) {
+		for(unsigned int c = 0; c < channels; c += 4) {
+			__m128i v = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*) (s + f * channels + c)));
+			_mm_store_ps(rows + f * stride + c, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+		}
+	}
+}
+
+__attribute__((target("sse4.1")))
+static void spread_s32_sse41(const void* src, unsigned int channels, unsigned int n, float* rows, unsigned int stride)
+{
+	if(channels % 4) {
+		spread_s32_scalar(src, channels, n, rows, stride);
+		return;
+	}
+
+	const int32_t* s = (const int32_t*) src;
+	const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+	for(unsigned int f = 0; f < n; f++) {
+		for(unsigned int c = 0; c < channels; c += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*) (s + f * channels + c));
+			_mm_store_ps(rows + f * stride + c, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+		}
+	}
+}
+
+__attribute__((target("sse4.1")))
+static void measure_sse41(Lanes* l, const float* rows, unsigned int stride, unsigned int channels, unsigned int n)
+{
+	const __m128 b0 = _mm_set1_ps(SHELF_B0);
+	const __m128 b1 = _mm_set1_ps(SHELF_B1);
+	const __m128 b2 = _mm_set1_ps(SHELF_B2);
+	const __m128 a1 = _mm_set1_ps(SHELF_A1);
+	const __m128 a2 = _mm_set1_ps(SHELF_A2);
+	const __m128 r1 = _mm_set1_ps(RLB_A1);
+	const __m128 r2 = _mm_set1_ps(RLB_A2);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	for(unsigned int c = 0; c < channels; c += 4) {
+		__m128 z1 = _mm_load_ps(l->shelf_z1 + c);
+		__m128 z2 = _mm_load_ps(l->shelf_z2 + c);
+		__m128 w1 = _mm_load_ps(l->rlb_z1 + c);
+		__m128 w2 = _mm_load_ps(l->rlb_z2 + c);
+		__m128 peak = _mm_load_ps(l->peak + c);
+		__m128 power = _mm_load_ps(l->power + c);
+		__m128 kpower = _mm_load_ps(l->kpower + c);
+
+		for(unsigned int f = 0; f < n; f++) {
+			__m128 x = _mm_load_ps(rows + f * stride + c);
+
+			__m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+			z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+			z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+
+			__m128 k = _mm_add_ps(y, w1);
+			w1 = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(two, y)), _mm_mul_ps(r1, k)), w2);
+			w2 = _mm_sub_ps(y, _mm_mul_ps(r2, k));
+
+			peak = _mm_max_ps(peak, _mm_and_ps(x, magnitude));
+			power = _mm_add_ps(power, _mm_mul_ps(x, x));
+			kpower = _mm_add_ps(kpower, _mm_mul_ps(k, k));
+		}
+
+		_mm_store_ps(l->shelf_z1 + c, z1);
+		_mm_store_ps(l->shelf_z2 + c, z2);
+		_mm_store_ps(l->rlb_z1 + c, w1);
+		_mm_store_ps(l->rlb_z2 + c, w2);
+		_mm_store_ps(l->peak + c, peak);
+		_mm_store_ps(l->power + c, power);
+		_mm_store_ps(l->kpower + c, kpower);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX2: eight channels per vector, the spreads are the SSE4.1 ones
+
+__attribute__((target("avx2")))
+static void measure_avx2(Lanes* l, const float* rows, unsigned int stride, unsigned int channels, unsigned int n)
+{
+	const __m256 b0 = _mm256_set1_ps(SHELF_B0);
+	const __m256 b1 = _mm256_set1_ps(SHELF_B1);
+	const __m256 b2 = _mm256_set1_ps(SHELF_B2);
+	const __m256 a1 = _mm256_set1_ps(SHELF_A1);
+	const __m256 a2 = _mm256_set1_ps(SHELF_A2);
+	const __m256 r1 = _mm256_set1_ps(RLB_A1);
+	const __m256 r2 = _mm256_set1_ps(RLB_A2);
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 magnitude = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	for(unsigned int c = 0; c < channels; c += 8) {
+		__m256 z1 = _mm256_load_ps(l->shelf_z1 + c);
+		__m256 z2 = _mm256_load_ps(l->shelf_z2 + c);
+		__m256 w1 = _mm256_load_ps(l->rlb_z1 + c);
+		__m256 w2 = _mm256_load_ps(l->rlb_z2 + c);
+		__m256 peak = _mm256_load_ps(l->peak + c);
+		__m256 power = _mm256_load_ps(l->power + c);
+		__m256 kpower = _mm256_load_ps(l->kpower + c);
+
+		for(unsigned int f = 0; f < n; f++) {
+			__m256 x = _mm256_load_ps(rows + f * stride + c);
+
+			__m256 y = _mm256_add_ps(_mm256_mul_ps(b0, x), z1);
+			z1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(b1, x), _mm256_mul_ps(a1, y)), z2);
+			z2 = _mm256_sub_ps(_mm256_mul_ps(b2, x), _mm256_mul_ps(a2, y));
+
+			__m256 k = _mm256_add_ps(y, w1);
+			w1 = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(two, y)), _mm256_mul_ps(r1, k)), w2);
+			w2 = _mm256_sub_ps(y, _mm256_mul_ps(r2, k));
+
+			peak = _mm256_max_ps(peak, _mm256_and_ps(x, magnitude));
+			power = _mm256_add_ps(power, _mm256_mul_ps(x, x));
+			kpower = _mm256_add_ps(kpower, _mm256_mul_ps(k, k));
+		}
+
+		_mm256_store_ps(l->shelf_z1 + c, z1);
+		_mm256_store_ps(l->shelf_z2 + c, z2);
+		_mm256_store_ps(l->rlb_z1 + c, w1);
+		_mm256_store_ps(l->rlb_z2 + c, w2);
+		_mm256_store_ps(l->peak + c, peak);
+		_mm256_store_ps(l->power + c, power);
+		_mm256_store_ps(l->kpower + c, kpower);
+	}
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+#ifdef AX_X86
+static const SpreadFunc spreads_s16[CX_ISA_CNT] = { spread_s16_scalar, spread_s16_sse41, spread_s16_sse41 };
+static const SpreadFunc spreads_s32[CX_ISA_CNT] = { spread_s32_scalar, spread_s32_sse41, spread_s32_sse41 };
+static const MeasureFunc measures[CX_ISA_CNT] = { measure_scalar, measure_sse41, measure_avx2 };
+#else
+static const SpreadFunc spreads_s16[CX_ISA_CNT] = { spread_s16_scalar, spread_s16_scalar, spread_s16_scalar };
+static const SpreadFunc spreads_s32[CX_ISA_CNT] = { spread_s32_scalar, spread_s32_scalar, spread_s32_scalar };
+static const MeasureFunc measures[CX_ISA_CNT] = { measure_scalar, measure_scalar, measure_scalar };
+#endif
+
+// Shared with the mixer, see mix.cpp
+void AXSpread(const void* src, unsigned int channels, unsigned int bit, unsigned int n, float* rows, unsigned int stride, CXIsa isa)
+{
+	SpreadFunc f = bit == 16 ? spreads_s16[isa] : spreads_s32[isa];
+	f(src, channels, n, rows, stride);
+}
+
+static float decibel(double power)
+{
+	return power > 0.0 ? (float) (10.0 * log10(power)) : AX_METER_FLOOR;
+}
+
+static float loudness(double kpower)
+{
+	return kpower > 0.0 ? (float) (-0.691 + 10.0 * log10(kpower)) : AX_METER_FLOOR;
+}
+
+// Mean of the last count blocks, fewer right after the start
+static double mean(const double history[SHORT_BLOCKS][LANES], unsigned int c, unsigned int count)
+{
+	if(count > blocks) {
+		count = blocks;
+	}
+
+	double sum = 0.0;
+	for(unsigned int i = 1; i <= count; i++) {
+		sum += history[(blocks - i) % SHORT_BLOCKS][c];
+	}
+	return sum / count;
+}
+
+static void finish_block(void)
+{
+	unsigned int slot = blocks % SHORT_BLOCKS;
+	for(unsigned int c = 0; c < meter_channels; c++) {
+		power_history[slot][c] = (double) lanes.power[c] / BLOCK_FRAMES;
+		kpower_history[slot][c] = (double) lanes.kpower[c] / BLOCK_FRAMES;
+		peak_history[slot][c] = lanes.peak[c];
+	}
+	blocks++;
+
+	memset(lanes.peak, 0, sizeof(lanes.peak));
+	memset(lanes.power, 0, sizeof(lanes.power));
+	memset(lanes.kpower, 0, sizeof(lanes.kpower));
+
+	AXMeterLevels next;
+	memset(&next, 0, sizeof(next));
+	next.channels = meter_channels;
+	next.blocks = blocks;
+	next.load = frames_measured ? busy_time / (frames_measured * 1000000.0 / AUDIO_RATE) : 0;
+
+	double program_momentary = 0.0;
+	double program_short_term = 0.0;
+	unsigned int held = blocks < SHORT_BLOCKS ? blocks : SHORT_BLOCKS;
+
+	for(unsigned int c = 0; c < meter_channels; c++) {
+		float hold = 0.0f;
+		for(unsigned int i = 0; i < held; i++) {
+			hold = peak_history[i][c] > hold ? peak_history[i][c] : hold;
+		}
+
+		double momentary = mean(kpower_history, c, MOMENTARY_BLOCKS);
+		double short_term = mean(kpower_history, c, SHORT_BLOCKS);
+
+		next.peak[c] = decibel((double) peak_history[slot][c] * peak_history[slot][c]);
+		next.peak_hold[c] = decibel((double) hold * hold);
+		next.rms[c] = decibel(mean(power_history, c, MOMENTARY_BLOCKS));
+		next.momentary[c] = loudness(momentary);
+		next.short_term[c] = loudness(short_term);
+
+		program_momentary += momentary;
+		program_short_term += short_term;
+	}
+
+	next.program_momentary = loudness(program_momentary);
+	next.program_short_term = loudness(program_short_term);
+
+	__atomic_add_fetch(&levels_seq, 1, __ATOMIC_ACQ_REL);
+	levels = next;
+	__atomic_add_fetch(&levels_seq, 1, __ATOMIC_RELEASE);
+}
+
+// Takes the sample format of the ring, 16 or 32 bit interleaved
+bool AXMeterInit(unsigned int channels, unsigned int bit, CXIsa isa)
+{
+	meter_channels = 0;
+
+	if(channels == 0 || channels > AX_MAX_CHANNELS || (bit != 16 && bit != 32)) {
+		printf("Audio meters: %u channels at %u bit are not supported\n", channels, bit);
+		return false;
+	}
+
+	if(!CXIsaSupported(isa)) {
+		isa = CX_ISA_SCALAR;
+	}
+
+	spread = bit == 16 ? spreads_s16[isa] : spreads_s32[isa];
+	measure = measures[isa];
+
+	// whole AVX2 vectors of channels, the lanes past the last channel
+	// stay silent
+	row_stride = (channels + 7) & ~7;
+
+	memset(&lanes, 0, sizeof(lanes));
+	memset(rows, 0, sizeof(rows));
+	memset(power_history, 0, sizeof(power_history));
+	memset(kpower_history, 0, sizeof(kpower_history));
+	memset(peak_history, 0, sizeof(peak_history));
+	block_fill = 0;
+	blocks = 0;
+	busy_time = 0;
+	frames_measured = 0;
+
+	__atomic_add_fetch(&levels_seq, 1, __ATOMIC_ACQ_REL);
+	memset(&levels, 0, sizeof(levels));
+	__atomic_add_fetch(&levels_seq, 1, __ATOMIC_RELEASE);
+
+	meter_bit = bit;
+	meter_channels = channels;
+	return true;
+}
+
+// Called from ax_thread with whole sample frames
+void AXMeterProcess(const void* data, size_t frames)
+{
+	if(!meter_channels) {
+		return;
+	}
+
+	int64_t start = monotonic_us();
+
+#ifdef AX_X86
+	// the filters decay into denormals on silence
+	unsigned int csr = _mm_getcsr();
+	_mm_setcsr(csr | 0x8040);
+#endif
+
+	const uint8_t* src = (const uint8_t*) data;
+	size_t frame_bytes = meter_channels * (meter_bit / 8);
+
+	while(frames > 0) {
+		unsigned int n = BLOCK_FRAMES - block_fill;
+		if(n > RUN) {
+			n = RUN;
+		}
+		if(n > frames) {
+			n = frames;
+		}
+
+		spread(src, meter_channels, n, rows, row_stride);
+		measure(&lanes, rows, row_stride, meter_channels, n);
+
+		src += n * frame_bytes;
+		frames -= n;
+		frames_measured += n;
+
+		block_fill += n;
+		if(block_fill == BLOCK_FRAMES) {
+			block_fill = 0;
+			finish_block();
+		}
+	}
+
+#ifdef AX_X86
+	_mm_setcsr(csr);
+#endif
+
+	busy_time += monotonic_us() - start;
+}
+
+// Lock free, returns false until the first block was measured
+bool AXMeterGet(AXMeterLevels* out)
+{
+	uint32_t seq;
+
+	do {
+		seq = __atomic_load_n(&levels_seq, __ATOMIC_ACQUIRE);
+		memcpy(out, &levels, sizeof(*out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while((seq & 1) || seq != __atomic_load_n(&levels_seq, __ATOMIC_RELAXED));
+
+	return out->blocks > 0;
+}
@@ -0,0 +1,254 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define	AX_X86
+#endif
+
+#include "deckview.h"
+
+// Channel routing and downmix of the captured audio to the sound card, on
+// ax_thread. Runs of up to RUN sample frames are spread into rows of floats
+// like for the meters, then every output sample frame is the sum of the
+// routed input channels, each broadcast and multiplied by its column of the
+// matrix: all outputs of a frame at once in one vector, inputs without a
+// route skipped. The vectors are stored whole and overlapping, each frame
+// overwriting the unused lanes of the one before.
+
+#define	RUN		256
+#define	LANES		AX_MAX_CHANNELS
+
+// "5.1": ITU stereo downmix of L, R, C, LFE, Ls, Rs on channels 1-6
+static const char* downmix_51 = "1+3*0.7071+5*0.7071,2+3*0.7071+6*0.7071";
+
+typedef void (*MixFunc)(const float* rows, unsigned int stride, unsigned int n, float* dst);
+
+static float rows[RUN * LANES] __attribute__((aligned(32)));
+static unsigned int row_stride;
+
+// the matrix by input, the outputs of an input side by side
+static float columns[AX_MAX_CHANNELS][AX_MAX_OUTPUTS] __attribute__((aligned(32)));
+static unsigned int routed[AX_MAX_CHANNELS];
+static unsigned int routed_count;
+
+static unsigned int mix_channels = 0;
+static unsigned int mix_bit;
+static unsigned int mix_outputs;
+static CXIsa mix_isa;
+static MixFunc mix;
+
+bool AXRouteParse(const char* spec, unsigned int channels, AXRoute* route)
+{
+	memset(route, 0, sizeof(*route));
+
+	if(!strcmp(spec, "5.1")) {
+		spec = downmix_51;
+	}
+
+	const char* p = spec;
+	while(*p) {
+		if(route->outputs == AX_MAX_OUTPUTS) {
+			printf("Audio routing %s: more than %u outputs\n", spec, AX_MAX_OUTPUTS);
+			return false;
+		}
+
+		// input[*gain] terms joined by +
+		for(;;) {
+			char* end;
+			long input = strtol(p, &end, 10);
+			if(end == p || input < 1 || input > (long) channels) {
+				printf("Audio routing %s: no input channel %.*s of %u\n", spec, (int) strcspn(p, ",+*"), p, channels);
+				return false;
+			}
+			p = end;
+
+			float gain = 1.0f;
+			if(*p == '*') {
+				gain = strtof(p + 1, &end);
+				if(end == p + 1) {
+					printf("Audio routing %s: bad gain\n", spec);
+					return false;
+				}
+				p = end;
+			}
+
+			route->gain[route->outputs][input - 1] += gain;
+
+			if(*p != '+') {
+				break;
+			}
+			p++;
+		}
+		route->outputs++;
+
+		if(*p == ',') {
+			p++;
+		} else if(*p) {
+			printf("Audio routing %s: unexpected %c\n", spec, *p);
+			return false;
+		}
+	}
+
+	if(!route->outputs) {
+		printf("Audio routing is empty\n");
+		return false;
+	}
+
+	return true;
+}
+
+void AXRoutePrint(const AXRoute* route, unsigned int channels)
+{
+	printf("Audio output: ");
+	for(unsigned int o = 0; o < route->outputs; o++) {
+		bool first = true;
+		for(unsigned int i = 0; i < channels; i++) {
+			float g = route->gain[o][i];
+			if(g == 0.0f) {
+				continue;
+			}
+
+			printf(first ? "%u" : "+%u", i + 1);
+			if(g != 1.0f) {
+				printf("*%.3g", g);
+			}
+			first = false;
+		}
+		printf(o + 1 < route->outputs ? ", " : "\n");
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar reference
+
+static void mix_scalar(const float* rows, unsigned int stride, unsigned int n, float* dst)
+{
+	for(unsigned int f = 0; f < n; f++) {
+		const float* row = rows + f * stride;
+		for(unsigned int o = 0; o < mix_outputs; o++) {
+			float sum = 0.0f;
+			for(unsigned int r = 0; r < routed_count; r++) {
+				unsigned int i = routed[r];
+				sum += row[i] * columns[i][o];
+			}
+			dst[f * mix_outputs + o] = sum;
+		}
+	}
+}
+
+#ifdef AX_X86
+////////////////////////////////////////////////////////////////////////////////
+// SSE4.1: up to four outputs per vector, two vectors for more
+
+__attribute__((target("sse4.1")))
+static void mix_sse41(const float* rows, unsigned int stride, unsigned int n, float* dst)
+{
+	bool wide = mix_outputs > 4;
+
+	for(unsigned int f = 0; f < n; f++) {
+		const float* row = rows + f * stride;
+		__m128 lo = _mm_setzero_ps();
+		__m128 hi = _mm_setzero_ps();
+
+		for(unsigned int r = 0; r < routed_count; r++) {
+			unsigned int i = routed[r];
+			__m128 x = _mm_set1_ps(row[i]);
+			lo = _mm_add_ps(lo, _mm_mul_ps(x, _mm_load_ps(columns[i])));
+			if(wide) {
+				hi = _mm_add_ps(hi, _mm_mul_ps(x, _mm_load_ps(columns[i] + 4)));
+			}
+		}
+
+		_mm_storeu_ps(dst + f * mix_outputs, lo);
+		if(wide) {
+			_mm_storeu_ps(dst + f * mix_outputs + 4, hi);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX2: all outputs in one vector
+
+__attribute__((target("avx2")))
+static void mix_avx2(const float* rows, unsigned int stride, unsigned int n, float* dst)
+{
+	for(unsigned int f = 0; f < n; f++) {
+		const float* row = rows + f * stride;
+		__m256 sum = _mm256_setzero_ps();
+
+		for(unsigned int r = 0; r < routed_count; r++) {
+			unsigned int i = routed[r];
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_broadcast_ss(row + i), _mm256_load_ps(columns[i])));
+		}
+
+		_mm256_storeu_ps(dst + f * mix_outputs, sum);
+	}
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+#ifdef AX_X86
+static const MixFunc mixes[CX_ISA_CNT] = { mix_scalar, mix_sse41, mix_avx2 };
+#else
+static const MixFunc mixes[CX_ISA_CNT] = { mix_scalar, mix_scalar, mix_scalar };
+#endif
+
+// Takes the sample format of the ring, 16 or 32 bit interleaved
+bool AXMixInit(unsigned int channels, unsigned int bit, const AXRoute* route, CXIsa isa)
+{
+	mix_channels = 0;
+
+	if(channels == 0 || channels > AX_MAX_CHANNELS || (bit != 16 && bit != 32) || route->outputs > AX_MAX_OUTPUTS) {
+		printf("Audio mixer: %u channels at %u bit are not supported\n", channels, bit);
+		return false;
+	}
+
+	if(!CXIsaSupported(isa)) {
+		isa = CX_ISA_SCALAR;
+	}
+
+	memset(columns, 0, sizeof(columns));
+	routed_count = 0;
+	for(unsigned int i = 0; i < channels; i++) {
+		bool used = false;
+		for(unsigned int o = 0; o < route->outputs; o++) {
+			columns[i][o] = route->gain[o][i];
+			used |= columns[i][o] != 0.0f;
+		}
+		if(used) {
+			routed[routed_count++] = i;
+		}
+	}
+
+	row_stride = (channels + 7) & ~7;
+	memset(rows, 0, sizeof(rows));
+
+	mix_isa = isa;
+	mix = mixes[isa];
+	mix_outputs = route->outputs;
+	mix_bit = bit;
+	mix_channels = channels;
+	return true;
+}
+
+// Mixes frames of captured audio into frames * outputs floats at dst, which
+// must have room for AX_MIX_PAD more
+void AXMix(const void* src, size_t frames, float* dst)
+{
+	const uint8_t* s = (const uint8_t*) src;
+	size_t frame_bytes = mix_channels * (mix_bit / 8);
+
+	while(frames > 0) {
+		unsigned int n = frames < RUN ? frames : RUN;
+
+		AXSpread(s, mix_channels, mix_bit, n, rows, row_stride, mix_isa);
+		mix(rows, row_stride, n, dst);
+
+		s += n * frame_bytes;
+		dst += n * mix_outputs;
+		frames -= n;
+	}
+}
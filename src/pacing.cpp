@@ -0,0 +1,283 @@
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GLFW/glfw3.h>
+
+#include "deckview.h"
+
+// Presentation scheduler. The input cadence is learned from the capture
+// timestamps of the frames, the display refresh rate is known from the
+// monitor. From the ratio of both a display strategy is chosen:
+//
+// - vsync:    input and display run at the same rate, present every frame
+//             on the next vsync
+// - interval: the display runs at an integer multiple n of the input rate,
+//             a swap interval of n shows every frame for exactly n vsyncs
+// - latch:    unrelated rates, sleep until just before the next vsync and
+//             present the newest frame at that point (late latching)
+//
+// Capture-to-swap latency is measured per frame with a timestamp query
+// issued right after the swap. The queries are read a few swaps later,
+// when they are available, so the CPU never waits for the GPU.
+
+#define	CADENCE_MIN_SAMPLES	16
+#define	CADENCE_TOLERANCE	0.002
+#define	LATCH_SAFETY		1000 /* us */
+#define	SWAP_QUERYCNT		4
+
+typedef struct {
+	GLuint	query;
+	bool	pending;
+	bool	new_frame;
+	int64_t	capture_time;
+	int64_t	latch_time;
+} SwapQuery;
+
+static GXPaceMode mode = GX_PACE_AUTO;
+static GXPaceMode strategy = GX_PACE_VSYNC;
+static int swap_interval = 1;
+static int64_t (*clock_fn)(void) = NULL;
+
+static double refresh_rate = 60.0;
+
+static int64_t last_arrival = -1;
+static double input_period = 0;
+static unsigned int input_samples = 0;
+static unsigned int input_fields = 1;	// pictures presented per input frame
+
+static int64_t last_vsync = -1;
+static int64_t latch_time = -1;
+static double render_budget = 2000;
+
+static SwapQuery swap_queries[SWAP_QUERYCNT];
+static unsigned int swap_query_idx = 0;
+
+static int64_t latency_last = 0;
+static int64_t latency_min = 0;
+static int64_t latency_max = 0;
+static double latency_sum = 0;
+static unsigned long latency_cnt = 0;
+
+const char* GXPaceModeName(GXPaceMode m)
+{
+	switch(m) {
+		case GX_PACE_AUTO:
+			return "auto";
+		case GX_PACE_VSYNC:
+			return "vsync";
+		case GX_PACE_INTERVAL:
+			return "interval";
+		case GX_PACE_LATCH:
+			return "latch";
+		default:
+			return "unknown";
+	}
+}
+
+void GXPaceInit(GXPaceMode m, double refresh, int64_t (*clock)(void))
+{
+	mode = m;
+	strategy = m == GX_PACE_AUTO ? GX_PACE_VSYNC : m;
+	clock_fn = clock;
+
+	if(refresh > 0) {
+		refresh_rate = refresh;
+	}
+
+	swap_interval = 1;
+	glfwSwapInterval(swap_interval);
+
+	for(unsigned int i = 0; i < SWAP_QUERYCNT; i++) {
+		glGenQueries(1, &swap_queries[i].query);
+		swap_queries[i].pending = false;
+	}
+}
+
+void GXPaceFrameArrived(int64_t arrival)
+{
+	if(last_arrival >= 0) {
+		double delta = arrival - last_arrival;
+
+		if(input_samples == 0) {
+			input_period = delta;
+			input_samples++;
+		} else if(delta > 0 && delta < input_period * 4) {
+			// gaps (signal loss, drops in the driver) are ignored
+			input_period += (delta - input_period) / CADENCE_MIN_SAMPLES;
+			input_samples++;
+		} else if(input_samples < CADENCE_MIN_SAMPLES) {
+			// not settled yet, a new format may have started
+			input_period = delta;
+			input_samples = 1;
+		}
+	}
+
+	last_arrival = arrival;
+}
+
+// Interlaced inputs shown field by field present two pictures per frame,
+// the strategy is chosen for that rate
+void GXPaceSetFields(unsigned int fields)
+{
+	input_fields = fields ? fields : 1;
+}
+
+static void set_swap_interval(int interval)
+{
+	if(interval != swap_interval) {
+		swap_interval = interval;
+		glfwSwapInterval(swap_interval);
+	}
+}
+
+static void choose_strategy(void)
+{
+	GXPaceMode next = mode;
+	int interval = 1;
+
+	if(input_samples >= CADENCE_MIN_SAMPLES && input_period > 0) {
+		double input_rate = 1000000.0 * input_fields / input_period;
+		double ratio = refresh_rate / input_rate;
+		double n = floor(ratio + 0.5);
+		bool locked = n >= 1 && fabs(ratio - n) < ratio * CADENCE_TOLERANCE;
+
+		if(mode == GX_PACE_AUTO) {
+			if(locked) {
+				next = n > 1 ? GX_PACE_INTERVAL : GX_PACE_VSYNC;
+			} else {
+				next = GX_PACE_LATCH;
+			}
+		}
+
+		if(next == GX_PACE_INTERVAL && locked) {
+			interval = (int) n;
+		}
+	} else if(mode == GX_PACE_AUTO) {
+		next = GX_PACE_VSYNC;
+	}
+
+	if(next != strategy || interval != swap_interval) {
+		printf("Pacing: input %.3f Hz", input_period > 0 ? 1000000.0 / input_period : 0.0);
+		if(input_fields > 1) {
+			printf(" by %u fields", input_fields);
+		}
+		printf(", display %.3f Hz, %s", refresh_rate, GXPaceModeName(next));
+		if(next == GX_PACE_INTERVAL) {
+			printf(" %d", interval);
+		}
+		printf("\n");
+	}
+
+	strategy = next;
+	set_swap_interval(interval);
+}
+
+GXPaceMode GXPaceStrategy(void)
+{
+	choose_strategy();
+	return strategy;
+}
+
+int64_t GXPaceLatchWait(void)
+{
+	int64_t now = clock_fn();
+	latch_time = now;
+
+	if(strategy != GX_PACE_LATCH || last_vsync < 0) {
+		return 0;
+	}
+
+	double period = 1000000.0 / refresh_rate;
+	double margin = render_budget * 1.5 + LATCH_SAFETY;
+
+	// next vsync that can still be reached with the render budget
+	double next = last_vsync + ceil((now - last_vsync + margin) / period) * period;
+	int64_t wait = (int64_t) (next - margin) - now;
+	if(wait <= 0) {
+		return 0;
+	}
+
+	latch_time = now + wait;
+	return wait;
+}
+
+// The GPU timestamp of the swap, related to the clock through the current
+// GPU time
+static void resolve_swap(SwapQuery* q)
+{
+	GLuint64 done;
+	GLint64 gpu_now;
+	glGetQueryObjectui64v(q->query, GL_QUERY_RESULT, &done);
+	glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+	int64_t now = clock_fn() - (gpu_now - (GLint64) done) / 1000;
+	q->pending = false;
+
+	if(now > last_vsync) {
+		last_vsync = now;
+	}
+
+	if(q->latch_time >= 0 && now > q->latch_time) {
+		render_budget += ((now - q->latch_time) - render_budget) / 8;
+	}
+
+	if(q->new_frame && q->capture_time > 0) {
+		int64_t latency = now - q->capture_time;
+		if(latency_cnt == 0 || latency < latency_min) {
+			latency_min = latency;
+		}
+		if(latency_cnt == 0 || latency > latency_max) {
+			latency_max = latency;
+		}
+		latency_last = latency;
+		latency_sum += latency;
+		latency_cnt++;
+	}
+}
+
+void GXPaceSwapped(bool new_frame, int64_t capture_time)
+{
+	// oldest first, up to the first the GPU hasn't reached yet
+	for(unsigned int i = 0; i < SWAP_QUERYCNT; i++) {
+		SwapQuery* q = &swap_queries[(swap_query_idx + i) % SWAP_QUERYCNT];
+		if(!q->pending) {
+			continue;
+		}
+
+		GLint available = 0;
+		glGetQueryObjectiv(q->query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available) {
+			break;
+		}
+		resolve_swap(q);
+	}
+
+	// only waits if the GPU is SWAP_QUERYCNT swaps behind
+	SwapQuery* q = &swap_queries[swap_query_idx];
+	if(q->pending) {
+		resolve_swap(q);
+	}
+
+	glQueryCounter(q->query, GL_TIMESTAMP);
+	q->pending = true;
+	q->new_frame = new_frame;
+	q->capture_time = capture_time;
+	q->latch_time = latch_time;
+	swap_query_idx = (swap_query_idx + 1) % SWAP_QUERYCNT;
+
+	latch_time = -1;
+}
+
+void GXPaceGetStats(GXPaceStats* stats)
+{
+	stats->input_rate = input_period > 0 ? 1000000.0 / input_period : 0;
+	stats->refresh_rate = refresh_rate;
+	stats->strategy = strategy;
+	stats->swap_interval = swap_interval;
+	stats->latency_last = latency_last;
+	stats->latency_min = latency_min;
+	stats->latency_max = latency_max;
+	stats->latency_avg = latency_cnt ? latency_sum / latency_cnt : 0;
+	stats->latency_cnt = latency_cnt;
+}
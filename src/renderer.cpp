@@ -5,7 +5,9 @@
 #include <GL/gl.h>
 #include <GL/glext.h>
 #include <GLFW/glfw3.h>
+#include <ctime>
 #include <signal.h>
+#include <unistd.h>
 #include <pthread.h>
 
 #include <DeckLinkAPI.h>
@@ -20,48 +22,116 @@ static int window_pos_x;
 static int window_pos_y;
 static bool is_fullscreen = false;
 
-static IDeckLink* device = NULL;
-static IDeckLinkInput* input = NULL;
-static DeckLinkCaptureDelegate* delegate = NULL;
+static unsigned int sample_depth = 16;
+static unsigned int audio_channels = 2;
+
+// Captured frames are handed to the renderer by reference: the capture
+// callback AddRefs each frame and publishes it into the ring, the renderer
+// moves them into its presentation queue, uploads them straight from the
+// DeckLink buffer when they are due and releases them. Frames the renderer
+// did not pick up in time are released and counted as dropped, so the
+// callback never has to wait. Ring and queue count against GX_FRAME_BUDGET.
+#define	FRAME_RINGCNT	GX_FRAME_RINGCNT
+
+// Presentation queue, only touched by the render thread. Frames are kept in
+// capture order until the audio clock says they are due. It holds no more
+// than the A/V delay needs (see queue_limit), FRAME_QUEUECNT at most.
+#define	FRAME_QUEUECNT	(GX_FRAME_BUDGET - GX_FRAME_RINGCNT)
+
+typedef struct {
+	IDeckLinkVideoInputFrame*	frame;
+	int64_t	pts;		// stream time in us
+	int64_t	duration;	// us
+	int64_t	capture;	// hardware reference time of arrival in us
+} QueuedFrame;
+
+// Everything belonging to one capture input. All inputs are tiled into the
+// same window and share the render loop, the shaders and the swap; each
+// only adds its own textures and uploads.
+struct GXInput {
+	unsigned int	index;
+	CaptureSource*	source;
+	DeckLinkCaptureDelegate*	delegate;
+	GXRenderer	renderer;
+
+	volatile BMDPixelFormat	pixel_format;
+	unsigned int	frame_depth;
+	unsigned int	frame_width;
+	unsigned int	frame_height;
+	double	frame_rate;
+	BMDFieldDominance	field_dominance;
+	volatile GXColorspace	mode_colorspace;
+
+	// field of the frame on screen, 0 for the first in time, and when the
+	// second is due (us, glfwGetTime), -1 if it isn't
+	unsigned int	field;
+	int64_t	field_due;
+
+	// frame_seq is bumped for every published frame, the render loop
+	// compares it to its read position to pick up new frames.
+	IDeckLinkVideoInputFrame*	frame_ring[FRAME_RINGCNT];
+	volatile uint64_t	frame_seq;
+	uint64_t	frame_ring_r;
+	volatile uint64_t	frames_dropped;
+
+	QueuedFrame	frame_queue[FRAME_QUEUECNT];
+	unsigned int	frame_queue_len;
+
+	int64_t	av_offset;
+	double	av_offset_sum;
+	unsigned long	av_offset_cnt;
+	int64_t	held_pts;
+	unsigned long	frames_repeated;
+
+	int64_t	presented_capture;
+
+	double	upload_time;
+	unsigned long	upload_count;
+};
 
-static IDeckLinkProfileAttributes* attributes = NULL;
-static IDeckLinkDisplayMode* display_mode = NULL;
+static GXInput inputs[GX_MAX_INPUTS];
+static unsigned int input_count = 0;
 
-static GXRenderer renderer = { 0 };
+static GXComposite composite;
+static GXComposeMode compose_mode = GX_COMPOSE_ARRAY;
 
-static volatile BMDPixelFormat pixel_format = bmdFormat8BitYUV;
-static const BMDVideoInputFlags input_flags = bmdVideoInputFlagDefault | bmdVideoInputEnableFormatDetection;
-static const unsigned int sample_depth = 16;
-static const unsigned int audio_channels = 2;
+static GXScopes scopes;
 
-static unsigned int frame_depth = 8;
-static unsigned int frame_width = 0;
-static unsigned int frame_height = 0;
-static void* frame = NULL;
-static size_t frame_size = 0;
+// Single frames drawn at another size: tiles, or the only input
+static GXScaler scaler;
 
-static float brightness = 1.0;
-static bool clear = true;
-static pthread_mutex_t mutex;
+// Interlaced inputs drawn as single frames. Both fields of a frame are shown
+// in turn if the display refreshes at least at the field rate.
+#define	FIELD_RATE_TOLERANCE	0.002
 
-extern "C" {
-extern const char yuv8_vert[];
-extern const char yuv8_frag[];
-extern const char yuv10_vert[];
-extern const char yuv10_frag[];
-}
+static GXDeinterlacer deinterlacer;
+static double display_rate = 0;
 
-static const float quad_vertices[] = {
-	-1.0f, -1.0f,  0.0f,
-	 1.0f, -1.0f,  0.0f,
-	 1.0f,  1.0f,  0.0f,
+// What -y asked for, the fields left at _CNT follow the signal
+static GXColorimetry forced_colorimetry;
 
-	 1.0f,  1.0f,  0.0f,
-	-1.0f,  1.0f,  0.0f,
-	-1.0f, -1.0f,  0.0f
-};
+// The input whose audio is played. Only its frames are synced to the audio
+// clock and drive the frame pacing, the others show their newest frame.
+static volatile unsigned int audio_input = 0;
+
+// The input whose capture thread feeds the audio ring, -1 while a switch is
+// handed over. The ring has a single producer: the old input gives it up at
+// the start of its next callback, after its last AXPlay returned, and only
+// then may the new one claim it.
+static int audio_owner = 0;
+
+// A/V sync state. Video is presented against the audio clock, frames are
+// dropped when late and held (repeated) when early, within av_tolerance.
+#define	AV_MAX_OFFSET	2000000 /* us */
 
-#define	QUAD_VTX_CNT	(sizeof(quad_vertices) / (sizeof(*quad_vertices) * 3))
+static int64_t av_tolerance = -1;
+static int64_t present_delay = 16667;
+static int64_t audio_latency = 0;
+static double title_time = 0;
+
+static float brightness = 1.0;
+static bool clear = true;
+static bool redraw = true;
 
 static void error_handler(int error, const char* description)
 {
@@ -75,12 +145,295 @@ static void sigfunc(int signum)
 	}
 }
 
+static void publish_frame(GXInput* in, IDeckLinkVideoInputFrame* video_frame)
+{
+	video_frame->AddRef();
+
+	uint64_t w = in->frame_seq;
+	IDeckLinkVideoInputFrame* old = __atomic_exchange_n(&in->frame_ring[w % FRAME_RINGCNT], video_frame, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&in->frame_seq, w + 1, __ATOMIC_RELEASE);
+
+	// the renderer did not consume this slot in time
+	if(old) {
+		old->Release();
+		__atomic_add_fetch(&in->frames_dropped, 1, __ATOMIC_RELAXED);
+	}
+
+	// wake up the render loop
+	glfwPostEmptyEvent();
+}
+
+static void drop_queued(GXInput* in, unsigned int cnt)
+{
+	for(unsigned int i = 0; i < cnt; i++) {
+		in->frame_queue[i].frame->Release();
+	}
+
+	memmove(&in->frame_queue[0], &in->frame_queue[cnt], (in->frame_queue_len - cnt) * sizeof(QueuedFrame));
+	in->frame_queue_len -= cnt;
+}
+
+// Clock the capture timestamps of the audio input's frames are related to
+static int64_t reference_time(void)
+{
+	return inputs[audio_input].source->ReferenceTime();
+}
+
+static int64_t time_us(void)
+{
+	return (int64_t) (glfwGetTime() * 1000000.0);
+}
+
+static bool interlaced(const GXInput* in)
+{
+	return in->field_dominance == bmdUpperFieldFirst || in->field_dominance == bmdLowerFieldFirst;
+}
+
+static bool deinterlaced(const GXInput* in)
+{
+	return interlaced(in) && deinterlacer.mode != GX_DEINTERLACE_WEAVE;
+}
+
+// A single input is scaled by the scaler unless it is set to bilinear,
+// which the array mipmaps do as well, and deinterlaced first so it keeps
+// the field rate. The array reduces the tiles of interlaced inputs from
+// their first fields, at frame rate.
+static bool composited(void)
+{
+	return compose_mode == GX_COMPOSE_ARRAY && (input_count > 1 || (scaler.mode == GX_SCALE_BILINEAR && !deinterlaced(&inputs[0])));
+}
+
+static bool field_rate(const GXInput* in)
+{
+	return deinterlaced(in) && !composited() && in->frame_rate > 0 && display_rate >= 2.0 * in->frame_rate * (1.0 - FIELD_RATE_TOLERANCE);
+}
+
+// The second field of the frame on screen is drawn half a field after the
+// first was swapped in, so its swap waits for the vsync a field later.
+// Returns whether it is due now, otherwise *wait is lowered to when it is.
+static bool next_field(GXInput* in, int64_t* wait)
+{
+	if(in->field_due < 0) {
+		return false;
+	}
+
+	int64_t early = in->field_due - time_us();
+	if(early > 0) {
+		if(early < *wait) {
+			*wait = early;
+		}
+		return false;
+	}
+
+	in->field = 1;
+	in->field_due = -1;
+	return true;
+}
+
+// Frames the presentation queue keeps: those arriving while the first one
+// waits for the audio output to catch up with it, rounded up, plus one. Inputs not
+// synced to the audio only show their newest frame. What the recorder and
+// exporter hold counts against the same budget.
+static unsigned int queue_limit(const GXInput* in)
+{
+	if(in->index != audio_input || av_tolerance < 0 || in->frame_rate <= 0) {
+		return 2;
+	}
+
+	unsigned int limit = (unsigned int) ((audio_latency + present_delay + av_tolerance) * in->frame_rate / 1000000.0) + 2;
+
+	unsigned int budget = FRAME_QUEUECNT;
+	if(in->index == 0) {
+		budget -= RXActive() ? RX_QUEUECNT : 0;
+		budget -= EXActive() ? EX_QUEUECNT : 0;
+	}
+
+	return limit < budget ? limit : budget;
+}
+
+// Move everything published since the last call into the presentation queue
+static void collect_frames(GXInput* in)
+{
+	uint64_t w = __atomic_load_n(&in->frame_seq, __ATOMIC_ACQUIRE);
+
+	if(w - in->frame_ring_r > FRAME_RINGCNT) {
+		in->frame_ring_r = w - FRAME_RINGCNT;
+	}
+
+	for(; in->frame_ring_r < w; in->frame_ring_r++) {
+		IDeckLinkVideoInputFrame** slot = &in->frame_ring[in->frame_ring_r % FRAME_RINGCNT];
+		IDeckLinkVideoInputFrame* f = __atomic_exchange_n(slot, (IDeckLinkVideoInputFrame*) NULL, __ATOMIC_ACQ_REL);
+		if(!f) {
+			continue;
+		}
+
+		// The producer bumps frame_seq before it writes the slot of the
+		// next lap, so unless frame_seq is still short of that lap the
+		// frame taken is the expected one. Otherwise it may be a newer
+		// one: it goes back for the next call to pick up in order, or is
+		// dropped if the slot was refilled meanwhile, as it is older than
+		// that frame either way.
+		if(__atomic_load_n(&in->frame_seq, __ATOMIC_ACQUIRE) >= in->frame_ring_r + FRAME_RINGCNT) {
+			IDeckLinkVideoInputFrame* empty = NULL;
+			if(!__atomic_compare_exchange_n(slot, &empty, f, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				f->Release();
+				__atomic_add_fetch(&in->frames_dropped, 1, __ATOMIC_RELAXED);
+			}
+			break;
+		}
+
+		unsigned int limit = queue_limit(in);
+		if(in->frame_queue_len >= limit) {
+			unsigned int cnt = in->frame_queue_len - limit + 1;
+			drop_queued(in, cnt);
+			__atomic_add_fetch(&in->frames_dropped, cnt, __ATOMIC_RELAXED);
+		}
+
+		BMDTimeValue pts;
+		BMDTimeValue duration;
+		if(f->GetStreamTime(&pts, &duration, 1000000) != S_OK) {
+			pts = 0;
+			duration = 0;
+		}
+
+		BMDTimeValue capture;
+		if(f->GetHardwareReferenceTimestamp(1000000, &capture, &duration) != S_OK) {
+			capture = in->source->ReferenceTime();
+		}
+
+		if(in->index == audio_input) {
+			GXPaceFrameArrived(capture);
+		}
+
+		QueuedFrame* q = &in->frame_queue[in->frame_queue_len++];
+		q->frame = f;
+		q->pts = pts;
+		q->duration = duration;
+		q->capture = capture;
+	}
+}
+
+// Pick the frame to present now. Returns NULL if the current frame should
+// stay on screen; *wait is lowered to the time until the next frame is due.
+static IDeckLinkVideoInputFrame* schedule_frame(GXInput* in, int64_t* wait)
+{
+	if(in->frame_queue_len == 0) {
+		return NULL;
+	}
+
+	int64_t clock;
+	int pick = in->frame_queue_len - 1;
+
+	if(in->index == audio_input && av_tolerance >= 0 && AXGetClock(&clock)) {
+		// the frame drawn now becomes visible with the next vsync
+		int64_t target = clock + present_delay;
+
+		pick = -1;
+		for(unsigned int i = 0; i < in->frame_queue_len; i++) {
+			if(in->frame_queue[i].pts <= target + av_tolerance) {
+				pick = i;
+			}
+		}
+
+		if(pick < 0) {
+			int64_t early = in->frame_queue[0].pts - target;
+
+			// Hold the current frame unless the queue is full or the
+			// clocks are too far apart to be related (stream restart)
+			if(in->frame_queue_len < queue_limit(in) && early < AV_MAX_OFFSET) {
+				if(in->held_pts != in->frame_queue[0].pts) {
+					in->held_pts = in->frame_queue[0].pts;
+					in->frames_repeated++;
+				}
+				if(early - av_tolerance < *wait) {
+					*wait = early - av_tolerance;
+				}
+				return NULL;
+			}
+
+			pick = 0;
+		}
+
+		in->av_offset = in->frame_queue[pick].pts - target;
+		in->av_offset_sum += in->av_offset;
+		in->av_offset_cnt++;
+	}
+
+	// everything older than the picked frame is late
+	__atomic_add_fetch(&in->frames_dropped, pick, __ATOMIC_RELAXED);
+	drop_queued(in, pick);
+
+	IDeckLinkVideoInputFrame* f = in->frame_queue[0].frame;
+	in->presented_capture = in->frame_queue[0].capture;
+	memmove(&in->frame_queue[0], &in->frame_queue[1], (in->frame_queue_len - 1) * sizeof(QueuedFrame));
+	in->frame_queue_len--;
+
+	return f;
+}
+
+static void update_title(void)
+{
+	double now = glfwGetTime();
+	if(now - title_time < 1.0) {
+		return;
+	}
+	title_time = now;
+
+	GXPaceStats pace;
+	GXPaceGetStats(&pace);
+
+	char title[192];
+	int len = snprintf(title, sizeof(title), "DeckLink View - %.2f Hz %s - latency %.1f ms", pace.input_rate, GXPaceModeName(pace.strategy), pace.latency_last / 1000.0);
+
+	if(input_count > 1) {
+		len += snprintf(title + len, sizeof(title) - len, " - %u inputs, audio %u", input_count, audio_input + 1);
+	}
+
+	AXStats audio;
+	AXGetStats(&audio);
+	if(audio.latency >= 0) {
+		len += snprintf(title + len, sizeof(title) - len, " - audio %.0f ms", audio.latency / 1000.0);
+		if(audio.drift_locked) {
+			len += snprintf(title + len, sizeof(title) - len, " %+.1f ppm", audio.drift);
+		}
+	}
+
+	if(RXActive()) {
+		RXStats rec;
+		RXGetStats(&rec);
+		len += snprintf(title + len, sizeof(title) - len, " - REC %s%lu dropped", rec.failed ? "FAILED " : "", rec.dropped);
+	}
+
+	const GXInput* in = &inputs[audio_input];
+	if(av_tolerance >= 0) {
+		if(in->av_offset_cnt) {
+			snprintf(title + len, sizeof(title) - len, " - A/V %+.1f ms", in->av_offset / 1000.0);
+		} else {
+			snprintf(title + len, sizeof(title) - len, " - A/V no audio clock");
+		}
+	}
+
+	glfwSetWindowTitle(window, title);
+}
+
+static void release_frames(GXInput* in)
+{
+	for(unsigned int i = 0; i < FRAME_RINGCNT; i++) {
+		IDeckLinkVideoInputFrame* f = __atomic_exchange_n(&in->frame_ring[i], (IDeckLinkVideoInputFrame*) NULL, __ATOMIC_ACQ_REL);
+		if(f) {
+			f->Release();
+		}
+	}
+
+	drop_queued(in, in->frame_queue_len);
+}
+
 HRESULT DeckLinkCaptureDelegate::VideoInputFormatChanged(BMDVideoInputFormatChangedEvents events, IDeckLinkDisplayMode* mode, BMDDetectedVideoInputFormatFlags format_flags)
 {
 	// This only gets called if bmdVideoInputEnableFormatDetection was set
 
-	BMDPixelFormat fmt = pixel_format;
-	unsigned int depth = frame_depth;
+	BMDPixelFormat fmt = input->pixel_format;
+	unsigned int depth = input->frame_depth;
 
 	if(events & bmdVideoInputColorspaceChanged) {
 		if(format_flags & bmdDetectedVideoInput8BitDepth) {
@@ -110,247 +463,466 @@ HRESULT DeckLinkCaptureDelegate::VideoInputFormatChanged(BMDVideoInputFormatChan
 		}
 	}
 
+	// the HDR transfer is only known from the frames
+	if(mode->GetFlags() & bmdDisplayModeColorspaceRec2020) {
+		input->mode_colorspace = GX_COLORSPACE_REC2020;
+	} else if(mode->GetFlags() & bmdDisplayModeColorspaceRec601) {
+		input->mode_colorspace = GX_COLORSPACE_REC601;
+	} else {
+		input->mode_colorspace = GX_COLORSPACE_REC709;
+	}
+
 	// Restart streams if either display mode or pixel format have changed
-	if((events & bmdVideoInputDisplayModeChanged) || (pixel_format != fmt)) {
+	if((events & bmdVideoInputDisplayModeChanged) || (input->pixel_format != fmt)) {
 		const char* display_mode_name;
 		mode->GetName(&display_mode_name);
-		printf("Video format changed to %s %s %d bit\n", display_mode_name, format_flags & bmdDetectedVideoInputRGB444 ? "RGB" : "YUV", depth);
+		printf("Input %u: video format changed to %s %s %d bit\n", input->index + 1, display_mode_name, format_flags & bmdDetectedVideoInputRGB444 ? "RGB" : "YUV", depth);
 		if(display_mode_name) {
 			free((void*) display_mode_name);
 		}
 
-		frame_width = mode->GetWidth();
-		frame_height = mode->GetHeight();
+		input->frame_width = mode->GetWidth();
+		input->frame_height = mode->GetHeight();
+		input->field_dominance = mode->GetFieldDominance();
+		input->field = 0;
+		input->field_due = -1;
 
-		if(!is_fullscreen) {
-			glfwSetWindowSize(window, frame_width, frame_height);
+		BMDTimeValue duration;
+		BMDTimeScale timescale;
+		if(mode->GetFrameRate(&duration, &timescale) == S_OK && duration > 0) {
+			input->frame_rate = (double) timescale / duration;
 		}
 
-		pthread_mutex_lock(&mutex);
-		switch(fmt) {
-			case bmdFormat8BitYUV:
-				frame_size = (frame_width * 16 / 8) * frame_height;
-				break;
-			case bmdFormat10BitYUV:
-				frame_size = ((frame_width + 47) / 48) * 128 * frame_height;
-				break;
-			case bmdFormat10BitRGB:
-				frame_size = ((frame_width + 63) / 64) * 256 * frame_height;
-				break;
-			default:
-				frame_size = 0;
-				break;
+		// a multiview keeps its window size
+		if(!is_fullscreen && input_count == 1) {
+			glfwSetWindowSize(window, input->frame_width, input->frame_height);
 		}
 
-		// resize framebuffer
-		if(frame) {
-			frame = realloc(frame, frame_size);
-		} else {
-			frame = malloc(frame_size);
+		input->pixel_format = fmt;
+		input->frame_depth = depth;
+
+		if(!input->source->SetVideoMode(mode, fmt)) {
+			fprintf(stderr, "Input %u: failed to switch video mode\n", input->index + 1);
+			goto bail;
 		}
 
-		memset(frame, 0, frame_size);
+		if(interlaced(input)) {
+			printf("Input %u: %s field first, deinterlacing %s\n", input->index + 1, input->field_dominance == bmdUpperFieldFirst ? "upper" : "lower", GXDeinterlaceModeName(deinterlacer.mode));
+		}
 
-		pixel_format = fmt;
-		frame_depth = depth;
-		pthread_mutex_unlock(&mutex);
+		if(input->index == 0) {
+			RXFormat(mode, fmt);
+			EXFormat(mode, fmt);
+		}
+	}
 
-		if(input) {
-			input->StopStreams();
+bail:
+	return S_OK;
+}
 
-			if(input->EnableVideoInput(mode->GetDisplayMode(), fmt, input_flags) != S_OK) {
-				fprintf(stderr, "Failed to switch video mode\n");
-				goto bail;
-			}
+// Called at the start of every callback. Returns true if this input owns
+// the audio ring for the rest of it.
+static bool claim_audio(unsigned int index)
+{
+	int owner = __atomic_load_n(&audio_owner, __ATOMIC_ACQUIRE);
+	bool selected = index == audio_input;
 
-			input->StartStreams();
+	if(owner == (int) index) {
+		if(!selected) {
+			__atomic_store_n(&audio_owner, -1, __ATOMIC_RELEASE);
 		}
+		return selected;
 	}
 
-bail:
-	return S_OK;
+	return owner < 0 && selected && __atomic_compare_exchange_n(&audio_owner, &owner, (int) index, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
 }
 
 HRESULT DeckLinkCaptureDelegate::VideoInputFrameArrived(IDeckLinkVideoInputFrame* video_frame, IDeckLinkAudioInputPacket* audio_frame)
 {
+	// also the only thread writing the arrival, callback and audio copy
+	// histograms
+	bool primary = claim_audio(input->index);
+
+	int64_t start = 0;
+	if(GXStatsActive()) {
+		start = GXStatsTime();
+		if(primary) {
+			GXStatsArrival(start);
+		}
+	}
+
+	bool has_signal = video_frame && !(video_frame->GetFlags() & bmdFrameHasNoInputSource);
+
 	if(video_frame) {
-		if(video_frame->GetFlags() & bmdFrameHasNoInputSource) {
+		if(!has_signal) {
 			// TODO: maybe blank the video output in this case?
 			// printf("No input signal detected\n");
 		} else {
-			void* frame_bytes;
-			video_frame->GetBytes(&frame_bytes);
-
-			const size_t size = video_frame->GetRowBytes() * video_frame->GetHeight();
-			if(frame) {
-				if(frame_size < size) {
-					printf("fail! %lu vs %lu\n", frame_size, size);
-				} else {
-					pthread_mutex_lock(&mutex);
-					memcpy(frame, frame_bytes, size);
-					pthread_mutex_unlock(&mutex);
-				}
-			}
+			publish_frame(input, video_frame);
 		}
 	}
 
-	if(audio_frame) {
+	// only queue, the writer and export threads do the copies
+	if(input->index == 0) {
+		RXFrame(has_signal ? video_frame : NULL, audio_frame);
+		EXFrame(has_signal ? video_frame : NULL, audio_frame);
+	}
+
+	if(audio_frame && primary) {
 		void* frame_bytes;
 		audio_frame->GetBytes(&frame_bytes);
 		size_t size = audio_frame->GetSampleFrameCount() * audio_channels * (sample_depth / 8);
-		AXPlay(frame_bytes, size);
+
+		BMDTimeValue packet_time;
+		if(audio_frame->GetPacketTime(&packet_time, bmdAudioSampleRate48kHz) != S_OK) {
+			packet_time = 0;
+		}
+
+		if(start) {
+			int64_t copy_start = GXStatsTime();
+			AXPlay(frame_bytes, size, packet_time);
+			GXStatsRecord(GX_STAT_AUDIO_COPY, GXStatsTime() - copy_start);
+		} else {
+			AXPlay(frame_bytes, size, packet_time);
+		}
+	}
+
+	if(start && primary) {
+		GXStatsRecord(GX_STAT_CALLBACK, GXStatsTime() - start);
 	}
 
 	return S_OK;
 }
 
-bool GXInitDeckLink(IDeckLink* device)
+
+// Colorspace of the display mode unless the frame's HDR metadata tells
+// otherwise. Range isn't signalled, video levels are assumed. A change only
+// picks another unpack variant.
+static void detect_colorimetry(GXInput* in, IDeckLinkVideoInputFrame* video_frame)
 {
-	int64_t duplex_mode;
-	bool format_detection_supported;
-	bool supported;
+	GXColorimetry c;
+	c.colorspace = in->mode_colorspace;
+	c.range = GX_RANGE_LIMITED;
+	c.transfer = GX_TRANSFER_SDR;
+
+	IDeckLinkVideoFrameMetadataExtensions* metadata = NULL;
+	if((video_frame->GetFlags() & bmdFrameContainsHDRMetadata) && video_frame->QueryInterface(IID_IDeckLinkVideoFrameMetadataExtensions, (void**) &metadata) == S_OK) {
+		int64_t value;
+		if(metadata->GetInt(bmdDeckLinkFrameMetadataColorspace, &value) == S_OK) {
+			switch(value) {
+				case bmdColorspaceRec601:
+					c.colorspace = GX_COLORSPACE_REC601;
+					break;
+				case bmdColorspaceRec709:
+					c.colorspace = GX_COLORSPACE_REC709;
+					break;
+				case bmdColorspaceRec2020:
+					c.colorspace = GX_COLORSPACE_REC2020;
+					break;
+			}
+		}
 
-	if(device->QueryInterface(IID_IDeckLinkProfileAttributes, (void**)&attributes) != S_OK) {
-		fprintf(stderr, "Unable to get DeckLink attributes interface\n");
-		return false;
+		// CTA-861.3: 2 is SMPTE ST 2084, 3 HLG
+		if(metadata->GetInt(bmdDeckLinkFrameMetadataHDRElectroOpticalTransferFunc, &value) == S_OK) {
+			if(value == 2) {
+				c.transfer = GX_TRANSFER_PQ;
+			} else if(value == 3) {
+				c.transfer = GX_TRANSFER_HLG;
+			}
+		}
+
+		metadata->Release();
 	}
 
-	// Check the DeckLink device is active
-	if(attributes->GetInt(BMDDeckLinkDuplex, &duplex_mode) != S_OK) {
-		fprintf(stderr, "The selected DeckLink device is inactive\n");
-		return false;
+	if(forced_colorimetry.colorspace != GX_COLORSPACE_CNT) {
+		c.colorspace = forced_colorimetry.colorspace;
+	}
+	if(forced_colorimetry.range != GX_RANGE_CNT) {
+		c.range = forced_colorimetry.range;
+	}
+	if(forced_colorimetry.transfer != GX_TRANSFER_CNT) {
+		c.transfer = forced_colorimetry.transfer;
 	}
 
-	if(duplex_mode == bmdDuplexInactive) {
-		fprintf(stderr, "The selected DeckLink device is inactive\n");
-		return false;
+	GXColorimetry* current = &in->renderer.colorimetry;
+	if(c.colorspace != current->colorspace || c.range != current->range || c.transfer != current->transfer) {
+		printf("Input %u: colorimetry %s %s %s\n", in->index + 1, GXColorspaceName(c.colorspace), GXRangeName(c.range), GXTransferName(c.transfer));
+		GXSetColorimetry(&in->renderer, &c);
 	}
+}
 
-	// Get the input (capture) interface of the DeckLink device
-	if(device->QueryInterface(IID_IDeckLinkInput, (void**) &input) != S_OK) {
-		fprintf(stderr, "The selected device does not have an input interface\n");
-		return false;
+static void upload_frame(GXInput* in, IDeckLinkVideoInputFrame* video_frame)
+{
+	detect_colorimetry(in, video_frame);
+
+	void* frame_bytes;
+	video_frame->GetBytes(&frame_bytes);
+
+	double start = glfwGetTime();
+	GXUploadFrame(&in->renderer, video_frame->GetPixelFormat(), video_frame->GetWidth(), video_frame->GetHeight(), video_frame->GetRowBytes(), frame_bytes);
+	double elapsed = glfwGetTime() - start;
+	in->upload_time += elapsed;
+	in->upload_count++;
+
+	if(GXStatsActive()) {
+		GXStatsRecord(GX_STAT_UPLOAD, (int64_t) (elapsed * 1000000.0));
 	}
+}
 
-	// Check the card supports format detection
-	if(attributes->GetFlag(BMDDeckLinkSupportsInputFormatDetection, &format_detection_supported) != S_OK) {
-		fprintf(stderr, "Format detection is not supported on this device\n");
-		return false;
+static void print_upload_stats(void)
+{
+	for(unsigned int i = 0; i < input_count; i++) {
+		GXInput* in = &inputs[i];
+		if(in->upload_count) {
+			printf("Input %u: upload (%s): %.3f ms average over %lu frames\n", i + 1, GXUploadModeName(in->renderer.upload_mode), in->upload_time * 1000.0 / in->upload_count, in->upload_count);
+		}
+
+		in->upload_time = 0;
+		in->upload_count = 0;
 	}
+}
 
-	if(!format_detection_supported) {
-		fprintf(stderr, "Format detection is not supported on this device\n");
-		return false;
+// Stops the recording if there is one, the sources must be stopped
+static void print_record_stats(void)
+{
+	if(!RXActive()) {
+		return;
 	}
 
-	// For format detection mode, use 1080p30 as default mode to start with
-	if(input->GetDisplayMode(bmdModeHD1080p30, &display_mode) != S_OK) {
-		fprintf(stderr, "Unable to get display mode\n");
-		return false;
+	RXStop();
+
+	RXStats rec;
+	RXGetStats(&rec);
+
+	printf("Recorded %lu frames, %.2f GB video, %.1f MB audio (%s I/O)\n", rec.frames, rec.video_bytes / 1e9, rec.audio_bytes / 1e6, rec.direct ? "direct" : "buffered");
+	if(rec.write_time > 0) {
+		printf("Recording: %.0f MB/s while writing, %lu frames dropped, %lu audio packets cut short, queue peak %u/%u\n", rec.video_bytes / (double) rec.write_time, rec.dropped, rec.audio_dropped, rec.queue_max, rec.queue_size);
 	}
+	if(rec.skipped) {
+		printf("Recording: %lu frames skipped, the format changed\n", rec.skipped);
+	}
+}
 
-	if(display_mode == NULL) {
-		fprintf(stderr, "Unable to get display mode\n");
-		return false;
+// Stops the export if there is one, the sources must be stopped
+static void print_export_stats(void)
+{
+	if(!EXActive()) {
+		return;
 	}
 
-	// Check display mode is supported with given options
-	if(input->DoesSupportVideoMode(bmdVideoConnectionUnspecified, display_mode->GetDisplayMode(), pixel_format, bmdNoVideoInputConversion, bmdSupportedVideoModeDefault, NULL, &supported) != S_OK) {
-		fprintf(stderr, "The display mode is not supported with the selected pixel format\n");
-		return false;
+	EXStop();
+
+	EXStats ex;
+	EXGetStats(&ex);
+
+	printf("Exported %lu frames to shared memory, %lu dropped", ex.frames, ex.dropped);
+	if(ex.frames) {
+		printf(", %.3f ms copy per frame", ex.copy_time / 1000.0 / ex.frames);
+	}
+	printf("\n");
+	if(ex.oversize) {
+		printf("Export: %lu frames too large for a slot, published without video\n", ex.oversize);
 	}
+}
 
-	if(!supported) {
-		fprintf(stderr, "The display mode is not supported with the selected pixel format\n");
-		return false;
+static void toggle_upload_mode(void)
+{
+	print_upload_stats();
+
+	GXUploadMode mode = inputs[0].renderer.upload_mode == GX_UPLOAD_DIRECT ? GX_UPLOAD_PBO : GX_UPLOAD_DIRECT;
+	for(unsigned int i = 0; i < input_count; i++) {
+		GXSetUploadMode(&inputs[i].renderer, mode);
 	}
 
-	delegate = new DeckLinkCaptureDelegate();
-	input->SetCallback(delegate);
+	printf("Upload mode: %s\n", GXUploadModeName(inputs[0].renderer.upload_mode));
+}
 
-	return true;
+static void select_audio_input(unsigned int index)
+{
+	if(index >= input_count || index == audio_input) {
+		return;
+	}
+
+	audio_input = index;
+	printf("Audio from input %u\n", index + 1);
 }
 
-#ifdef NDEBUG
-#define	GL_ERROR()
-#else
-#define	GL_ERROR()	check_error(__FILE__, __LINE__)
+// Moves all played back inputs together, by whole frames of each
+static void seek(double seconds, int64_t frames)
+{
+	for(unsigned int i = 0; i < input_count; i++) {
+		GXInput* in = &inputs[i];
+		if(seconds == 0) {
+			in->source->Seek(frames, frames != 0);
+		} else {
+			in->source->Seek((int64_t) (seconds * in->frame_rate), true);
+		}
+	}
+}
 
-void check_error(const char* filename, unsigned int line)
+// Tiles are laid out in a grid as close to square as possible, row by row
+// from the top left
+static void tile_rect(unsigned int index, int width, int height, int* x, int* y, int* w, int* h)
 {
-	GLenum error = glGetError();
-	switch(error) {
-		case GL_NO_ERROR:
-			break;
-		case GL_INVALID_ENUM:
-			printf("%s:%u: Error: GL_INVALID_ENUM\n", filename, line);
-			break;
-		case GL_INVALID_VALUE:
-			printf("%s:%u: Error: GL_INVALID_VALUE\n", filename, line);
-			break;
-		case GL_INVALID_OPERATION:
-			printf("%s:%u: Error: GL_INVALID_OPERATION\n", filename, line);
-			break;
-		case GL_INVALID_FRAMEBUFFER_OPERATION:
-			printf("%s:%u: Error: GL_INVALID_FRAMEBUFFER_OPERATION\n", filename, line);
-			break;
-		case GL_OUT_OF_MEMORY:
-			printf("%s:%u: Error: GL_OUT_OF_MEMORY\n", filename, line);
-			exit(1);
-			break;
-		case GL_STACK_UNDERFLOW:
-			printf("%s:%u: Error: GL_STACK_UNDERFLOW\n", filename, line);
-			break;
-		case GL_STACK_OVERFLOW:
-			printf("%s:%u: Error: GL_STACK_OVERFLOW\n", filename, line);
-			break;
-		default:
-			printf("%s:%u: Unknown error 0x%X\n", filename, line, error);
+	unsigned int cols = 1;
+	while(cols * cols < input_count) {
+		cols++;
 	}
+	unsigned int rows = (input_count + cols - 1) / cols;
+
+	unsigned int col = index % cols;
+	unsigned int row = index / cols;
+
+	*x = width * col / cols;
+	*w = width * (col + 1) / cols - *x;
+	*y = height - height * (row + 1) / rows;
+	*h = height * (row + 1) / rows - height * row / rows;
 }
-#endif
 
-void GXRender(int width, int height)
+static void render_input(GXInput* in, int width, int height)
 {
-	GXRenderer* self = &renderer;
+	GXRenderer* self = &in->renderer;
 
-	bool interpolate = width != (int) frame_width || height != (int) frame_height;
+	int x, y, w, h;
+	tile_rect(in->index, width, height, &x, &y, &w, &h);
+	glViewport(x, y, w, h);
 
-	switch(pixel_format) {
-		case bmdFormat8BitYUV:
-			glUseProgram(self->yuv8_shader);
+	// the field shown: the first of every frame, and the second when it
+	// is due; the upper one holds the even lines
+	if(deinterlaced(in)) {
+		unsigned int first = in->field_dominance == bmdLowerFieldFirst ? 1 : 0;
+		GXDeinterlacerDraw(&deinterlacer, in->index, self, first ^ in->field, in->field == 0);
+	} else {
+		self->shown = self->unpacked;
+	}
 
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, self->frame);
-			glUniform1i(self->yuv8_shader_tex, 0);
-			glUniform1f(self->yuv8_shader_brightness, brightness);
-			glUniform1f(self->yuv8_shader_interpolate, interpolate);
+	if(w == (int) self->frame_width && h == (int) self->frame_height) {
+		GXDraw(self, false, brightness);
+	} else {
+		GXScalerDraw(&scaler, in->index, self, brightness);
+	}
+}
 
-			pthread_mutex_lock(&mutex);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame_width / 2, frame_height, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, (GLvoid*) frame);
-			pthread_mutex_unlock(&mutex);
-			break;
+// All inputs at once from the texture array, each reduced to its tile size
+static void render_composite(int width, int height)
+{
+	GXTile tiles[GX_MAX_INPUTS];
+
+	for(unsigned int i = 0; i < input_count; i++) {
+		GXInput* in = &inputs[i];
+		GXTile* t = &tiles[i];
+		tile_rect(i, width, height, &t->x, &t->y, &t->width, &t->height);
+
+		// a new frame of an interlaced input is deinterlaced before its
+		// layer is reduced from the field, the field stays shown until
+		// the next one
+		if(!deinterlaced(in)) {
+			in->renderer.shown = in->renderer.unpacked;
+		} else if(in->renderer.unpack_pending) {
+			unsigned int first = in->field_dominance == bmdLowerFieldFirst ? 1 : 0;
+			GXDeinterlacerDraw(&deinterlacer, i, &in->renderer, first, true);
+		}
+		GXCompositeUnpack(&composite, i, &in->renderer, t);
+	}
 
-		case bmdFormat10BitYUV:
-			glUseProgram(self->yuv10_shader);
-
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, self->frame);
-			glUniform1i(self->yuv10_shader_tex, 0);
-			glUniform2i(self->yuv10_shader_size, frame_width, frame_height);
-			glUniform1f(self->yuv10_shader_brightness, brightness);
-			glUniform1f(self->yuv10_shader_interpolate, interpolate);
-
-			pthread_mutex_lock(&mutex);
-			int tex_width = ((frame_width + 47) / 48) * 128 / 4;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, tex_width, frame_height, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, (GLvoid*) frame);
-			pthread_mutex_unlock(&mutex);
-			GL_ERROR();
-			break;
+	GXCompositeDraw(&composite, tiles, input_count, brightness);
+}
+
+static void toggle_compose_mode(void)
+{
+	compose_mode = compose_mode == GX_COMPOSE_ARRAY ? GX_COMPOSE_TILES : GX_COMPOSE_ARRAY;
+
+	printf("Compositing: %s\n", GXComposeModeName(compose_mode));
+}
+
+static void print_scale_stats(GXScaleMode mode)
+{
+	GXScaleStats st;
+	GXScalerGetStats(&scaler, mode, &st);
+	if(!st.count) {
+		return;
+	}
+
+	printf("Scaling %s: %.3f ms GPU per draw over %lu, %.3f ms per frame over %lu\n", GXScaleModeName(mode), st.gpu_ms, st.count, st.frame_ms, st.frames);
+}
+
+static void cycle_scale_mode(void)
+{
+	print_scale_stats(scaler.mode);
+	GXScalerSetMode(&scaler, (GXScaleMode) ((scaler.mode + 1) % GX_SCALE_CNT));
+
+	printf("Scaling: %s\n", GXScaleModeName(scaler.mode));
+}
+
+static void print_deinterlace_stats(GXDeinterlaceMode mode)
+{
+	GXDeinterlaceStats st;
+	GXDeinterlacerGetStats(&deinterlacer, mode, &st);
+	if(!st.count) {
+		return;
+	}
+
+	printf("Deinterlacing %s: %.3f ms GPU per field over %lu\n", GXDeinterlaceModeName(mode), st.gpu_ms, st.count);
+}
+
+static void cycle_deinterlace_mode(void)
+{
+	print_deinterlace_stats(deinterlacer.mode);
+	GXDeinterlacerSetMode(&deinterlacer, (GXDeinterlaceMode) ((deinterlacer.mode + 1) % GX_DEINTERLACE_CNT));
+
+	printf("Deinterlacing: %s\n", GXDeinterlaceModeName(deinterlacer.mode));
+}
+
+static void print_scope_stats(GXScope scope)
+{
+	GXScopeStats st;
+	GXScopesGetStats(&scopes, scope, &st);
+	if(!st.draw_count) {
+		return;
+	}
+
+	printf("Scope %s: %u samples, %.3f ms GPU per new frame over %lu, %.3f ms GPU per draw over %lu\n", GXScopeName(scope), st.samples, st.scatter_ms, st.scatter_count, st.draw_ms, st.draw_count);
+}
+
+static void toggle_scope(GXScope scope)
+{
+	if(!GXScopesToggle(&scopes, scope)) {
+		print_scope_stats(scope);
+	}
+
+	printf("Scope %s: %s\n", GXScopeName(scope), GXScopesEnabled(&scopes, scope) ? "on" : "off");
+}
+
+// The scopes of the audio input sit side by side along the bottom, each in
+// a quarter of the width, the vectorscope square
+static void render_scopes(int width, int height)
+{
+	bool any = false;
+	for(unsigned int i = 0; i < GX_SCOPE_CNT; i++) {
+		any |= GXScopesEnabled(&scopes, (GXScope) i);
+	}
+	if(!any) {
+		return;
 	}
 
-	glBindVertexArray(self->quad_vao);
-	glDrawArrays(GL_TRIANGLES, 0, QUAD_VTX_CNT);
+	int w = width / GX_SCOPE_CNT;
+	int h = height / 3 < w ? height / 3 : w;
+
+	GXTile rects[GX_SCOPE_CNT];
+	for(unsigned int i = 0; i < GX_SCOPE_CNT; i++) {
+		GXTile* r = &rects[i];
+		r->x = w * i;
+		r->y = 0;
+		r->width = i == GX_SCOPE_VECTORSCOPE ? h : w;
+		r->height = h;
+	}
+
+	GXScopesRender(&scopes, &inputs[audio_input].renderer, rects);
+}
+
+static void refresh_handler(GLFWwindow* window)
+{
+	redraw = true;
 }
 
 static bool get_monitor(GLFWmonitor** monitor, GLFWwindow* window)
@@ -470,8 +1042,8 @@ static void exit_fullscreen(void)
 	glfwSetWindowAttrib(window, GLFW_DECORATED, GLFW_TRUE);
 	glfwSetWindowAttrib(window, GLFW_FLOATING, GLFW_FALSE);
 
-	if(frame_width > 0 && frame_height > 0) {
-		glfwSetWindowSize(window, frame_width, frame_height);
+	if(input_count == 1 && inputs[0].frame_width > 0 && inputs[0].frame_height > 0) {
+		glfwSetWindowSize(window, inputs[0].frame_width, inputs[0].frame_height);
 	} else {
 		glfwSetWindowSize(window, SCREEN_WIDTH, SCREEN_HEIGHT);
 	}
@@ -492,6 +1064,8 @@ static void toggle_fullscreen(void)
 static void key_handler(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	if(action == GLFW_PRESS) {
+		redraw = true;
+
 		switch(key) {
 			case GLFW_KEY_F2:
 				toggle_fullscreen();
@@ -511,25 +1085,114 @@ static void key_handler(GLFWwindow* window, int key, int scancode, int action, i
 			case GLFW_KEY_C:
 				clear = !clear;
 				break;
+			case GLFW_KEY_U:
+				toggle_upload_mode();
+				break;
+			case GLFW_KEY_I:
+				GXStatsToggleOverlay();
+				break;
+			case GLFW_KEY_A:
+				GXStatsToggleMeters();
+				break;
+			case GLFW_KEY_M:
+				toggle_compose_mode();
+				break;
+			case GLFW_KEY_S:
+				cycle_scale_mode();
+				break;
+			case GLFW_KEY_D:
+				cycle_deinterlace_mode();
+				break;
+			case GLFW_KEY_W:
+				toggle_scope(GX_SCOPE_WAVEFORM);
+				break;
+			case GLFW_KEY_P:
+				toggle_scope(GX_SCOPE_PARADE);
+				break;
+			case GLFW_KEY_V:
+				toggle_scope(GX_SCOPE_VECTORSCOPE);
+				break;
+			case GLFW_KEY_H:
+				toggle_scope(GX_SCOPE_HISTOGRAM);
+				break;
+			case GLFW_KEY_LEFT:
+				seek(-5.0, 0);
+				break;
+			case GLFW_KEY_RIGHT:
+				seek(5.0, 0);
+				break;
+			case GLFW_KEY_DOWN:
+				seek(-60.0, 0);
+				break;
+			case GLFW_KEY_UP:
+				seek(60.0, 0);
+				break;
+			case GLFW_KEY_COMMA:
+				seek(0, -1);
+				break;
+			case GLFW_KEY_PERIOD:
+				seek(0, 1);
+				break;
+			case GLFW_KEY_HOME:
+				seek(0, 0);
+				break;
+			case GLFW_KEY_1:
+			case GLFW_KEY_2:
+			case GLFW_KEY_3:
+			case GLFW_KEY_4:
+			case GLFW_KEY_5:
+			case GLFW_KEY_6:
+			case GLFW_KEY_7:
+			case GLFW_KEY_8:
+			case GLFW_KEY_9:
+				select_audio_input(key - GLFW_KEY_1);
+				break;
 		}
 	}
 }
 
-bool GXInit(IDeckLink* dev)
+bool GXInit(CaptureSource** sources, unsigned int count, const GXConfig* config)
 {
-	device = dev;
+	if(count < 1 || count > GX_MAX_INPUTS) {
+		printf("Between 1 and %u inputs are supported\n", GX_MAX_INPUTS);
+		return false;
+	}
 
-	pthread_mutex_init(&mutex, NULL);
+	audio_channels = config->audio_channels;
+	audio_latency = config->audio_latency;
+	sample_depth = config->audio_depth;
 
-	if(!AXInit(audio_channels, sample_depth)) {
-		printf("Failed to initialize audio\n");
+	AXRoute route;
+	if(!AXRouteParse(config->audio_route, audio_channels, &route)) {
 		return false;
 	}
 
-	if(!GXInitDeckLink(device)) {
+	printf("Audio capture: %u channels, %u bit\n", audio_channels, sample_depth);
+	AXRoutePrint(&route, audio_channels);
+
+	if(!AXInit(audio_channels, sample_depth, &route, config->audio_output, config->audio_latency, config->audio_drift)) {
+		printf("Failed to initialize audio\n");
 		return false;
 	}
 
+	for(unsigned int i = 0; i < count; i++) {
+		GXInput* in = &inputs[i];
+		in->index = i;
+		in->source = sources[i];
+		in->pixel_format = bmdFormat8BitYUV;
+		in->frame_depth = 8;
+		in->held_pts = -1;
+		in->field_dominance = bmdProgressiveFrame;
+		in->mode_colorspace = GX_COLORSPACE_REC709;
+		in->field_due = -1;
+		in->delegate = new DeckLinkCaptureDelegate(in);
+		input_count++;
+
+		if(!in->source->Init(in->delegate, in->pixel_format)) {
+			return false;
+		}
+	}
+
 	glfwSetErrorCallback(error_handler);
 	if(!glfwInit()) {
 		printf("Failed to initialize GLFW\n");
@@ -549,6 +1212,7 @@ bool GXInit(IDeckLink* dev)
 	signal(SIGTERM, sigfunc);
 
 	glfwSetKeyCallback(window, key_handler);
+	glfwSetWindowRefreshCallback(window, refresh_handler);
 
 	glfwMakeContextCurrent(window);
 	glfwSwapInterval(1);
@@ -565,7 +1229,51 @@ bool GXInit(IDeckLink* dev)
 
 	glClearColor(0.0, 0.0, 0.0, 0.0);
 
-	GXRendererInit(&renderer);
+	// the first input compiles the shaders, the others share them
+	for(unsigned int i = 0; i < input_count; i++) {
+		GXRendererInit(&inputs[i].renderer, i ? &inputs[0].renderer : NULL);
+		GXSetUploadMode(&inputs[i].renderer, config->upload_mode);
+	}
+	printf("Upload mode:  %s\n", GXUploadModeName(inputs[0].renderer.upload_mode));
+
+	GXCompositeInit(&composite, &inputs[0].renderer, input_count);
+	compose_mode = config->compose_mode;
+	printf("Compositing:  %s\n", GXComposeModeName(compose_mode));
+
+	GXScopesInit(&scopes, &inputs[0].renderer);
+
+	GXScalerInit(&scaler, &inputs[0].renderer, config->scale_mode, GX_SCALE_BUDGET);
+	printf("Scaling:      %s\n", GXScaleModeName(scaler.mode));
+
+	forced_colorimetry = config->colorimetry;
+	printf("Colorimetry:  %s %s %s\n", GXColorspaceName(forced_colorimetry.colorspace), GXRangeName(forced_colorimetry.range), GXTransferName(forced_colorimetry.transfer));
+
+	GXDeinterlacerInit(&deinterlacer, &inputs[0].renderer, config->deinterlace_mode);
+	printf("Deinterlace:  %s\n", GXDeinterlaceModeName(deinterlacer.mode));
+
+	if(!GXStatsInit(config->stats_csv)) {
+		return false;
+	}
+
+	av_tolerance = config->av_tolerance;
+
+	if(config->record_path && !RXStart(config->record_path, audio_channels, sample_depth)) {
+		return false;
+	}
+
+	if(config->export_name && !EXStart(config->export_name, audio_channels, sample_depth)) {
+		RXStop();
+		return false;
+	}
+
+	const GLFWvidmode* vidmode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+	if(vidmode && vidmode->refreshRate > 0) {
+		display_rate = vidmode->refreshRate;
+		present_delay = 1000000 / vidmode->refreshRate;
+	}
+
+	GXPaceInit(config->pace_mode, display_rate, reference_time);
+
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	return true;
@@ -573,31 +1281,80 @@ bool GXInit(IDeckLink* dev)
 
 void GXMain(void)
 {
-	if(input) {
-		if(input->EnableVideoInput(display_mode->GetDisplayMode(), pixel_format, input_flags) != S_OK) {
-			fprintf(stderr, "Failed to enable video input. Is another application using the card?\n");
-			glfwSetWindowShouldClose(window, GLFW_TRUE);
-		}
-
-		if(input->EnableAudioInput(bmdAudioSampleRate48kHz, sample_depth, audio_channels) != S_OK) {
-			fprintf(stderr, "Failed to enable audio input. Is another application using the card?\n");
-			glfwSetWindowShouldClose(window, GLFW_TRUE);
-		}
-
-		if(input->StartStreams() != S_OK) {
-			fprintf(stderr, "Failed to start streams\n");
+	// Format detection only reports modes other than the one the input
+	// starts with, a signal already in that mode is never reported
+	RXFormat(inputs[0].source->StartMode(), inputs[0].pixel_format);
+	EXFormat(inputs[0].source->StartMode(), inputs[0].pixel_format);
+
+	for(unsigned int i = 0; i < input_count; i++) {
+		GXInput* in = &inputs[i];
+		if(!in->source->Start(in->pixel_format, sample_depth, audio_channels)) {
 			glfwSetWindowShouldClose(window, GLFW_TRUE);
 		}
 	}
 
 	AXStart();
 
+	int last_width = 0;
+	int last_height = 0;
+
+	IDeckLinkVideoInputFrame* video_frames[GX_MAX_INPUTS];
+
 	while(!glfwWindowShouldClose(window)) {
 		int width;
 		int height;
 
 		glfwGetFramebufferSize(window, &width, &height);
 
+		int64_t wait = 100000;
+		for(unsigned int i = 0; i < input_count; i++) {
+			collect_frames(&inputs[i]);
+		}
+
+		// late latching: wait until just before the next vsync and
+		// then take whatever is newest at that point
+		GXInput* primary = &inputs[audio_input];
+		GXPaceSetFields(field_rate(primary) ? 2 : 1);
+		GXPaceMode strategy = GXPaceStrategy();
+		int64_t latch = GXPaceLatchWait();
+		if(strategy == GX_PACE_LATCH && primary->frame_queue_len > 0 && latch > 0) {
+			usleep(latch);
+			for(unsigned int i = 0; i < input_count; i++) {
+				collect_frames(&inputs[i]);
+			}
+		}
+
+		bool new_frame = false;
+		bool new_field = false;
+		for(unsigned int i = 0; i < input_count; i++) {
+			GXInput* in = &inputs[i];
+			video_frames[i] = schedule_frame(in, &wait);
+			new_frame |= video_frames[i] != NULL;
+
+			// a new frame replaces a second field not shown yet
+			if(video_frames[i]) {
+				in->field = 0;
+				in->field_due = -1;
+			} else {
+				new_field |= next_field(in, &wait);
+			}
+		}
+		update_title();
+
+		// Without a due frame or any other change the previous image
+		// is still valid, so skip the upload and the swap and sleep
+		// until the next frame is due or the capture callback or an
+		// input event wakes us up. Blending without clear accumulates
+		// across draws and thus always redraws.
+		if(!new_frame && !new_field && width == last_width && height == last_height && clear && !redraw) {
+			glfwWaitEventsTimeout((wait > 100000 ? 100000 : wait) / 1000000.0);
+			continue;
+		}
+
+		last_width = width;
+		last_height = height;
+		redraw = false;
+
 		glViewport(0, 0, width, height);
 		if(clear) {
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -606,190 +1363,129 @@ void GXMain(void)
 			glEnable(GL_BLEND);
 		}
 
-		GXRender(width, height);
-
-		glfwSwapBuffers(window);
-		glfwPollEvents();
-	}
-
-	AXStop();
-
-	if(input) {
-		input->StopStreams();
-		input->DisableAudioInput();
-		input->DisableVideoInput();
-	}
-}
-
-void GXDestroy(void)
-{
-	if(display_mode) {
-		display_mode->Release();
-	}
-
-	if(delegate) {
-		delegate->Release();
-	}
-
-	if(input) {
-		input->Release();
-	}
+		for(unsigned int i = 0; i < input_count; i++) {
+			if(video_frames[i]) {
+				upload_frame(&inputs[i], video_frames[i]);
+				video_frames[i]->Release();
+			}
+		}
 
-	if(attributes) {
-		attributes->Release();
-	}
+		bool stats = GXStatsActive();
+		if(stats) {
+			GXStatsGPUBegin();
+		}
 
-	if(frame) {
-		free(frame);
-	}
+		if(composited()) {
+			render_composite(width, height);
+		} else {
+			for(unsigned int i = 0; i < input_count; i++) {
+				render_input(&inputs[i], width, height);
+			}
+			GXScalerFrameDone(&scaler);
+			glViewport(0, 0, width, height);
+		}
 
-	AXStop();
-	AXDestroy();
+		if(stats) {
+			GXStatsGPUEnd();
+		}
 
-	glfwDestroyWindow(window);
-	glfwTerminate();
-}
+		// timed on their own, outside of the frame's query
+		render_scopes(width, height);
 
-////////////////////////////////////////////////////////////////////////////////
-GLuint GXCompileShader(GLuint type, const char* src)
-{
-	GLuint shader = glCreateShader(type);
-	glShaderSource(shader, 1, &src, 0);
-	glCompileShader(shader);
+		GXStatsDrawOverlay();
 
-	GLint compiled = 0;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-	if(compiled == GL_FALSE) {
-		GLint len = 0;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+		int64_t swap_start = stats ? GXStatsTime() : 0;
+		glfwSwapBuffers(window);
+		GXPaceSwapped(video_frames[audio_input] != NULL, primary->presented_capture);
 
-		if(!len) {
-			printf("Failed to retrieve shader compilation error log\n");
-			exit(1);
+		for(unsigned int i = 0; i < input_count; i++) {
+			GXInput* in = &inputs[i];
+			if(video_frames[i] && field_rate(in)) {
+				in->field_due = time_us() + (int64_t) (250000.0 / in->frame_rate);
+			}
 		}
 
-		char* log = (char*) malloc(len);
-		glGetShaderInfoLog(shader, len, &len, log);
-		glDeleteShader(shader);
+		if(stats) {
+			GXStatsRecord(GX_STAT_SWAP, GXStatsTime() - swap_start);
 
-		printf("Failed to compile shader:\n%s\n", log);
-		free(log);
+			AXStats audio;
+			AXGetStats(&audio);
+			GXStatsRecord(GX_STAT_AUDIO_QUEUE, audio.queued * 1000000 / 48000);
 
-		exit(1);
-	} else {
-		GLint len = 0;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
-
-		if(len) {
-			char* log = (char*) malloc(len);
-			glGetShaderInfoLog(shader, len, &len, log);
-			if(len) {
-				printf("shader compilation log:\n%s\n", log);
-			}
-			free(log);
+			GXStatsFrameDone();
 		}
+		glfwPollEvents();
 	}
 
-	return shader;
-}
-
-GLuint GXCreateShader(const char* vs_src, const char* fs_src)
-{
-	GLuint vs = GXCompileShader(GL_VERTEX_SHADER, vs_src);
-	GLuint fs = GXCompileShader(GL_FRAGMENT_SHADER, fs_src);
-
-	GLuint shader = glCreateProgram();
-
-	glAttachShader(shader, vs);
-	glAttachShader(shader, fs);
-	glLinkProgram(shader);
-
-	GLint linked = 0;
-	glGetProgramiv(shader, GL_LINK_STATUS, &linked);
-	if(linked == GL_FALSE) {
-		GLint len = 0;
-		glGetProgramiv(shader, GL_INFO_LOG_LENGTH, &len);
+	AXStop();
 
-		if(!len) {
-			printf("Faild to retrieve shader linking error log\n");
-			exit(1);
-		}
+	for(unsigned int i = 0; i < input_count; i++) {
+		inputs[i].source->Stop();
+		release_frames(&inputs[i]);
+	}
 
-		char* log = (char*) malloc(len);
-		glGetProgramInfoLog(shader, len, &len, log);
+	print_upload_stats();
+	print_record_stats();
+	print_export_stats();
 
-		glDeleteProgram(shader);
-		glDeleteShader(vs);
-		glDeleteShader(fs);
+	for(unsigned int i = 0; i < GX_SCOPE_CNT; i++) {
+		print_scope_stats((GXScope) i);
+	}
 
-		printf("Failed to link shader:\n%s\n", log);
+	for(unsigned int i = 0; i < GX_SCALE_CNT; i++) {
+		print_scale_stats((GXScaleMode) i);
+	}
 
-		free(log);
-		exit(1);
-	} else {
-		GLint len = 0;
-		glGetProgramiv(shader, GL_INFO_LOG_LENGTH, &len);
+	for(unsigned int i = 0; i < GX_DEINTERLACE_CNT; i++) {
+		print_deinterlace_stats((GXDeinterlaceMode) i);
+	}
 
-		if(len) {
-			char* log = (char*) malloc(len);
-			glGetProgramInfoLog(shader, len, &len, log);
+	for(unsigned int i = 0; i < input_count; i++) {
+		GXInput* in = &inputs[i];
 
-			if(len) {
-				printf("Shader linking error log:\n%s\n", log);
-			}
+		if(in->frames_dropped || in->frames_repeated) {
+			printf("Input %u: dropped %lu frames, held %lu frames\n", i + 1, (unsigned long) in->frames_dropped, in->frames_repeated);
+		}
 
-			free(log);
+		if(in->av_offset_cnt) {
+			printf("Input %u: A/V offset: %+.1f ms average\n", i + 1, in->av_offset_sum / in->av_offset_cnt / 1000.0);
 		}
 	}
 
-	glDetachShader(shader, vs);
-	glDetachShader(shader, fs);
-
-	glDeleteShader(vs);
-	glDeleteShader(fs);
-
-	return shader;
+	GXPaceStats pace;
+	GXPaceGetStats(&pace);
+	if(pace.latency_cnt) {
+		printf("Capture to swap latency: %.1f ms average, %.1f ms min, %.1f ms max\n", pace.latency_avg / 1000.0, pace.latency_min / 1000.0, pace.latency_max / 1000.0);
+	}
 }
 
-void GXRendererInit(GXRenderer* self)
+void GXDestroy(void)
 {
-	GXCreateBuffers(self);
-	GXCreateTexture(self);
+	for(unsigned int i = 0; i < input_count; i++) {
+		GXInput* in = &inputs[i];
 
-	self->yuv8_shader = GXCreateShader(yuv8_vert, yuv8_frag);
-	self->yuv8_shader_tex = glGetUniformLocation(self->yuv8_shader, "frame");
-	self->yuv8_shader_brightness = glGetUniformLocation(self->yuv8_shader, "brightness");
-	self->yuv8_shader_interpolate = glGetUniformLocation(self->yuv8_shader, "interpolate");
+		if(in->delegate) {
+			in->delegate->Release();
+			in->delegate = NULL;
+		}
 
-	self->yuv10_shader = GXCreateShader(yuv10_vert, yuv10_frag);
-	self->yuv10_shader_tex = glGetUniformLocation(self->yuv10_shader, "frame");
-	self->yuv10_shader_size = glGetUniformLocation(self->yuv10_shader, "frame_size");
-	self->yuv10_shader_brightness = glGetUniformLocation(self->yuv10_shader, "brightness");
-	self->yuv10_shader_interpolate = glGetUniformLocation(self->yuv10_shader, "interpolate");
-}
+		release_frames(in);
+		GXUploadDestroy(&in->renderer);
+	}
 
-void GXCreateBuffers(GXRenderer* self)
-{
-	glGenVertexArrays(1, &self->quad_vao);
-	glBindVertexArray(self->quad_vao);
+	GXCompositeDestroy(&composite);
+	GXScopesDestroy(&scopes);
+	GXScalerDestroy(&scaler);
+	GXDeinterlacerDestroy(&deinterlacer);
 
-	GLuint loc = 0;
+	RXStop();
+	EXStop();
 
-	glGenBuffers(1, &self->quad_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, self->quad_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
+	GXStatsDestroy();
 
-	glEnableVertexAttribArray(loc);
-	glVertexAttribPointer(loc , 3, GL_FLOAT, GL_FALSE, 0, 0);
-}
+	AXStop();
+	AXDestroy();
 
-void GXCreateTexture(GXRenderer* self)
-{
-	glGenTextures(1, &self->frame);
-	glBindTexture(GL_TEXTURE_2D, self->frame);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 64, 64, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+	glfwDestroyWindow(window);
+	glfwTerminate();
 }
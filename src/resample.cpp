@@ -0,0 +1,220 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define	AX_X86
+#endif
+
+#include "deckview.h"
+
+// Fractional resampler for the routed output, steered by the drift
+// compensation of ax_thread to ratios a few hundred ppm off 1. Windowed sinc
+// (Kaiser) of TAPS taps, tabulated at PHASES fractional positions with the
+// weights of an output sample interpolated linearly between two rows. Every
+// output frame is the sum of TAPS input frames, each broadcast against its
+// weight with all channels side by side in a vector, stored overlapping
+// like the mixer does.
+
+#define	TAPS		64
+#define	PHASES		256
+#define	CUTOFF		0.9	// of the Nyquist frequency
+#define	BETA		8.0	// Kaiser window, about 80 dB stop band
+#define	CHUNK		(1024 + 64)	// most input frames per call
+
+typedef void (*ResampleFunc)(const float* frames, const float* row0, const float* row1, float t, float* dst);
+
+// row p holds the taps for an output p / PHASES of a frame past the centre
+// tap, one row more for the interpolation of the last phase
+static float table[PHASES + 1][TAPS] __attribute__((aligned(32)));
+
+// input frames of the last call still under the window and the new ones,
+// compact, padded for whole vector loads past the last frame
+static float history[(TAPS + CHUNK) * AX_MAX_OUTPUTS + AX_MIX_PAD] __attribute__((aligned(32)));
+static size_t history_frames;
+static double position;		// of the next output frame in history
+
+static unsigned int resample_channels = 0;
+static ResampleFunc resample;
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	for(int k = 1; k < 32; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static void create_table(void)
+{
+	for(unsigned int p = 0; p <= PHASES; p++) {
+		double frac = (double) p / PHASES;
+		double sum = 0.0;
+
+		for(unsigned int j = 0; j < TAPS; j++) {
+			double x = (double) j - (TAPS / 2 - 1) - frac;
+			double r = x / (TAPS / 2);
+			double window = r * r < 1.0 ? bessel_i0(BETA * sqrt(1.0 - r * r)) / bessel_i0(BETA) : 0.0;
+			double sinc = x == 0.0 ? 1.0 : sin(M_PI * CUTOFF * x) / (M_PI * CUTOFF * x);
+
+			table[p][j] = (float) (CUTOFF * sinc * window);
+			sum += table[p][j];
+		}
+
+		// unity gain at DC for every phase
+		for(unsigned int j = 0; j < TAPS; j++) {
+			table[p][j] = (float) (table[p][j] / sum);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar reference
+
+static void resample_scalar(const float* frames, const float* row0, const float* row1, float t, float* dst)
+{
+	for(unsigned int c = 0; c < resample_channels; c++) {
+		float sum = 0.0f;
+		for(unsigned int j = 0; j < TAPS; j++) {
+			float w = row0[j] + (row1[j] - row0[j]) * t;
+			sum += w * frames[j * resample_channels + c];
+		}
+		dst[c] = sum;
+	}
+}
+
+#ifdef AX_X86
+////////////////////////////////////////////////////////////////////////////////
+// SSE4.1: up to four channels per vector, two vectors for more
+
+__attribute__((target("sse4.1")))
+static void resample_sse41(const float* frames, const float* row0, const float* row1, float t, float* dst)
+{
+	float w[TAPS] __attribute__((aligned(16)));
+	__m128 vt = _mm_set1_ps(t);
+	for(unsigned int j = 0; j < TAPS; j += 4) {
+		__m128 a = _mm_load_ps(row0 + j);
+		__m128 b = _mm_load_ps(row1 + j);
+		_mm_store_ps(w + j, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), vt)));
+	}
+
+	bool wide = resample_channels > 4;
+	__m128 lo = _mm_setzero_ps();
+	__m128 hi = _mm_setzero_ps();
+	for(unsigned int j = 0; j < TAPS; j++) {
+		const float* f = frames + j * resample_channels;
+		__m128 x = _mm_set1_ps(w[j]);
+		lo = _mm_add_ps(lo, _mm_mul_ps(x, _mm_loadu_ps(f)));
+		if(wide) {
+			hi = _mm_add_ps(hi, _mm_mul_ps(x, _mm_loadu_ps(f + 4)));
+		}
+	}
+
+	_mm_storeu_ps(dst, lo);
+	if(wide) {
+		_mm_storeu_ps(dst + 4, hi);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// AVX2: all channels in one vector
+
+__attribute__((target("avx2")))
+static void resample_avx2(const float* frames, const float* row0, const float* row1, float t, float* dst)
+{
+	float w[TAPS] __attribute__((aligned(32)));
+	__m256 vt = _mm256_set1_ps(t);
+	for(unsigned int j = 0; j < TAPS; j += 8) {
+		__m256 a = _mm256_load_ps(row0 + j);
+		__m256 b = _mm256_load_ps(row1 + j);
+		_mm256_store_ps(w + j, _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), vt)));
+	}
+
+	__m256 sum = _mm256_setzero_ps();
+	for(unsigned int j = 0; j < TAPS; j++) {
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_broadcast_ss(w + j), _mm256_loadu_ps(frames + j * resample_channels)));
+	}
+
+	_mm256_storeu_ps(dst, sum);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+#ifdef AX_X86
+static const ResampleFunc resamples[CX_ISA_CNT] = { resample_scalar, resample_sse41, resample_avx2 };
+#else
+static const ResampleFunc resamples[CX_ISA_CNT] = { resample_scalar, resample_scalar, resample_scalar };
+#endif
+
+// Starts over with silence under the first half of the window, so output
+// frame k is at input frame k * ratio, half a window behind the input
+bool AXResampleInit(unsigned int channels, CXIsa isa)
+{
+	resample_channels = 0;
+
+	if(channels == 0 || channels > AX_MAX_OUTPUTS) {
+		printf("Resampler: %u channels are not supported\n", channels);
+		return false;
+	}
+
+	if(!CXIsaSupported(isa)) {
+		isa = CX_ISA_SCALAR;
+	}
+
+	if(table[0][TAPS / 2 - 1] == 0.0f) {
+		create_table();
+	}
+
+	memset(history, 0, sizeof(history));
+	history_frames = TAPS / 2 - 1;
+	position = TAPS / 2 - 1;
+
+	resample = resamples[isa];
+	resample_channels = channels;
+	return true;
+}
+
+// Resamples frames of compact float frames at src, at most CHUNK - TAPS,
+// by ratio input frames per output frame. Returns the number of frames
+// written to dst, which must have room for frames / ratio + 1 of them and
+// AX_MIX_PAD floats more.
+size_t AXResample(const float* src, size_t frames, double ratio, float* dst)
+{
+	unsigned int channels = resample_channels;
+
+	memcpy(history + history_frames * channels, src, frames * channels * sizeof(float));
+	history_frames += frames;
+
+	size_t n = 0;
+	for(;;) {
+		double base = floor(position);
+		size_t first = (size_t) base - (TAPS / 2 - 1);
+		if(first + TAPS > history_frames) {
+			break;
+		}
+
+		double phase = (position - base) * PHASES;
+		unsigned int p = (unsigned int) phase;
+		resample(history + first * channels, table[p], table[p + 1], (float) (phase - p), dst + n * channels);
+
+		n++;
+		position += ratio;
+	}
+
+	// keep the frames the next output still needs
+	size_t keep_from = (size_t) floor(position) - (TAPS / 2 - 1);
+	if(keep_from > history_frames) {
+		keep_from = history_frames;
+	}
+	memmove(history, history + keep_from * channels, (history_frames - keep_from) * channels * sizeof(float));
+	history_frames -= keep_from;
+	position -= keep_from;
+
+	return n;
+}
@@ -0,0 +1,388 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "deckview.h"
+
+extern "C" {
+extern const char scale_vert[];
+extern const char scale_frag[];
+}
+
+// the quad of GXCreateBuffers
+#define	QUAD_VTX_CNT	6
+
+// Downscaling widens the filters to cover all source texels of an output
+// one, up to this many taps per pass: Lanczos-3 by 2:1, bicubic by 3:1.
+// Beyond that the filters alias a little rather than cost more.
+#define	SCALE_MAX_TAPS		12
+
+// frames per budget check
+#define	SCALE_BUDGET_WINDOW	120
+
+static const char* scale_mode_names[GX_SCALE_CNT] = {
+	"bilinear",
+	"bicubic",
+	"lanczos3"
+};
+
+const char* GXScaleModeName(GXScaleMode mode)
+{
+	return mode < GX_SCALE_CNT ? scale_mode_names[mode] : "unknown";
+}
+
+// Catmull-Rom (Keys, a = -0.5) and Lanczos-3
+static double kernel(GXScaleMode mode, double x)
+{
+	x = fabs(x);
+
+	if(mode == GX_SCALE_BICUBIC) {
+		if(x < 1.0) {
+			return (1.5 * x - 2.5) * x * x + 1.0;
+		}
+		if(x < 2.0) {
+			return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+		}
+		return 0.0;
+	}
+
+	if(x < 1e-9) {
+		return 1.0;
+	}
+	if(x >= 3.0) {
+		return 0.0;
+	}
+	double px = M_PI * x;
+	return 3.0 * sin(px) * sin(px / 3.0) / (px * px);
+}
+
+// One RGBA32F row per output texel: the first source texel, then the taps
+// four per texel, normalized to unity gain
+static void create_weights(GXScaleTarget* t, unsigned int axis, GXScaleMode mode, GLsizei src, GLsizei dst)
+{
+	double radius = mode == GX_SCALE_BICUBIC ? 2.0 : 3.0;
+	double ratio = (double) src / dst;
+	double stretch = ratio > 1.0 ? ratio : 1.0;
+
+	int taps = (int) ceil(2.0 * radius * stretch);
+	if(taps > SCALE_MAX_TAPS) {
+		taps = SCALE_MAX_TAPS;
+		stretch = taps / (2.0 * radius);
+	}
+
+	int texels = 1 + (taps + 3) / 4;
+	float* data = (float*) calloc((size_t) dst * texels * 4, sizeof(float));
+
+	for(GLsizei i = 0; i < dst; i++) {
+		double center = (i + 0.5) * ratio - 0.5;
+		int first = (int) floor(center - radius * stretch) + 1;
+		float* row = data + (size_t) i * texels * 4;
+
+		double sum = 0.0;
+		for(int k = 0; k < taps; k++) {
+			double w = kernel(mode, (first + k - center) / stretch);
+			row[4 + k] = (float) w;
+			sum += w;
+		}
+		for(int k = 0; k < taps; k++) {
+			row[4 + k] = (float) (row[4 + k] / sum);
+		}
+		row[0] = (float) first;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, t->weights[axis]);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, texels, dst, 0, GL_RGBA, GL_FLOAT, data);
+	free(data);
+
+	t->taps[axis] = taps;
+	t->weights_src[axis] = src;
+	t->weights_dst[axis] = dst;
+	t->weights_mode[axis] = mode;
+}
+
+static void resize_intermediate(GXScaleTarget* t, GLsizei width, GLsizei height)
+{
+	glBindTexture(GL_TEXTURE_2D, t->intermediate);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, t->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t->intermediate, 0);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Scale framebuffer is incomplete\n");
+	}
+
+	t->intermediate_width = width;
+	t->intermediate_height = height;
+}
+
+static void create_texture(GLuint* texture)
+{
+	glGenTextures(1, texture);
+	glBindTexture(GL_TEXTURE_2D, *texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+}
+
+// Shares the vertex buffers of the given renderer. Whenever the average
+// GPU time of all draws of a frame, over SCALE_BUDGET_WINDOW frames,
+// exceeds budget ms the next cheaper mode takes over. With tiles that is
+// the sum over all inputs.
+void GXScalerInit(GXScaler* self, const GXRenderer* share, GXScaleMode mode, double budget)
+{
+	memset(self, 0, sizeof(*self));
+	self->quad_vao = share->quad_vao;
+	self->mode = mode;
+	self->budget = budget;
+
+	self->shader = GXCreateShader(scale_vert, scale_frag);
+	self->shader_tex = glGetUniformLocation(self->shader, "frame");
+	self->shader_weights = glGetUniformLocation(self->shader, "weights");
+	self->shader_taps = glGetUniformLocation(self->shader, "taps");
+	self->shader_axis = glGetUniformLocation(self->shader, "axis");
+	self->shader_origin = glGetUniformLocation(self->shader, "origin");
+	self->shader_rows = glGetUniformLocation(self->shader, "rows");
+	self->shader_last = glGetUniformLocation(self->shader, "last");
+	self->shader_brightness = glGetUniformLocation(self->shader, "brightness");
+
+	for(unsigned int i = 0; i < GX_MAX_INPUTS; i++) {
+		GXScaleTarget* t = &self->targets[i];
+		create_texture(&t->intermediate);
+		create_texture(&t->weights[0]);
+		create_texture(&t->weights[1]);
+		glGenFramebuffers(1, &t->fbo);
+	}
+
+	glGenQueries(GX_SCALE_QUERYCNT * 2, &self->queries[0][0]);
+	GL_ERROR();
+}
+
+void GXScalerDestroy(GXScaler* self)
+{
+	for(unsigned int i = 0; i < GX_MAX_INPUTS; i++) {
+		GXScaleTarget* t = &self->targets[i];
+		glDeleteFramebuffers(1, &t->fbo);
+		glDeleteTextures(1, &t->intermediate);
+		glDeleteTextures(2, t->weights);
+	}
+
+	glDeleteQueries(GX_SCALE_QUERYCNT * 2, &self->queries[0][0]);
+	glDeleteProgram(self->shader);
+}
+
+void GXScalerSetMode(GXScaler* self, GXScaleMode mode)
+{
+	self->mode = mode;
+	self->window_time = 0;
+	self->window_count = 0;
+}
+
+static void check_budget(GXScaler* self)
+{
+	if(self->budget <= 0 || self->window_count < SCALE_BUDGET_WINDOW) {
+		return;
+	}
+
+	double ms = self->window_time / 1e6 / self->window_count;
+	self->window_time = 0;
+	self->window_count = 0;
+
+	if(ms > self->budget && self->mode != GX_SCALE_BILINEAR) {
+		GXScaleMode cheaper = (GXScaleMode) (self->mode - 1);
+		printf("Scaling: %s takes %.2f ms GPU per frame, over the %.1f ms budget, falling back to %s\n", GXScaleModeName(self->mode), ms, self->budget, GXScaleModeName(cheaper));
+		self->mode = cheaper;
+	}
+}
+
+// Called with the first result of a later frame, the sum is complete then
+static void frame_resolved(GXScaler* self)
+{
+	if(!self->sum_mixed && !self->frame_untimed[self->sum_frame % GX_SCALE_QUERYCNT]) {
+		GXScaleMode mode = self->sum_mode;
+		self->frame_time[mode] += self->sum_time;
+		self->frames[mode]++;
+		if(mode == self->mode) {
+			self->window_time += self->sum_time;
+			self->window_count++;
+		}
+	}
+
+	self->sum_time = 0;
+	self->sum_count = 0;
+	self->sum_mixed = false;
+
+	check_budget(self);
+}
+
+static void draw_resolved(GXScaler* self, unsigned long frame, GXScaleMode mode, GLuint64 elapsed)
+{
+	self->time[mode] += elapsed;
+	self->count[mode]++;
+
+	if(self->sum_count && frame != self->sum_frame) {
+		frame_resolved(self);
+	}
+
+	if(self->sum_count && mode != self->sum_mode) {
+		self->sum_mixed = true;
+	}
+	self->sum_frame = frame;
+	self->sum_mode = mode;
+	self->sum_time += elapsed;
+	self->sum_count++;
+}
+
+// Timestamps before and after each draw, which unlike a time elapsed query
+// may sit inside the one of the frame stats. Like the scopes they are read
+// back a few draws later without waiting, a draw whose queries are still
+// in flight goes untimed.
+static bool timer_begin(GXScaler* self)
+{
+	unsigned int idx = self->query_idx;
+	GLuint* q = self->queries[idx];
+
+	if(self->query_pending[idx]) {
+		GLint available = 0;
+		glGetQueryObjectiv(q[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available) {
+			self->frame_untimed[self->frame % GX_SCALE_QUERYCNT] = true;
+			return false;
+		}
+
+		GLuint64 begin;
+		GLuint64 end;
+		glGetQueryObjectui64v(q[0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(q[1], GL_QUERY_RESULT, &end);
+		self->query_pending[idx] = false;
+
+		draw_resolved(self, self->query_frame[idx], self->query_mode[idx], end - begin);
+	}
+
+	glQueryCounter(q[0], GL_TIMESTAMP);
+	self->query_mode[idx] = self->mode;
+	self->query_frame[idx] = self->frame;
+	return true;
+}
+
+static void timer_end(GXScaler* self)
+{
+	unsigned int idx = self->query_idx;
+	glQueryCounter(self->queries[idx][1], GL_TIMESTAMP);
+	self->query_pending[idx] = true;
+}
+
+static void scale(GXScaler* self, GXScaleTarget* t, GXRenderer* input, const GLint* viewport, float brightness)
+{
+	GLsizei src_width = input->unpacked_width;
+	GLsizei src_height = input->unpacked_height;
+	GLsizei dst_width = viewport[2];
+	GLsizei dst_height = viewport[3];
+
+	if(t->weights_src[0] != src_width || t->weights_dst[0] != dst_width || t->weights_mode[0] != self->mode) {
+		create_weights(t, 0, self->mode, src_width, dst_width);
+	}
+	if(t->weights_src[1] != src_height || t->weights_dst[1] != dst_height || t->weights_mode[1] != self->mode) {
+		create_weights(t, 1, self->mode, src_height, dst_height);
+	}
+
+	GLint framebuffer;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	GLboolean blend = glIsEnabled(GL_BLEND);
+
+	if(t->intermediate_width != dst_width || t->intermediate_height != src_height) {
+		resize_intermediate(t, dst_width, src_height);
+	}
+
+	glUseProgram(self->shader);
+	glUniform1i(self->shader_tex, 0);
+	glUniform1i(self->shader_weights, 1);
+	glBindVertexArray(self->quad_vao);
+
+	// horizontal: frame rows to the output width
+	glBindFramebuffer(GL_FRAMEBUFFER, t->fbo);
+	glViewport(0, 0, dst_width, src_height);
+	glDisable(GL_BLEND);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, input->shown);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, t->weights[0]);
+	glUniform1i(self->shader_axis, 0);
+	glUniform1i(self->shader_taps, t->taps[0]);
+	glUniform2i(self->shader_origin, 0, 0);
+	glUniform2i(self->shader_last, src_width - 1, src_height - 1);
+	glDrawArrays(GL_TRIANGLES, 0, QUAD_VTX_CNT);
+
+	// vertical: the intermediate columns to the output height
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	if(blend) {
+		glEnable(GL_BLEND);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, t->intermediate);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, t->weights[1]);
+	glUniform1i(self->shader_axis, 1);
+	glUniform1i(self->shader_taps, t->taps[1]);
+	glUniform2i(self->shader_origin, viewport[0], viewport[1]);
+	glUniform1i(self->shader_rows, dst_height);
+	glUniform2i(self->shader_last, dst_width - 1, src_height - 1);
+	glUniform1f(self->shader_brightness, brightness);
+	glDrawArrays(GL_TRIANGLES, 0, QUAD_VTX_CNT);
+
+	glActiveTexture(GL_TEXTURE0);
+	GL_ERROR();
+}
+
+// Draws the frame of input into the viewport, which differs from the frame
+// size. slot keeps the weights and the intermediate of each input apart.
+void GXScalerDraw(GXScaler* self, unsigned int slot, GXRenderer* input, float brightness)
+{
+	// bilinear is GXDraw's, which decodes a frame drawn smaller straight
+	// into the viewport
+	if(self->mode != GX_SCALE_BILINEAR) {
+		GXUnpackFrame(input);
+	}
+
+	if(!input->unpacked_width && !input->unpack_pending) {
+		// nothing uploaded yet
+		return;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	bool timed = timer_begin(self);
+
+	if(self->mode == GX_SCALE_BILINEAR) {
+		GXDraw(input, true, brightness);
+	} else {
+		scale(self, &self->targets[slot], input, viewport, brightness);
+	}
+
+	if(timed) {
+		timer_end(self);
+	}
+	self->query_idx = (self->query_idx + 1) % GX_SCALE_QUERYCNT;
+}
+
+// Ends the frame whose draws count against the budget together
+void GXScalerFrameDone(GXScaler* self)
+{
+	self->frame++;
+	self->frame_untimed[self->frame % GX_SCALE_QUERYCNT] = false;
+}
+
+void GXScalerGetStats(GXScaler* self, GXScaleMode mode, GXScaleStats* stats)
+{
+	stats->count = self->count[mode];
+	stats->gpu_ms = stats->count ? self->time[mode] / 1e6 / stats->count : 0;
+	stats->frames = self->frames[mode];
+	stats->frame_ms = stats->frames ? self->frame_time[mode] / 1e6 / stats->frames : 0;
+}
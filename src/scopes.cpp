@@ -0,0 +1,336 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "deckview.h"
+
+extern "C" {
+extern const char scope_scatter_vert[];
+extern const char scope_scatter_frag[];
+extern const char scope_vert[];
+extern const char scope_frag[];
+}
+
+// the quad of GXCreateBuffers
+#define	QUAD_VTX_CNT	6
+
+// Scopes sample every step-th pixel in both directions so that no more
+// than this many points are scattered, every other pixel of 1080p and every
+// fourth of 2160p. Points that land on the same texel serialize in the
+// blender, so the scatter pass costs about as much as its sample count.
+#define	SCOPE_MAX_SAMPLES	(960 * 540)
+
+#define	SCOPE_COLUMNS		1024
+#define	SCOPE_LEVELS		512
+#define	SCOPE_VECTOR_SIZE	512
+
+// counts to intensity, see glsl/scope.frag.glsl
+#define	SCOPE_GAIN		4.0
+#define	SCOPE_HISTOGRAM_GAIN	0.5
+
+static const char* scope_names[GX_SCOPE_CNT] = {
+	"waveform",
+	"parade",
+	"vectorscope",
+	"histogram"
+};
+
+// points drawn per sample
+static const unsigned int scope_instances[GX_SCOPE_CNT] = { 1, 3, 1, 4 };
+
+const char* GXScopeName(GXScope scope)
+{
+	return scope < GX_SCOPE_CNT ? scope_names[scope] : "unknown";
+}
+
+static void resize_accum(GXScopes* self, GXScope scope, GLsizei width, GLsizei height)
+{
+	GLenum internal_format = scope == GX_SCOPE_WAVEFORM || scope == GX_SCOPE_VECTORSCOPE ? GL_R32F : GL_RGBA32F;
+
+	glBindTexture(GL_TEXTURE_2D, self->accum[scope]);
+	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, self->fbo[scope]);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, self->accum[scope], 0);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Scope framebuffer is incomplete\n");
+	}
+
+	self->accum_width[scope] = width;
+	self->accum_height[scope] = height;
+}
+
+// Shares the vertex buffers of the given renderer
+void GXScopesInit(GXScopes* self, const GXRenderer* share)
+{
+	memset(self, 0, sizeof(*self));
+	self->quad_vao = share->quad_vao;
+
+	// the points have no attributes, core profiles still want a VAO
+	glGenVertexArrays(1, &self->points_vao);
+
+	self->scatter_shader = GXCreateShader(scope_scatter_vert, scope_scatter_frag);
+	self->scatter_shader_tex = glGetUniformLocation(self->scatter_shader, "frame");
+	self->scatter_shader_scope = glGetUniformLocation(self->scatter_shader, "scope");
+	self->scatter_shader_columns = glGetUniformLocation(self->scatter_shader, "columns");
+	self->scatter_shader_step = glGetUniformLocation(self->scatter_shader, "step");
+	self->scatter_shader_size = glGetUniformLocation(self->scatter_shader, "size");
+	self->scatter_shader_bins = glGetUniformLocation(self->scatter_shader, "bins");
+
+	self->draw_shader = GXCreateShader(scope_vert, scope_frag);
+	self->draw_shader_tex = glGetUniformLocation(self->draw_shader, "accum");
+	self->draw_shader_scope = glGetUniformLocation(self->draw_shader, "scope");
+	self->draw_shader_gain = glGetUniformLocation(self->draw_shader, "gain");
+
+	glGenTextures(GX_SCOPE_CNT, self->accum);
+	glGenFramebuffers(GX_SCOPE_CNT, self->fbo);
+
+	GLint framebuffer;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+
+	for(unsigned int i = 0; i < GX_SCOPE_CNT; i++) {
+		glBindTexture(GL_TEXTURE_2D, self->accum[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+		glGenQueries(GX_SCOPE_QUERYCNT * 2, &self->queries[i][0][0]);
+	}
+
+	resize_accum(self, GX_SCOPE_WAVEFORM, SCOPE_COLUMNS, SCOPE_LEVELS);
+	resize_accum(self, GX_SCOPE_PARADE, SCOPE_COLUMNS, SCOPE_LEVELS);
+	resize_accum(self, GX_SCOPE_VECTORSCOPE, SCOPE_VECTOR_SIZE, SCOPE_VECTOR_SIZE);
+	// sized to the bit depth of the first frame
+	resize_accum(self, GX_SCOPE_HISTOGRAM, 256, 1);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	GL_ERROR();
+}
+
+void GXScopesDestroy(GXScopes* self)
+{
+	for(unsigned int i = 0; i < GX_SCOPE_CNT; i++) {
+		glDeleteQueries(GX_SCOPE_QUERYCNT * 2, &self->queries[i][0][0]);
+	}
+
+	glDeleteFramebuffers(GX_SCOPE_CNT, self->fbo);
+	glDeleteTextures(GX_SCOPE_CNT, self->accum);
+	glDeleteVertexArrays(1, &self->points_vao);
+	glDeleteProgram(self->scatter_shader);
+	glDeleteProgram(self->draw_shader);
+}
+
+// Returns the new state
+bool GXScopesToggle(GXScopes* self, GXScope scope)
+{
+	self->enabled[scope] = !self->enabled[scope];
+	self->source[scope] = NULL;
+	return self->enabled[scope];
+}
+
+bool GXScopesEnabled(const GXScopes* self, GXScope scope)
+{
+	return self->enabled[scope];
+}
+
+static bool stale(const GXScopes* self, GXScope scope, const GXRenderer* input)
+{
+	return self->source[scope] != input || self->source_frame[scope] != input->frame_count || input->unpack_pending;
+}
+
+// Counts the newest frame of input into the scope, unless it already was.
+// The frame is unpacked first if the compositor decoded it straight into
+// its texture array, that pass then counts towards the scope. Returns
+// false if there was nothing to do.
+bool GXScopesCompute(GXScopes* self, GXScope scope, GXRenderer* input)
+{
+	if(!stale(self, scope, input)) {
+		return false;
+	}
+
+	GXUnpackFrame(input);
+	if(!input->unpacked_width) {
+		return false;
+	}
+
+	GLint framebuffer;
+	GLint viewport[4];
+	GLint blend_src;
+	GLint blend_dst;
+	GLfloat clear_color[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_BLEND_SRC_RGB, &blend_src);
+	glGetIntegerv(GL_BLEND_DST_RGB, &blend_dst);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+	GLboolean blend = glIsEnabled(GL_BLEND);
+
+	// a histogram bin per code value of 8 bit frames, 10 bit ones get
+	// as many bins as 10 bit codes
+	if(scope == GX_SCOPE_HISTOGRAM) {
+		GLsizei bins = input->frame_format == bmdFormat8BitYUV ? 256 : 1024;
+		if(bins != self->accum_width[scope]) {
+			resize_accum(self, scope, bins, 1);
+		}
+	}
+
+	unsigned int step = 1;
+	while((input->frame_width / step) * (input->frame_height / step) > SCOPE_MAX_SAMPLES) {
+		step++;
+	}
+	unsigned int columns = (input->frame_width + step - 1) / step;
+	unsigned int rows = (input->frame_height + step - 1) / step;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, self->fbo[scope]);
+	glViewport(0, 0, self->accum_width[scope], self->accum_height[scope]);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	glUseProgram(self->scatter_shader);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, input->unpacked);
+	glUniform1i(self->scatter_shader_tex, 0);
+	glUniform1i(self->scatter_shader_scope, scope);
+	glUniform1i(self->scatter_shader_columns, columns);
+	glUniform1i(self->scatter_shader_step, step);
+	glUniform2i(self->scatter_shader_size, input->frame_width, input->frame_height);
+	glUniform1i(self->scatter_shader_bins, self->accum_width[GX_SCOPE_HISTOGRAM]);
+
+	glBindVertexArray(self->points_vao);
+	glDrawArraysInstanced(GL_POINTS, 0, columns * rows, scope_instances[scope]);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glBlendFunc(blend_src, blend_dst);
+	glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+	if(!blend) {
+		glDisable(GL_BLEND);
+	}
+
+	self->source[scope] = input;
+	self->source_frame[scope] = input->frame_count;
+	self->samples[scope] = columns * rows;
+
+	GL_ERROR();
+	return true;
+}
+
+// Draws the scope over the current viewport
+void GXScopesDraw(GXScopes* self, GXScope scope)
+{
+	if(!self->samples[scope]) {
+		return;
+	}
+
+	GLint blend_src;
+	GLint blend_dst;
+	glGetIntegerv(GL_BLEND_SRC_RGB, &blend_src);
+	glGetIntegerv(GL_BLEND_DST_RGB, &blend_dst);
+	GLboolean blend = glIsEnabled(GL_BLEND);
+
+	double cells = scope == GX_SCOPE_HISTOGRAM ? self->accum_width[scope] * SCOPE_HISTOGRAM_GAIN : (double) self->accum_width[scope] * self->accum_height[scope] * SCOPE_GAIN;
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	glUseProgram(self->draw_shader);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, self->accum[scope]);
+	glUniform1i(self->draw_shader_tex, 0);
+	glUniform1i(self->draw_shader_scope, scope);
+	glUniform1f(self->draw_shader_gain, cells / self->samples[scope]);
+
+	glBindVertexArray(self->quad_vao);
+	glDrawArrays(GL_TRIANGLES, 0, QUAD_VTX_CNT);
+
+	glBlendFunc(blend_src, blend_dst);
+	if(!blend) {
+		glDisable(GL_BLEND);
+	}
+
+	GL_ERROR();
+}
+
+// Timer queries are read back a few frames later without waiting; a pass
+// whose query is still in flight from GX_SCOPE_QUERYCNT frames ago goes
+// untimed
+static bool timer_begin(GXScopes* self, GXScope scope, unsigned int pass)
+{
+	unsigned int idx = self->query_idx[scope];
+	GLuint q = self->queries[scope][idx][pass];
+
+	if(self->query_pending[scope][idx][pass]) {
+		GLint available = 0;
+		glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available) {
+			return false;
+		}
+
+		GLuint64 elapsed;
+		glGetQueryObjectui64v(q, GL_QUERY_RESULT, &elapsed);
+		if(pass == 0) {
+			self->scatter_time[scope] += elapsed;
+			self->scatter_count[scope]++;
+		} else {
+			self->draw_time[scope] += elapsed;
+			self->draw_count[scope]++;
+		}
+		self->query_pending[scope][idx][pass] = false;
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, q);
+	self->query_pending[scope][idx][pass] = true;
+	return true;
+}
+
+// Computes and draws every enabled scope of input into its rectangle,
+// timing both passes of each
+void GXScopesRender(GXScopes* self, GXRenderer* input, const GXTile* rects)
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	for(unsigned int i = 0; i < GX_SCOPE_CNT; i++) {
+		GXScope scope = (GXScope) i;
+		if(!self->enabled[scope]) {
+			continue;
+		}
+
+		if(stale(self, scope, input)) {
+			bool timed = timer_begin(self, scope, 0);
+			GXScopesCompute(self, scope, input);
+			if(timed) {
+				glEndQuery(GL_TIME_ELAPSED);
+			}
+		}
+
+		const GXTile* r = &rects[scope];
+		glViewport(r->x, r->y, r->width, r->height);
+
+		bool timed = timer_begin(self, scope, 1);
+		GXScopesDraw(self, scope);
+		if(timed) {
+			glEndQuery(GL_TIME_ELAPSED);
+		}
+
+		self->query_idx[scope] = (self->query_idx[scope] + 1) % GX_SCOPE_QUERYCNT;
+	}
+
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void GXScopesGetStats(GXScopes* self, GXScope scope, GXScopeStats* stats)
+{
+	stats->scatter_count = self->scatter_count[scope];
+	stats->draw_count = self->draw_count[scope];
+	stats->scatter_ms = stats->scatter_count ? self->scatter_time[scope] / 1e6 / stats->scatter_count : 0;
+	stats->draw_ms = stats->draw_count ? self->draw_time[scope] / 1e6 / stats->draw_count : 0;
+	stats->samples = self->samples[scope];
+}
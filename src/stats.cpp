@@ -0,0 +1,382 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "deckview.h"
+
+// Pipeline instrumentation. Every stage records its duration into a log2
+// histogram (bucket n holds values in [2^(n-1), 2^n) us). Each histogram has
+// exactly one writer thread, readers tolerate torn values. When disabled
+// the only cost is the check of gx_stats_active at every probe.
+
+#define	GX_HIST_BUCKETS	24
+#define	GX_QUERY_CNT	4
+
+typedef struct {
+	volatile uint32_t	buckets[GX_HIST_BUCKETS];
+	volatile int64_t	last;
+	volatile int64_t	min;
+	volatile int64_t	max;
+	volatile int64_t	sum;
+	volatile uint64_t	count;
+} Histogram;
+
+typedef struct {
+	const char*	name;
+	float	r;
+	float	g;
+	float	b;
+} StatInfo;
+
+static const StatInfo stat_info[GX_STAT_CNT] = {
+	{ "arrival_jitter",	1.0f, 0.3f, 0.3f },
+	{ "callback",		1.0f, 0.6f, 0.2f },
+	{ "audio_copy",		1.0f, 1.0f, 0.3f },
+	{ "upload",		0.3f, 1.0f, 0.3f },
+	{ "gpu_draw",		0.3f, 0.8f, 1.0f },
+	{ "swap",		0.5f, 0.5f, 1.0f },
+	{ "audio_queue",	1.0f, 0.4f, 1.0f }
+};
+
+volatile bool gx_stats_active = false;
+
+static Histogram histograms[GX_STAT_CNT];
+static FILE* csv = NULL;
+static int64_t csv_start = 0;
+
+static int64_t last_arrival = -1;
+static double arrival_period = 0;
+
+static GLuint queries[GX_QUERY_CNT];
+static bool query_pending[GX_QUERY_CNT];
+static unsigned int query_idx = 0;
+static bool query_active = false;
+
+static bool overlay = false;
+static bool meters = false;
+static GLuint overlay_shader = 0;
+static GLuint overlay_vao = 0;
+static GLuint overlay_vbo = 0;
+
+extern "C" {
+extern const char overlay_vert[];
+extern const char overlay_frag[];
+}
+
+int64_t GXStatsTime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static unsigned int bucket_of(int64_t value)
+{
+	unsigned int bucket = 0;
+	while(value > 0 && bucket < GX_HIST_BUCKETS - 1) {
+		value >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+void GXStatsRecord(GXStat stat, int64_t value)
+{
+	Histogram* h = &histograms[stat];
+
+	if(value < 0) {
+		value = 0;
+	}
+
+	h->buckets[bucket_of(value)]++;
+	if(h->count == 0 || value < h->min) {
+		h->min = value;
+	}
+	if(h->count == 0 || value > h->max) {
+		h->max = value;
+	}
+	h->last = value;
+	h->sum += value;
+	h->count++;
+}
+
+void GXStatsArrival(int64_t now)
+{
+	if(last_arrival >= 0) {
+		double delta = now - last_arrival;
+		if(arrival_period == 0) {
+			arrival_period = delta;
+		}
+
+		double jitter = delta - arrival_period;
+		GXStatsRecord(GX_STAT_ARRIVAL_JITTER, (int64_t) (jitter < 0 ? -jitter : jitter));
+		arrival_period += (delta - arrival_period) / 16;
+	}
+	last_arrival = now;
+}
+
+static void reset(void)
+{
+	memset((void*) histograms, 0, sizeof(histograms));
+}
+
+bool GXStatsInit(const char* csv_path)
+{
+	reset();
+
+	if(csv_path) {
+		csv = fopen(csv_path, "w");
+		if(!csv) {
+			printf("Failed to open %s\n", csv_path);
+			return false;
+		}
+
+		fprintf(csv, "time_us");
+		for(unsigned int i = 0; i < GX_STAT_CNT; i++) {
+			fprintf(csv, ",%s_us", stat_info[i].name);
+		}
+		fprintf(csv, "\n");
+
+		csv_start = GXStatsTime();
+		gx_stats_active = true;
+	}
+
+	glGenQueries(GX_QUERY_CNT, queries);
+
+	overlay_shader = GXCreateShader(overlay_vert, overlay_frag);
+	glGenVertexArrays(1, &overlay_vao);
+	glBindVertexArray(overlay_vao);
+	glGenBuffers(1, &overlay_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, overlay_vbo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (GLvoid*) 0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (GLvoid*) (2 * sizeof(float)));
+
+	return true;
+}
+
+void GXStatsDestroy(void)
+{
+	gx_stats_active = false;
+
+	if(csv) {
+		fclose(csv);
+		csv = NULL;
+	}
+
+	glDeleteQueries(GX_QUERY_CNT, queries);
+	glDeleteBuffers(1, &overlay_vbo);
+	glDeleteVertexArrays(1, &overlay_vao);
+	glDeleteProgram(overlay_shader);
+}
+
+void GXStatsToggleOverlay(void)
+{
+	overlay = !overlay;
+	if(overlay) {
+		reset();
+		printf("Overlay rows (log2 us, grid at 100us, 1ms, 10ms):\n");
+		for(unsigned int i = 0; i < GX_STAT_CNT; i++) {
+			printf("  %u: %s\n", i + 1, stat_info[i].name);
+		}
+	}
+	gx_stats_active = overlay || csv;
+}
+
+void GXStatsToggleMeters(void)
+{
+	meters = !meters;
+}
+
+// Timer queries are read back a few frames later to avoid stalling
+void GXStatsGPUBegin(void)
+{
+	GLuint q = queries[query_idx];
+	if(query_pending[query_idx]) {
+		GLint available = 0;
+		glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available) {
+			return;
+		}
+
+		GLuint64 elapsed;
+		glGetQueryObjectui64v(q, GL_QUERY_RESULT, &elapsed);
+		GXStatsRecord(GX_STAT_GPU_DRAW, elapsed / 1000);
+		query_pending[query_idx] = false;
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, q);
+	query_pending[query_idx] = true;
+	query_active = true;
+}
+
+void GXStatsGPUEnd(void)
+{
+	if(query_active) {
+		glEndQuery(GL_TIME_ELAPSED);
+		query_idx = (query_idx + 1) % GX_QUERY_CNT;
+		query_active = false;
+	}
+}
+
+void GXStatsFrameDone(void)
+{
+	if(!csv) {
+		return;
+	}
+
+	fprintf(csv, "%ld", (long) (GXStatsTime() - csv_start));
+	for(unsigned int i = 0; i < GX_STAT_CNT; i++) {
+		fprintf(csv, ",%ld", (long) histograms[i].last);
+	}
+	fprintf(csv, "\n");
+}
+
+static float* push_quad(float* v, float x0, float y0, float x1, float y1, float r, float g, float b, float a)
+{
+	const float corners[6][2] = {
+		{ x0, y0 }, { x1, y0 }, { x1, y1 },
+		{ x1, y1 }, { x0, y1 }, { x0, y0 }
+	};
+
+	for(unsigned int i = 0; i < 6; i++) {
+		*v++ = corners[i][0];
+		*v++ = corners[i][1];
+		*v++ = r;
+		*v++ = g;
+		*v++ = b;
+		*v++ = a;
+	}
+
+	return v;
+}
+
+#define	METER_RANGE	60.0f	// dB shown below full scale
+#define	METER_TARGET	-23.0f	// R128 program loudness, LUFS
+
+// y of a level in dB on a meter from y0 to y1
+static float meter_y(float db, float y0, float y1)
+{
+	float t = (db + METER_RANGE) / METER_RANGE;
+	t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+	return y0 + (y1 - y0) * t;
+}
+
+// Meter bridge along the right edge, above the scopes: per channel the RMS
+// bar with the sample peak and the 3 s peak hold, then the program
+// momentary and short-term loudness against the R128 target
+static float* push_meters(float* v)
+{
+	AXMeterLevels m;
+	if(!AXMeterGet(&m)) {
+		return v;
+	}
+
+	const float right = 0.98f;
+	const float column = 0.035f;
+	const float y0 = -0.3f;
+	const float y1 = 0.95f;
+	float left = right - (m.channels + 3) * column;
+
+	v = push_quad(v, left, y0, right, y1, 0.0f, 0.0f, 0.0f, 0.6f);
+
+	// grid at -20 and -40 dB
+	for(unsigned int i = 1; i <= 2; i++) {
+		float y = meter_y(-20.0f * i, y0, y1);
+		v = push_quad(v, left, y - 0.001f, right, y + 0.001f, 0.4f, 0.4f, 0.4f, 0.8f);
+	}
+
+	for(unsigned int c = 0; c < m.channels; c++) {
+		float x0 = left + (c + 0.5f) * column;
+		float x1 = x0 + column * 0.8f;
+		float peak = meter_y(m.peak[c], y0, y1);
+		float hold = meter_y(m.peak_hold[c], y0, y1);
+		bool over = m.peak_hold[c] > -1.0f;
+
+		v = push_quad(v, x0, y0, x1, meter_y(m.rms[c], y0, y1), 0.3f, 0.9f, 0.3f, 0.9f);
+		v = push_quad(v, x0, peak - 0.003f, x1, peak + 0.003f, 1.0f, 1.0f, 1.0f, 1.0f);
+		v = push_quad(v, x0, hold - 0.003f, x1, hold + 0.003f, 1.0f, over ? 0.2f : 0.6f, over ? 0.2f : 0.3f, 1.0f);
+	}
+
+	float x = left + (m.channels + 1) * column;
+	v = push_quad(v, x, y0, x + column * 0.8f, meter_y(m.program_momentary, y0, y1), 0.3f, 0.8f, 1.0f, 0.9f);
+	x += column;
+	v = push_quad(v, x, y0, x + column * 0.8f, meter_y(m.program_short_term, y0, y1), 0.5f, 0.5f, 1.0f, 0.9f);
+
+	float target = meter_y(METER_TARGET, y0, y1);
+	v = push_quad(v, x - column, target - 0.002f, x + column * 0.8f, target + 0.002f, 1.0f, 1.0f, 0.3f, 1.0f);
+
+	return v;
+}
+
+#define	METER_QUADS	(AX_MAX_CHANNELS * 3 + 6)
+#define	OVERLAY_QUADS	(GX_STAT_CNT * (GX_HIST_BUCKETS + 5) + METER_QUADS)
+
+void GXStatsDrawOverlay(void)
+{
+	if(!overlay && !meters) {
+		return;
+	}
+
+	static float vertices[OVERLAY_QUADS * 6 * 6];
+	float* v = vertices;
+
+	if(meters) {
+		v = push_meters(v);
+	}
+
+	const float left = -0.98f;
+	const float width = 0.9f;
+	const float top = 0.98f;
+	const float row = 0.08f;
+	const float bar = width / GX_HIST_BUCKETS;
+
+	for(unsigned int i = 0; i < GX_STAT_CNT && overlay; i++) {
+		const Histogram* h = &histograms[i];
+		const StatInfo* info = &stat_info[i];
+
+		float y0 = top - (i + 1) * row;
+		float y1 = y0 + row * 0.9f;
+
+		v = push_quad(v, left, y0, left + width, y1, 0.0f, 0.0f, 0.0f, 0.6f);
+
+		uint32_t peak = 1;
+		for(unsigned int n = 0; n < GX_HIST_BUCKETS; n++) {
+			if(h->buckets[n] > peak) {
+				peak = h->buckets[n];
+			}
+		}
+
+		for(unsigned int n = 0; n < GX_HIST_BUCKETS; n++) {
+			float x0 = left + n * bar;
+			float height = (y1 - y0) * h->buckets[n] / peak;
+			v = push_quad(v, x0, y0, x0 + bar * 0.8f, y0 + height, info->r, info->g, info->b, 0.9f);
+		}
+
+		// grid at 100us, 1ms and 10ms
+		const unsigned int grid[3] = { bucket_of(100), bucket_of(1000), bucket_of(10000) };
+		for(unsigned int n = 0; n < 3; n++) {
+			float x = left + grid[n] * bar;
+			v = push_quad(v, x - 0.001f, y0, x + 0.001f, y1, 0.5f, 0.5f, 0.5f, 0.8f);
+		}
+
+		// mean
+		if(h->count) {
+			float x = left + bucket_of(h->sum / h->count) * bar + bar * 0.4f;
+			v = push_quad(v, x - 0.002f, y0, x + 0.002f, y1, 1.0f, 1.0f, 1.0f, 1.0f);
+		}
+	}
+
+	GLsizei count = (v - vertices) / 6;
+
+	glEnable(GL_BLEND);
+	glUseProgram(overlay_shader);
+	glBindVertexArray(overlay_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, overlay_vbo);
+	glBufferData(GL_ARRAY_BUFFER, (v - vertices) * sizeof(float), vertices, GL_STREAM_DRAW);
+	glDrawArrays(GL_TRIANGLES, 0, count);
+}
@@ -0,0 +1,991 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <DeckLinkAPI.h>
+
+#include "deckview.h"
+
+// Hardware-free capture sources. A generator thread produces frames at the
+// rate of the configured display mode and hands them to the same delegate
+// methods the DeckLink driver calls, wrapped in minimal implementations of
+// the DeckLink frame, packet and display mode interfaces. Like the driver
+// it emulates format detection: it starts in 1080p30 8 bit and reports the
+// configured format through VideoInputFormatChanged.
+//
+// Recordings (see RXFileHeader) are played back straight from a read-only
+// mapping of the file: frames point into their slot, which is found by its
+// number alone, so seeking costs nothing and no frame is copied before the
+// upload. The generator thread faults the pages of a frame in before
+// delivering it and asks for the next ones ahead, so the render thread
+// never waits for the disk.
+
+#define	FRAME_POOLCNT	8
+#define	AUDIO_RATE	48000
+#define	TONE_FREQ	1000.0
+#define	BAND_HEIGHT	32
+#define	READAHEAD_FRAMES	2
+
+typedef struct ModeInfo {
+	const char*	name;
+	BMDDisplayMode	mode;
+	long	width;
+	long	height;
+	BMDTimeValue	duration;
+	BMDTimeScale	timescale;
+	BMDFieldDominance	field_dominance;
+} ModeInfo;
+
+static const ModeInfo modes[] = {
+	{ "ntsc",	bmdModeNTSC,		720,  486,  1001, 30000, bmdLowerFieldFirst },
+	{ "pal",	bmdModePAL,		720,  576,  1000, 25000, bmdUpperFieldFirst },
+	{ "720p50",	bmdModeHD720p50,	1280, 720,  1000, 50000, bmdProgressiveFrame },
+	{ "720p5994",	bmdModeHD720p5994,	1280, 720,  1001, 60000, bmdProgressiveFrame },
+	{ "720p60",	bmdModeHD720p60,	1280, 720,  1000, 60000, bmdProgressiveFrame },
+	{ "1080i50",	bmdModeHD1080i50,	1920, 1080, 1000, 25000, bmdUpperFieldFirst },
+	{ "1080i5994",	bmdModeHD1080i5994,	1920, 1080, 1001, 30000, bmdUpperFieldFirst },
+	{ "1080p24",	bmdModeHD1080p24,	1920, 1080, 1000, 24000, bmdProgressiveFrame },
+	{ "1080p25",	bmdModeHD1080p25,	1920, 1080, 1000, 25000, bmdProgressiveFrame },
+	{ "1080p2997",	bmdModeHD1080p2997,	1920, 1080, 1001, 30000, bmdProgressiveFrame },
+	{ "1080p30",	bmdModeHD1080p30,	1920, 1080, 1000, 30000, bmdProgressiveFrame },
+	{ "1080p50",	bmdModeHD1080p50,	1920, 1080, 1000, 50000, bmdProgressiveFrame },
+	{ "1080p5994",	bmdModeHD1080p5994,	1920, 1080, 1001, 60000, bmdProgressiveFrame },
+	{ "1080p60",	bmdModeHD1080p6000,	1920, 1080, 1000, 60000, bmdProgressiveFrame },
+	{ "2160p25",	bmdMode4K2160p25,	3840, 2160, 1000, 25000, bmdProgressiveFrame },
+	{ "2160p2997",	bmdMode4K2160p2997,	3840, 2160, 1001, 30000, bmdProgressiveFrame },
+	{ "2160p30",	bmdMode4K2160p30,	3840, 2160, 1000, 30000, bmdProgressiveFrame },
+	{ "2160p50",	bmdMode4K2160p50,	3840, 2160, 1000, 50000, bmdProgressiveFrame },
+	{ "2160p5994",	bmdMode4K2160p5994,	3840, 2160, 1001, 60000, bmdProgressiveFrame },
+	{ "2160p60",	bmdMode4K2160p60,	3840, 2160, 1000, 60000, bmdProgressiveFrame },
+	{ NULL }
+};
+
+static const ModeInfo* find_mode(const char* name)
+{
+	for(const ModeInfo* m = modes; m->name; m++) {
+		if(!strcmp(m->name, name)) {
+			return m;
+		}
+	}
+	return NULL;
+}
+
+void ListSyntheticModes(void)
+{
+	for(const ModeInfo* m = modes; m->name; m++) {
+		printf("%s%s", m == modes ? "" : " ", m->name);
+	}
+	printf("\n");
+}
+
+static int64_t monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t row_bytes_for(BMDPixelFormat fmt, long width)
+{
+	switch(fmt) {
+		case bmdFormat8BitYUV:
+			return width * 2;
+		case bmdFormat10BitYUV:
+			return ((width + 47) / 48) * 128;
+		case bmdFormat10BitRGB:
+			return ((width + 63) / 64) * 256;
+		default:
+			return 0;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+class SyntheticDisplayMode : public IDeckLinkDisplayMode
+{
+	public:
+		SyntheticDisplayMode(const ModeInfo* info) : info(info) { }
+		virtual ~SyntheticDisplayMode() { }
+
+		virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, LPVOID* ppv) {
+			return E_NOINTERFACE;
+		}
+
+		// only ever used on the stack of the generator thread or owned
+		// by the source
+		virtual ULONG STDMETHODCALLTYPE AddRef(void) {
+			return 1;
+		}
+
+		virtual ULONG STDMETHODCALLTYPE Release(void) {
+			return 1;
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE GetName(const char** name) {
+			*name = strdup(info->name);
+			return S_OK;
+		}
+
+		virtual BMDDisplayMode STDMETHODCALLTYPE GetDisplayMode(void) {
+			return info->mode;
+		}
+
+		virtual long STDMETHODCALLTYPE GetWidth(void) {
+			return info->width;
+		}
+
+		virtual long STDMETHODCALLTYPE GetHeight(void) {
+			return info->height;
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE GetFrameRate(BMDTimeValue* duration, BMDTimeScale* timescale) {
+			*duration = info->duration;
+			*timescale = info->timescale;
+			return S_OK;
+		}
+
+		virtual BMDFieldDominance STDMETHODCALLTYPE GetFieldDominance(void) {
+			return info->field_dominance;
+		}
+
+		virtual BMDDisplayModeFlags STDMETHODCALLTYPE GetFlags(void) {
+			return info->height > 576 ? bmdDisplayModeColorspaceRec709 : bmdDisplayModeColorspaceRec601;
+		}
+
+	private:
+		const ModeInfo*	info;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Frames are pooled like on the card: a frame is free again once only the
+// pool holds a reference to it. If the renderer holds on to all of them,
+// new frames are dropped.
+class SyntheticVideoFrame : public IDeckLinkVideoInputFrame
+{
+	public:
+		SyntheticVideoFrame() : refcnt(1), buffer(NULL), buffer_size(0), mapped(NULL), width(0), height(0), row_bytes(0), format(0), band(-1) { }
+		virtual ~SyntheticVideoFrame() {
+			free(buffer);
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, LPVOID* ppv) {
+			return E_NOINTERFACE;
+		}
+
+		virtual ULONG STDMETHODCALLTYPE AddRef(void) {
+			return __sync_add_and_fetch(&refcnt, 1);
+		}
+
+		virtual ULONG STDMETHODCALLTYPE Release(void) {
+			unsigned int new_refcnt = __sync_sub_and_fetch(&refcnt, 1);
+			if(new_refcnt == 0) {
+				delete this;
+				return 0;
+			}
+			return new_refcnt;
+		}
+
+		virtual long STDMETHODCALLTYPE GetWidth(void) {
+			return width;
+		}
+
+		virtual long STDMETHODCALLTYPE GetHeight(void) {
+			return height;
+		}
+
+		virtual long STDMETHODCALLTYPE GetRowBytes(void) {
+			return row_bytes;
+		}
+
+		virtual BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat(void) {
+			return format;
+		}
+
+		virtual BMDFrameFlags STDMETHODCALLTYPE GetFlags(void) {
+			return bmdFrameFlagDefault;
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE GetBytes(void** bytes) {
+			*bytes = mapped ? (void*) mapped : buffer;
+			return S_OK;
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE GetTimecode(BMDTimecodeFormat fmt, IDeckLinkTimecode** timecode) {
+			*timecode = NULL;
+			return S_FALSE;
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE GetAncillaryData(IDeckLinkVideoFrameAncillary** ancillary) {
+			*ancillary = NULL;
+			return S_FALSE;
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE GetStreamTime(BMDTimeValue* time, BMDTimeValue* duration, BMDTimeScale scale) {
+			*time = stream_time * scale / timescale;
+			*duration = frame_duration * scale / timescale;
+			return S_OK;
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE GetHardwareReferenceTimestamp(BMDTimeScale scale, BMDTimeValue* time, BMDTimeValue* duration) {
+			*time = arrival * scale / 1000000;
+			*duration = frame_duration * scale / timescale;
+			return S_OK;
+		}
+
+		bool IsFree(void) {
+			return __sync_add_and_fetch(&refcnt, 0) == 1;
+		}
+
+		// (Re)allocate the buffer for a new format, returns true if the
+		// content has to be regenerated. buffer is NULL if the allocation
+		// failed, the next call tries again.
+		bool Configure(BMDPixelFormat fmt, long w, long h) {
+			if(buffer && fmt == format && w == width && h == height) {
+				return false;
+			}
+
+			format = fmt;
+			width = w;
+			height = h;
+			row_bytes = row_bytes_for(fmt, w);
+
+			size_t size = row_bytes * height;
+			// page aligned like the DMA buffers of the card, which
+			// lets the recorder write them with direct I/O
+			if(!buffer || size > buffer_size) {
+				free(buffer);
+				if(posix_memalign((void**) &buffer, 4096, size)) {
+					buffer = NULL;
+					size = 0;
+				}
+				buffer_size = size;
+			}
+
+			mapped = NULL;
+			band = -1;
+			return true;
+		}
+
+		// Point the frame at a recorded one instead of its own buffer
+		void Map(const RXFileHeader* header, const uint8_t* data) {
+			format = header->pixel_format;
+			width = header->width;
+			height = header->height;
+			row_bytes = header->row_bytes;
+			mapped = data;
+			band = -1;
+		}
+
+		unsigned int	refcnt;
+		uint8_t*	buffer;
+		size_t	buffer_size;
+		const uint8_t*	mapped;
+		long	width;
+		long	height;
+		long	row_bytes;
+		BMDPixelFormat	format;
+		long	band;
+
+		BMDTimeValue	stream_time;
+		BMDTimeValue	frame_duration;
+		BMDTimeScale	timescale;
+		int64_t	arrival;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class SyntheticAudioPacket : public IDeckLinkAudioInputPacket
+{
+	public:
+		SyntheticAudioPacket() : buffer(NULL), frames(0), packet_time(0) { }
+		virtual ~SyntheticAudioPacket() { }
+
+		virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, LPVOID* ppv) {
+			return E_NOINTERFACE;
+		}
+
+		// only valid for the duration of the callback, like on the card
+		virtual ULONG STDMETHODCALLTYPE AddRef(void) {
+			return 1;
+		}
+
+		virtual ULONG STDMETHODCALLTYPE Release(void) {
+			return 1;
+		}
+
+		virtual long STDMETHODCALLTYPE GetSampleFrameCount(void) {
+			return frames;
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE GetBytes(void** bytes) {
+			*bytes = buffer;
+			return S_OK;
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE GetPacketTime(BMDTimeValue* time, BMDTimeScale scale) {
+			*time = packet_time * scale / AUDIO_RATE;
+			return S_OK;
+		}
+
+		void*	buffer;
+		long	frames;
+		int64_t	packet_time;	// in samples
+};
+
+////////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	uint16_t	y;
+	uint16_t	cb;
+	uint16_t	cr;
+} YCbCr;
+
+// 75% Rec.709 colour bars, 10 bit code values
+static const YCbCr bars[8] = {
+	{ 721, 512, 512 },	// white
+	{ 674, 176, 543 },	// yellow
+	{ 581, 589, 176 },	// cyan
+	{ 534, 253, 207 },	// green
+	{ 251, 771, 817 },	// magenta
+	{ 204, 435, 848 },	// red
+	{ 111, 848, 481 },	// blue
+	{ 64,  512, 512 }	// black
+};
+
+static const YCbCr band_colour = { 940, 512, 512 };
+
+static uint32_t clamp_code(double v)
+{
+	return v < 64.0 ? 64 : v > 940.0 ? 940 : (uint32_t) (v + 0.5);
+}
+
+// Rec.709 YCbCr to RGB, both at 10 bit video levels, as one r210 word
+static uint32_t pack_r210(const YCbCr* p)
+{
+	double y = p->y - 64.0;
+	double cb = (p->cb - 512.0) * 219.0 / 224.0;
+	double cr = (p->cr - 512.0) * 219.0 / 224.0;
+
+	uint32_t r = clamp_code(64.0 + y + 1.5748 * cr);
+	uint32_t g = clamp_code(64.0 + y - 0.1873 * cb - 0.4681 * cr);
+	uint32_t b = clamp_code(64.0 + y + 1.8556 * cb);
+
+	return __builtin_bswap32((r << 20) | (g << 10) | b);
+}
+
+// Pack one row of samples, index() selects the palette entry for pixel x.
+// size is that of row, row_bytes_for(fmt, width).
+static void pack_row(uint8_t* row, size_t size, BMDPixelFormat fmt, long width, const YCbCr* palette, long (*index)(long x, long width))
+{
+	switch(fmt) {
+		case bmdFormat8BitYUV:
+			for(long x = 0; x < width; x += 2) {
+				const YCbCr* a = &palette[index(x, width)];
+				const YCbCr* b = &palette[index(x + 1, width)];
+				*row++ = a->cb >> 2;
+				*row++ = a->y >> 2;
+				*row++ = a->cr >> 2;
+				*row++ = b->y >> 2;
+			}
+			break;
+
+		case bmdFormat10BitYUV: {
+			uint32_t* w = (uint32_t*) row;
+			memset(row, 0, size);
+			for(long x = 0; x < width; x += 6) {
+				YCbCr p[6];
+				for(long i = 0; i < 6; i++) {
+					p[i] = palette[index(x + i < width ? x + i : width - 1, width)];
+				}
+				*w++ = p[0].cb | (p[0].y << 10) | (p[0].cr << 20);
+				*w++ = p[1].y | (p[2].cb << 10) | (p[2].y << 20);
+				*w++ = p[2].cr | (p[3].y << 10) | (p[4].cb << 20);
+				*w++ = p[4].y | (p[4].cr << 10) | (p[5].y << 20);
+			}
+			break;
+		}
+
+		case bmdFormat10BitRGB: {
+			uint32_t* w = (uint32_t*) row;
+			memset(row, 0, size);
+			for(long x = 0; x < width; x++) {
+				*w++ = pack_r210(&palette[index(x, width)]);
+			}
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+static long bar_index(long x, long width)
+{
+	return x * 8 / width;
+}
+
+static long band_index(long x, long width)
+{
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+class SyntheticSource : public CaptureSource
+{
+	public:
+		SyntheticSource(const SyntheticConfig* config);
+		virtual ~SyntheticSource();
+
+		virtual bool	Init(IDeckLinkInputCallback* callback, BMDPixelFormat fmt);
+		virtual bool	Start(BMDPixelFormat fmt, unsigned int sample_depth, unsigned int channels);
+		virtual bool	SetVideoMode(IDeckLinkDisplayMode* mode, BMDPixelFormat fmt);
+		virtual IDeckLinkDisplayMode*	StartMode(void);
+		virtual void	Stop(void);
+		virtual int64_t	ReferenceTime(void);
+		virtual bool	Seek(int64_t frame, bool relative);
+
+	private:
+		static void*	thread_main(void* arg);
+
+		void	Run(void);
+		void	DetectFormat(BMDVideoInputFormatChangedEvents events);
+		bool	PrepareRows(void);
+		bool	FillPattern(SyntheticVideoFrame* f, uint64_t index);
+		bool	FillFile(SyntheticVideoFrame* f);
+		void	FillAudio(long frames, int64_t sample_index);
+		bool	OpenCapture(void);
+		const uint8_t*	NextSlot(uint64_t* n);
+		void	PlayAudio(const uint8_t* slot, uint64_t n);
+
+		SyntheticConfig	config;
+		IDeckLinkInputCallback*	callback;
+		pthread_t	thread;
+		volatile bool	running;
+
+		const ModeInfo*	mode;		// configured mode
+		const ModeInfo*	current;	// mode the "card" is set to
+		SyntheticDisplayMode*	start_mode;	// current before detection
+		volatile BMDPixelFormat	format;
+		unsigned int	depth;
+
+		SyntheticVideoFrame**	pool;
+		SyntheticAudioPacket*	audio;
+		uint8_t*	audio_buffer;
+		unsigned int	audio_channels;
+		unsigned int	sample_bytes;
+
+		int	video_fd;
+		int	audio_fd;
+
+		uint8_t*	capture;	// mapping of the recording
+		size_t	capture_size;
+		const RXFileHeader*	capture_header;
+		const RXFileIndex*	capture_index;	// NULL if interrupted
+		uint64_t	capture_frames;
+		volatile int64_t	position;	// next frame to play, wrapped
+
+		uint8_t*	bars_row;
+		uint8_t*	band_row;
+		size_t	row_size;
+		BMDPixelFormat	row_format;
+		long	row_width;
+		bool	alloc_failed;	// reported once until a frame is filled again
+};
+
+SyntheticSource::SyntheticSource(const SyntheticConfig* cfg) : config(*cfg), callback(NULL), thread(0), running(false), pool(NULL), audio(NULL), audio_buffer(NULL), audio_channels(0), sample_bytes(2), video_fd(-1), audio_fd(-1), capture(NULL), capture_size(0), capture_header(NULL), capture_index(NULL), capture_frames(0), position(0), bars_row(NULL), band_row(NULL), row_size(0), row_format(0), row_width(0), alloc_failed(false)
+{
+	mode = find_mode(config.mode);
+	current = find_mode("1080p30");
+	start_mode = new SyntheticDisplayMode(current);
+	format = bmdFormat8BitYUV;
+	depth = config.depth;
+
+	pool = new SyntheticVideoFrame*[FRAME_POOLCNT];
+	for(unsigned int i = 0; i < FRAME_POOLCNT; i++) {
+		pool[i] = new SyntheticVideoFrame();
+	}
+	audio = new SyntheticAudioPacket();
+}
+
+SyntheticSource::~SyntheticSource()
+{
+	Stop();
+
+	for(unsigned int i = 0; i < FRAME_POOLCNT; i++) {
+		pool[i]->Release();
+	}
+	delete[] pool;
+	delete audio;
+	delete start_mode;
+	free(audio_buffer);
+
+	if(video_fd >= 0) {
+		close(video_fd);
+	}
+
+	if(audio_fd >= 0) {
+		close(audio_fd);
+	}
+
+	if(capture) {
+		munmap(capture, capture_size);
+	}
+
+	free(bars_row);
+	free(band_row);
+}
+
+bool SyntheticSource::Init(IDeckLinkInputCallback* cb, BMDPixelFormat fmt)
+{
+	if(!mode) {
+		fprintf(stderr, "Unknown video mode %s\n", config.mode);
+		return false;
+	}
+
+	if(config.depth != 8 && config.depth != 10) {
+		fprintf(stderr, "Unsupported bit depth %u\n", config.depth);
+		return false;
+	}
+
+	if(config.capture_path) {
+		if(!OpenCapture()) {
+			return false;
+		}
+	} else if(config.video_path) {
+		video_fd = open(config.video_path, O_RDONLY);
+		if(video_fd < 0) {
+			fprintf(stderr, "Failed to open %s\n", config.video_path);
+			return false;
+		}
+	}
+
+	if(config.audio_path) {
+		audio_fd = open(config.audio_path, O_RDONLY);
+		if(audio_fd < 0) {
+			fprintf(stderr, "Failed to open %s\n", config.audio_path);
+			return false;
+		}
+	}
+
+	callback = cb;
+	format = fmt;
+
+	return true;
+}
+
+bool SyntheticSource::Start(BMDPixelFormat fmt, unsigned int sample_depth, unsigned int channels)
+{
+	if(sample_depth != 16 && sample_depth != 32) {
+		fprintf(stderr, "Synthetic audio only supports 16 and 32 bit samples\n");
+		return false;
+	}
+
+	format = fmt;
+	audio_channels = channels;
+	sample_bytes = sample_depth / 8;
+
+	// one second is more than any frame duration
+	free(audio_buffer);
+	audio_buffer = (uint8_t*) malloc(AUDIO_RATE * channels * sample_bytes);
+	audio->buffer = audio_buffer;
+
+	running = true;
+	if(pthread_create(&thread, NULL, thread_main, this)) {
+		running = false;
+		thread = 0;
+		return false;
+	}
+
+	return true;
+}
+
+// Called from VideoInputFormatChanged on the generator thread
+bool SyntheticSource::SetVideoMode(IDeckLinkDisplayMode* m, BMDPixelFormat fmt)
+{
+	const ModeInfo* info = NULL;
+	for(const ModeInfo* i = modes; i->name; i++) {
+		if(i->mode == m->GetDisplayMode()) {
+			info = i;
+		}
+	}
+
+	if(!info || !row_bytes_for(fmt, info->width)) {
+		return false;
+	}
+
+	current = info;
+	format = fmt;
+	return true;
+}
+
+IDeckLinkDisplayMode* SyntheticSource::StartMode(void)
+{
+	return start_mode;
+}
+
+void SyntheticSource::Stop(void)
+{
+	if(thread) {
+		running = false;
+		pthread_join(thread, NULL);
+		thread = 0;
+	}
+}
+
+int64_t SyntheticSource::ReferenceTime(void)
+{
+	return monotonic_us();
+}
+
+// Takes effect with the next frame, the generator wraps the position
+bool SyntheticSource::Seek(int64_t frame, bool relative)
+{
+	if(!capture) {
+		return false;
+	}
+
+	if(relative) {
+		__atomic_add_fetch(&position, frame, __ATOMIC_ACQ_REL);
+	} else {
+		__atomic_store_n(&position, frame, __ATOMIC_RELEASE);
+	}
+	return true;
+}
+
+bool SyntheticSource::OpenCapture(void)
+{
+	int fd = open(config.capture_path, O_RDONLY);
+	if(fd < 0) {
+		fprintf(stderr, "Failed to open %s\n", config.capture_path);
+		return false;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) < 0 || (size_t) st.st_size < RX_FILE_ALIGN) {
+		fprintf(stderr, "%s is not a recording\n", config.capture_path);
+		close(fd);
+		return false;
+	}
+
+	capture_size = st.st_size;
+	void* map = mmap(NULL, capture_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		fprintf(stderr, "Failed to map %s\n", config.capture_path);
+		return false;
+	}
+	capture = (uint8_t*) map;
+
+	const RXFileHeader* h = (const RXFileHeader*) capture;
+	capture_header = h;
+	if(memcmp(h->magic, RX_FILE_MAGIC, sizeof(h->magic)) || !h->timescale || !h->frame_duration ||
+			h->audio_offset < (uint64_t) h->row_bytes * h->height || h->slot_stride < h->audio_offset + sizeof(RXFileIndex) ||
+			!row_bytes_for(h->pixel_format, h->width) || row_bytes_for(h->pixel_format, h->width) > h->row_bytes || h->data_offset > capture_size) {
+		fprintf(stderr, "%s is not a recording\n", config.capture_path);
+		return false;
+	}
+
+	mode = NULL;
+	for(const ModeInfo* m = modes; m->name; m++) {
+		if(m->mode == h->display_mode) {
+			mode = m;
+		}
+	}
+
+	if(!mode) {
+		fprintf(stderr, "%s: unsupported display mode\n", config.capture_path);
+		return false;
+	}
+
+	depth = h->pixel_format == bmdFormat8BitYUV ? 8 : 10;
+	config.rgb = h->pixel_format == bmdFormat10BitRGB;
+
+	if(h->index_offset && h->index_offset + h->frame_count * sizeof(RXFileIndex) <= capture_size) {
+		capture_index = (const RXFileIndex*) (capture + h->index_offset);
+		capture_frames = h->frame_count;
+	} else {
+		// every complete slot holds its own index entry
+		capture_frames = (capture_size - h->data_offset) / h->slot_stride;
+		fprintf(stderr, "%s has no index, the recording was interrupted\n", config.capture_path);
+	}
+
+	if(!capture_frames) {
+		fprintf(stderr, "%s holds no frames\n", config.capture_path);
+		return false;
+	}
+
+	position = (int64_t) (config.start * h->timescale / h->frame_duration);
+
+	printf("Playing %s: %s, %llu frames (%.1f s)\n", config.capture_path, mode->name, (unsigned long long) capture_frames, (double) capture_frames * h->frame_duration / h->timescale);
+
+	return true;
+}
+
+// Slot of the frame to play, the position moves on unless a seek moved it
+// meanwhile. Its pages are faulted in here and the following ones read
+// ahead.
+const uint8_t* SyntheticSource::NextSlot(uint64_t* n)
+{
+	const RXFileHeader* h = capture_header;
+
+	int64_t pos = __atomic_load_n(&position, __ATOMIC_ACQUIRE);
+	int64_t wrapped = pos % (int64_t) capture_frames;
+	if(wrapped < 0) {
+		wrapped += capture_frames;
+	}
+	__atomic_compare_exchange_n(&position, &pos, wrapped + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+
+	*n = wrapped;
+	const uint8_t* slot = capture + h->data_offset + *n * h->slot_stride;
+
+	uint64_t ahead = capture_frames - *n - 1;
+	if(ahead > READAHEAD_FRAMES) {
+		ahead = READAHEAD_FRAMES;
+	}
+	if(ahead) {
+		madvise((void*) (slot + h->slot_stride), ahead * h->slot_stride, MADV_WILLNEED);
+	}
+
+	uint8_t sum = 0;
+	for(size_t i = 0; i < h->slot_stride; i += RX_FILE_ALIGN) {
+		sum += slot[i];
+	}
+	__asm__ volatile("" : : "r" (sum));
+
+	return slot;
+}
+
+// The recorded audio of the slot, silence if it doesn't match the format
+// the output was opened with
+void SyntheticSource::PlayAudio(const uint8_t* slot, uint64_t n)
+{
+	const RXFileHeader* h = capture_header;
+	const uint8_t* audio_part = slot + h->audio_offset;
+	const RXFileIndex* entry = capture_index ? &capture_index[n] : (const RXFileIndex*) audio_part;
+
+	size_t bytes = (size_t) entry->audio_frames * audio_channels * sample_bytes;
+	if(h->audio_channels == audio_channels && h->sample_depth == sample_bytes * 8 && entry->audio_frames && sizeof(RXFileIndex) + bytes <= h->slot_stride - h->audio_offset) {
+		audio->buffer = (void*) (audio_part + sizeof(RXFileIndex));
+		audio->frames = entry->audio_frames;
+	} else {
+		audio->buffer = audio_buffer;
+		memset(audio_buffer, 0, audio->frames * audio_channels * sample_bytes);
+	}
+}
+
+void* SyntheticSource::thread_main(void* arg)
+{
+	((SyntheticSource*) arg)->Run();
+	return NULL;
+}
+
+void SyntheticSource::DetectFormat(BMDVideoInputFormatChangedEvents events)
+{
+	SyntheticDisplayMode display_mode(mode);
+	BMDDetectedVideoInputFormatFlags flags = depth == 10 && config.rgb ? bmdDetectedVideoInputRGB444 : bmdDetectedVideoInputYCbCr422;
+	flags |= depth == 10 ? bmdDetectedVideoInput10BitDepth : bmdDetectedVideoInput8BitDepth;
+	callback->VideoInputFormatChanged(events, &display_mode, flags);
+}
+
+bool SyntheticSource::PrepareRows(void)
+{
+	size_t size = row_bytes_for(format, current->width);
+	if(size > row_size) {
+		free(bars_row);
+		free(band_row);
+		bars_row = (uint8_t*) malloc(size);
+		band_row = (uint8_t*) malloc(size);
+		row_size = size;
+		if(!bars_row || !band_row) {
+			row_size = 0;
+			return false;
+		}
+	}
+
+	pack_row(bars_row, size, format, current->width, bars, bar_index);
+	pack_row(band_row, size, format, current->width, &band_colour, band_index);
+	row_format = format;
+	row_width = current->width;
+	return true;
+}
+
+// Colour bars with a band moving down one step per frame. Only the rows
+// touched by the band are rewritten, so generating 4K frames is cheap.
+// Returns false if a buffer could not be allocated.
+bool SyntheticSource::FillPattern(SyntheticVideoFrame* f, uint64_t index)
+{
+	if((row_format != format || row_width != current->width) && !PrepareRows()) {
+		return false;
+	}
+
+	if(f->Configure(format, current->width, current->height)) {
+		if(!f->buffer) {
+			return false;
+		}
+		for(long y = 0; y < f->height; y++) {
+			memcpy(f->buffer + y * f->row_bytes, bars_row, f->row_bytes);
+		}
+	}
+
+	long bands = f->height / BAND_HEIGHT;
+	long band = index % bands;
+
+	if(f->band >= 0) {
+		for(long y = f->band * BAND_HEIGHT; y < (f->band + 1) * BAND_HEIGHT; y++) {
+			memcpy(f->buffer + y * f->row_bytes, bars_row, f->row_bytes);
+		}
+	}
+
+	for(long y = band * BAND_HEIGHT; y < (band + 1) * BAND_HEIGHT; y++) {
+		memcpy(f->buffer + y * f->row_bytes, band_row, f->row_bytes);
+	}
+	f->band = band;
+	return true;
+}
+
+// Raw frames back to back in the capture format, looped at the end
+bool SyntheticSource::FillFile(SyntheticVideoFrame* f)
+{
+	f->Configure(format, current->width, current->height);
+	if(!f->buffer) {
+		return false;
+	}
+
+	size_t size = f->row_bytes * f->height;
+	ssize_t n = read(video_fd, f->buffer, size);
+	if(n < (ssize_t) size) {
+		lseek(video_fd, 0, SEEK_SET);
+		n = read(video_fd, f->buffer, size);
+		if(n < (ssize_t) size) {
+			memset(f->buffer, 0, size);
+		}
+	}
+	return true;
+}
+
+void SyntheticSource::FillAudio(long frames, int64_t sample_index)
+{
+	size_t size = frames * audio_channels * sample_bytes;
+
+	if(audio_fd >= 0) {
+		ssize_t n = read(audio_fd, audio_buffer, size);
+		if(n < (ssize_t) size) {
+			lseek(audio_fd, 0, SEEK_SET);
+			memset(audio_buffer + (n > 0 ? n : 0), 0, size - (n > 0 ? n : 0));
+		}
+		return;
+	}
+
+	// -20 dBFS 1 kHz tone on all channels
+	int16_t* s16 = (int16_t*) audio_buffer;
+	int32_t* s32 = (int32_t*) audio_buffer;
+	for(long i = 0; i < frames; i++) {
+		double t = (double) (sample_index + i) / AUDIO_RATE;
+		double v = 0.1 * sin(2.0 * M_PI * TONE_FREQ * t);
+		for(unsigned int c = 0; c < audio_channels; c++) {
+			if(sample_bytes == 2) {
+				*s16++ = (int16_t) (v * 32767.0);
+			} else {
+				*s32++ = (int32_t) (v * 2147483647.0);
+			}
+		}
+	}
+}
+
+void SyntheticSource::Run(void)
+{
+	// report the configured format like the card's format detection
+	DetectFormat(bmdVideoInputDisplayModeChanged | bmdVideoInputColorspaceChanged);
+
+	uint64_t index = 0;
+	int64_t samples = 0;
+	int64_t start = monotonic_us();
+	int64_t last_switch = start;
+	unsigned int burst = config.burst ? config.burst : 1;
+
+	while(running) {
+		const ModeInfo* m = current;
+
+		// deliver a burst of frames at the time the last one is due
+		int64_t due = start + (int64_t) ((index + burst - 1) * m->duration * 1000000 / m->timescale);
+		int64_t now = monotonic_us();
+		if(due > now) {
+			struct timespec ts;
+			ts.tv_sec = due / 1000000;
+			ts.tv_nsec = (due % 1000000) * 1000;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		}
+
+		for(unsigned int b = 0; b < burst && running; b++) {
+			SyntheticVideoFrame* f = NULL;
+			for(unsigned int i = 0; i < FRAME_POOLCNT; i++) {
+				if(pool[(index + i) % FRAME_POOLCNT]->IsFree()) {
+					f = pool[(index + i) % FRAME_POOLCNT];
+					break;
+				}
+			}
+
+			uint64_t n = 0;
+			const uint8_t* slot = capture ? NextSlot(&n) : NULL;
+
+			// a frame that could not be allocated is skipped like one
+			// with no pool frame free
+			bool filled = true;
+			if(f) {
+				if(slot) {
+					f->Map(capture_header, slot);
+				} else if(video_fd >= 0) {
+					filled = FillFile(f);
+				} else {
+					filled = FillPattern(f, index);
+				}
+			}
+			if(!filled) {
+				if(!alloc_failed) {
+					fprintf(stderr, "Synthetic source: failed to allocate a %ldx%ld frame, skipping\n", current->width, current->height);
+				}
+				f = NULL;
+			}
+			alloc_failed = !filled;
+
+			if(f) {
+				f->stream_time = index * m->duration;
+				f->frame_duration = m->duration;
+				f->timescale = m->timescale;
+				f->arrival = monotonic_us();
+			}
+
+			// audio samples belonging to this frame, sample accurate
+			// for fractional frame rates
+			int64_t next = (int64_t) ((index + 1) * m->duration * AUDIO_RATE / m->timescale);
+			audio->frames = next - samples;
+			audio->packet_time = samples;
+			if(slot) {
+				PlayAudio(slot, n);
+			} else {
+				FillAudio(audio->frames, samples);
+			}
+			samples += audio->frames;
+
+			// a NULL frame means all pool frames are still in use
+			callback->VideoInputFrameArrived(f, audio);
+			index++;
+		}
+
+		if(config.format_interval > 0 && video_fd < 0 && !capture && monotonic_us() - last_switch >= config.format_interval * 1000000) {
+			last_switch = monotonic_us();
+			depth = depth == 8 ? 10 : 8;
+			DetectFormat(bmdVideoInputColorspaceChanged);
+		}
+	}
+}
+
+CaptureSource* CreateSyntheticSource(const SyntheticConfig* config)
+{
+	return new SyntheticSource(config);
+}
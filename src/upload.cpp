@@ -0,0 +1,246 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "deckview.h"
+
+// Upper bound for waiting on a PBO fence before reusing the buffer
+#define	PBO_FENCE_TIMEOUT	100000000 /* ns */
+
+typedef struct {
+	GLenum	internal_format;
+	GLenum	format;
+	GLenum	type;
+	GLsizei	width;
+	GLsizei	height;
+} TextureFormat;
+
+static bool get_texture_format(TextureFormat* tf, BMDPixelFormat fmt, unsigned int width, unsigned int height, unsigned int row_bytes)
+{
+	switch(fmt) {
+		case bmdFormat8BitYUV:
+			// one RGBA texel per UYVY macropixel
+			tf->internal_format = GL_RGBA8;
+			tf->format = GL_BGRA;
+			tf->type = GL_UNSIGNED_INT_8_8_8_8_REV;
+			tf->width = width / 2;
+			tf->height = height;
+			return true;
+
+		case bmdFormat10BitYUV:
+			// one RGB10_A2 texel per 32bit v210 word
+			tf->internal_format = GL_RGB10_A2;
+			tf->format = GL_RGBA;
+			tf->type = GL_UNSIGNED_INT_2_10_10_10_REV;
+			tf->width = row_bytes / 4;
+			tf->height = height;
+			return true;
+
+		case bmdFormat10BitRGB:
+			// one RGB10_A2 texel per big endian r210 word, the shader
+			// swaps the bytes back
+			tf->internal_format = GL_RGB10_A2;
+			tf->format = GL_RGBA;
+			tf->type = GL_UNSIGNED_INT_2_10_10_10_REV;
+			tf->width = row_bytes / 4;
+			tf->height = height;
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+const char* GXUploadModeName(GXUploadMode mode)
+{
+	switch(mode) {
+		case GX_UPLOAD_DIRECT:
+			return "direct";
+		case GX_UPLOAD_PBO:
+			return "pbo";
+		default:
+			return "unknown";
+	}
+}
+
+bool GXUploadSupported(GXUploadMode mode)
+{
+	switch(mode) {
+		case GX_UPLOAD_DIRECT:
+			return true;
+		case GX_UPLOAD_PBO:
+			return GXExtensionSupported("GL_ARB_buffer_storage") &&
+				GXExtensionSupported("GL_ARB_texture_storage") &&
+				GXExtensionSupported("GL_ARB_sync");
+		default:
+			return false;
+	}
+}
+
+static void destroy_pbos(GXRenderer* self)
+{
+	for(unsigned int i = 0; i < GX_PBO_CNT; i++) {
+		if(self->pbo_fence[i]) {
+			glClientWaitSync(self->pbo_fence[i], GL_SYNC_FLUSH_COMMANDS_BIT, PBO_FENCE_TIMEOUT);
+			glDeleteSync(self->pbo_fence[i]);
+			self->pbo_fence[i] = 0;
+		}
+
+		if(self->pbo[i]) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, self->pbo[i]);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &self->pbo[i]);
+			self->pbo[i] = 0;
+			self->pbo_ptr[i] = NULL;
+		}
+	}
+
+	self->pbo_size = 0;
+	self->pbo_idx = 0;
+}
+
+static bool create_pbos(GXRenderer* self, size_t size)
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(GX_PBO_CNT, self->pbo);
+	for(unsigned int i = 0; i < GX_PBO_CNT; i++) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, self->pbo[i]);
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+		self->pbo_ptr[i] = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+		if(!self->pbo_ptr[i]) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			printf("Failed to map pixel buffer object\n");
+			destroy_pbos(self);
+			return false;
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	self->pbo_size = size;
+	self->pbo_idx = 0;
+
+	return true;
+}
+
+// Immutable storage cannot be respecified, so a format change replaces the
+// texture object. The mutable texture is recreated when leaving PBO mode.
+static void recreate_texture(GXRenderer* self)
+{
+	glDeleteTextures(1, &self->frame);
+	GXCreateTexture(self);
+	self->frame_immutable = false;
+	self->frame_internal_format = 0;
+	self->frame_tex_width = 0;
+	self->frame_tex_height = 0;
+}
+
+void GXSetUploadMode(GXRenderer* self, GXUploadMode mode)
+{
+	if(!GXUploadSupported(mode)) {
+		printf("Upload mode %s is not supported, using %s\n", GXUploadModeName(mode), GXUploadModeName(GX_UPLOAD_DIRECT));
+		mode = GX_UPLOAD_DIRECT;
+	}
+
+	if(self->frame_immutable && mode != GX_UPLOAD_PBO) {
+		recreate_texture(self);
+	}
+
+	if(mode != GX_UPLOAD_PBO) {
+		destroy_pbos(self);
+	}
+
+	self->upload_mode = mode;
+}
+
+static void upload_direct(GXRenderer* self, const TextureFormat* tf, const void* data)
+{
+	glTexImage2D(GL_TEXTURE_2D, 0, tf->internal_format, tf->width, tf->height, 0, tf->format, tf->type, (GLvoid*) data);
+	GL_ERROR();
+}
+
+static void upload_pbo(GXRenderer* self, const TextureFormat* tf, const void* data, size_t size)
+{
+	if(!self->frame_immutable ||
+			self->frame_internal_format != tf->internal_format ||
+			self->frame_tex_width != tf->width ||
+			self->frame_tex_height != tf->height) {
+		recreate_texture(self);
+		glTexStorage2D(GL_TEXTURE_2D, 1, tf->internal_format, tf->width, tf->height);
+		GL_ERROR();
+
+		self->frame_immutable = true;
+		self->frame_internal_format = tf->internal_format;
+		self->frame_tex_width = tf->width;
+		self->frame_tex_height = tf->height;
+	}
+
+	if(self->pbo_size < size) {
+		destroy_pbos(self);
+		if(!create_pbos(self, size)) {
+			GXSetUploadMode(self, GX_UPLOAD_DIRECT);
+			upload_direct(self, tf, data);
+			return;
+		}
+	}
+
+	unsigned int i = self->pbo_idx;
+	self->pbo_idx = (self->pbo_idx + 1) % GX_PBO_CNT;
+
+	// Wait until the GPU is done reading from this buffer. If it still
+	// isn't, the buffer is skipped and its fence kept, this frame is
+	// uploaded from client memory into the immutable texture.
+	if(self->pbo_fence[i]) {
+		GLenum wait = glClientWaitSync(self->pbo_fence[i], GL_SYNC_FLUSH_COMMANDS_BIT, PBO_FENCE_TIMEOUT);
+		if(wait != GL_ALREADY_SIGNALED && wait != GL_CONDITION_SATISFIED) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tf->width, tf->height, tf->format, tf->type, (GLvoid*) data);
+			GL_ERROR();
+			return;
+		}
+		glDeleteSync(self->pbo_fence[i]);
+		self->pbo_fence[i] = 0;
+	}
+
+	memcpy(self->pbo_ptr[i], data, size);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, self->pbo[i]);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tf->width, tf->height, tf->format, tf->type, (GLvoid*) 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	GL_ERROR();
+
+	self->pbo_fence[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void GXUploadFrame(GXRenderer* self, BMDPixelFormat fmt, unsigned int width, unsigned int height, unsigned int row_bytes, const void* data)
+{
+	TextureFormat tf;
+	if(!get_texture_format(&tf, fmt, width, height, row_bytes)) {
+		return;
+	}
+
+	self->frame_format = fmt;
+	self->frame_width = width;
+	self->frame_height = height;
+	self->unpack_pending = true;
+	self->frame_count++;
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, self->frame);
+
+	switch(self->upload_mode) {
+		case GX_UPLOAD_DIRECT:
+			upload_direct(self, &tf, data);
+			break;
+		case GX_UPLOAD_PBO:
+			upload_pbo(self, &tf, data, (size_t) row_bytes * height);
+			break;
+	}
+}
+
+void GXUploadDestroy(GXRenderer* self)
+{
+	destroy_pbos(self);
+}